@@ -15,6 +15,9 @@
 % SVISSETRESMAP     Set a codec's resolution map
 % SVISSETSRC        Set a codec's source image
 % SVISENCODE        Encode the source image
+% SVISCODECRGB      Create a space variant imaging system color codec
+% SVISSETSRCRGB     Set a color codec's source image
+% SVISENCODERGB     Encode the color source image
 %
 % HISTORY
 % -------
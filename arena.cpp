@@ -0,0 +1,96 @@
+// Aligned storage for pyramid and mask images.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "arena.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace SVIS
+{
+
+static unsigned char *AlignedAlloc (size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+    void *p = _aligned_malloc (bytes, alignment);
+#else
+    void *p = 0;
+    if (posix_memalign (&p, alignment, bytes) != 0)
+        p = 0;
+#endif
+    if (!p)
+        throw bad_alloc ();
+    return static_cast<unsigned char *> (p);
+}
+
+static void AlignedFree (unsigned char *p)
+{
+#ifdef _WIN32
+    _aligned_free (p);
+#else
+    free (p);
+#endif
+}
+
+Arena::Arena (bool huge_pages) :
+    huge_pages (huge_pages),
+    data (0),
+    capacity (0),
+    used (0)
+{
+}
+
+Arena::~Arena ()
+{
+    if (data)
+        AlignedFree (data);
+}
+
+void Arena::Reset (size_t bytes)
+{
+    used = 0;
+    if (bytes <= capacity)
+        return;
+
+    if (data)
+        AlignedFree (data);
+    data = 0;
+    capacity = 0;
+
+    const bool huge = huge_pages && bytes >= HUGE_PAGE;
+    const size_t size = Align (bytes, huge ? HUGE_PAGE : CACHE_LINE);
+    data = AlignedAlloc (size, huge ? HUGE_PAGE : CACHE_LINE);
+    capacity = size;
+#if defined (MADV_HUGEPAGE)
+    // This is only advice, so a failure is not an error
+    if (huge)
+        madvise (data, size, MADV_HUGEPAGE);
+#endif
+}
+
+unsigned char *Arena::Allocate (size_t bytes)
+{
+    const size_t size = Align (bytes, CACHE_LINE);
+    if (used + size > capacity)
+        throw runtime_error ("The arena is too small");
+    unsigned char *p = data + used;
+    used += size;
+    memset (p, 0, bytes);
+    return p;
+}
+
+} // namespace SVIS
@@ -0,0 +1,68 @@
+// Aligned storage for pyramid and mask images.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+namespace SVIS
+{
+
+// One block of memory that images are carved out of.  Each allocation
+// starts on a cache line, and row pitches are padded to a multiple of
+// the vector width, so the rows of every image are aligned for SIMD
+// loads.  The memory is kept when the arena is reset, so it is only
+// allocated again if a larger one is needed.
+class Arena
+{
+    public:
+    static const size_t CACHE_LINE = 64;
+    static const size_t VECTOR_WIDTH = 32;
+    static const size_t HUGE_PAGE = 2 << 20;
+
+    // If 'huge_pages' is true, blocks of at least HUGE_PAGE bytes are
+    // aligned to huge page boundaries and the kernel is advised to
+    // back them with transparent huge pages, where it can.
+    explicit Arena (bool huge_pages = true);
+    ~Arena ();
+    // Discard all allocations, and make sure that at least 'bytes'
+    // are available.  Pointers from earlier allocations are invalid.
+    void Reset (size_t bytes);
+    // Return 'bytes' of zeroed, cache line aligned memory
+    unsigned char *Allocate (size_t bytes);
+    size_t Capacity () const { return capacity; }
+    size_t Used () const { return used; }
+
+    // Round 'n' up to a multiple of 'alignment', a power of 2
+    static size_t Align (size_t n, size_t alignment)
+    {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+    // The row pitch of an image 'width' pixels wide
+    static unsigned Pitch (unsigned width)
+    {
+        return static_cast<unsigned> (Align (width, VECTOR_WIDTH));
+    }
+    // The number of bytes to reserve for an image of 'bytes' per pixel
+    static size_t Size (unsigned width, unsigned height, size_t bytes = 1)
+    {
+        return Align (static_cast<size_t> (Pitch (width)) * height * bytes, CACHE_LINE);
+    }
+
+    private:
+    bool huge_pages;
+    unsigned char *data;
+    size_t capacity;
+    size_t used;
+    // Disable copying
+    Arena (const Arena &);
+    Arena &operator= (const Arena &);
+};
+
+} // namespace SVIS
+
+#endif // ARENA_H
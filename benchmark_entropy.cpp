@@ -0,0 +1,128 @@
+// Benchmark compression routines
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// For each level of an encoded pyramid, report the bits per pixel of
+// the compressed blocks and how fast they are compressed and
+// decompressed.
+
+#include <chrono>
+#include "entropy.h"
+#include "foveate.h"
+#include <iomanip>
+#include <iostream>
+#include "pnm_util.h"
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+// Call f for about a quarter of a second and return the seconds per
+// call
+template<typename F>
+double Time (F f)
+{
+    size_t count = 0;
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now ();
+    double elapsed = 0.0;
+    while (elapsed < 0.25)
+    {
+        f ();
+        ++count;
+        elapsed = chrono::duration<double> (chrono::steady_clock::now () - t1).count ();
+    }
+    return elapsed / count;
+}
+
+void benchmark1 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    const unsigned LEVELS = 5;
+    Image src = { W, H, 0, src_image.GetPixelsAddress () };
+    FoveationPyramid p;
+    p.Create (src, LEVELS);
+    p.Reduce ();
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+    FoveationEncode (p, masks, W / 2, H / 2);
+
+    cout << "level      pixels    bits/pixel    encode MB/s    decode MB/s" << endl;
+    for (unsigned n = 0; n < LEVELS; ++n)
+    {
+        // Gather the blocks of this level
+        const Image &i = p.images[n];
+        vector<unsigned> offsets;
+        vector<Region> blocks;
+        size_t pixels = 0;
+        for (unsigned r = 0; r < p.regions[n].size (); ++r)
+        {
+            Region b = p.regions[n][r];
+            b.x1 >>= n;
+            b.y1 >>= n;
+            b.x2 >>= n;
+            b.y2 >>= n;
+            if (b.x2 == b.x1 || b.y2 == b.y1)
+                continue;
+            blocks.push_back (b);
+            offsets.push_back (pixels);
+            pixels += (b.x2 - b.x1) * (b.y2 - b.y1);
+        }
+        if (pixels == 0)
+            continue;
+
+        vector<unsigned char> residuals (pixels);
+        vector<unsigned char> stream;
+        double encode = Time ([&] () {
+            for (unsigned k = 0; k < blocks.size (); ++k)
+                Predict (i.pixels + blocks[k].y1 * Pitch (i) + blocks[k].x1,
+                    Pitch (i),
+                    blocks[k].x2 - blocks[k].x1,
+                    blocks[k].y2 - blocks[k].y1,
+                    &residuals[offsets[k]]);
+            stream.clear ();
+            RansEncode (&residuals[0], pixels, stream);
+        });
+
+        vector<unsigned char> decoded (pixels);
+        vector<unsigned char> dest (Pitch (i) * (i.height >> n));
+        double decode = Time ([&] () {
+            RansDecode (&stream[0], stream.size (), &decoded[0], pixels);
+            for (unsigned k = 0; k < blocks.size (); ++k)
+                Unpredict (&decoded[offsets[k]],
+                    blocks[k].x2 - blocks[k].x1,
+                    blocks[k].y2 - blocks[k].y1,
+                    &dest[blocks[k].y1 * Pitch (i) + blocks[k].x1],
+                    Pitch (i));
+        });
+
+        cout << setw (5) << n
+            << setw (12) << pixels
+            << setw (14) << fixed << setprecision (2) << 8.0 * stream.size () / pixels
+            << setw (15) << setprecision (1) << pixels / encode / 1e6
+            << setw (15) << pixels / decode / 1e6
+            << endl;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        benchmark1 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -10,18 +10,20 @@
 #include "filter.h"
 #include <iostream>
 #include <stdexcept>
+#include <vector>
 
 using namespace std;
 
-void benchmark1 ()
+template<typename T>
+void benchmark1 (const char *name)
 {
     // Setup image buffers
     const unsigned W = 256;
     const unsigned H = 256;
 
-    SVIS::Image src = { W, H, 0, new unsigned char [W * H] };
-    SVIS::Image dest = { W, H, 1, new unsigned char [(W / 2) * (H / 2)] };
-    SVIS::Image final = { W, H, 0, new unsigned char [W * H] };
+    SVIS::ImageT<T> src = { W, H, 0, new T [W * H] };
+    SVIS::ImageT<T> dest = { W, H, 1, new T [(W / 2) * (H / 2)] };
+    SVIS::ImageT<T> final = { W, H, 0, new T [W * H] };
 
     size_t count = 0;
     time_t t = clock ();
@@ -32,7 +34,7 @@ void benchmark1 ()
         ++count;
     }
 
-    cout << count << "Hz" << endl;
+    cout << name << " " << count << "Hz" << endl;
 
     // Free image buffers
     delete [] src.pixels;
@@ -40,11 +42,43 @@ void benchmark1 ()
     delete [] final.pixels;
 }
 
+template<typename T>
+void benchmark2 (const char *name)
+{
+    // Blend a whole image through a mask of the same size
+    const unsigned W = 256;
+    const unsigned H = 256;
+
+    vector<T> src_pixels (W * H, 100);
+    vector<T> dest_pixels (W * H, 200);
+    vector<unsigned char> mask_pixels (W * H);
+    for (unsigned i = 0; i < mask_pixels.size (); ++i)
+        mask_pixels[i] = i;
+    SVIS::ImageT<T> src = { W, H, 0, &src_pixels[0] };
+    SVIS::ImageT<T> dest = { W, H, 0, &dest_pixels[0] };
+    SVIS::Image mask = { W, H, 0, &mask_pixels[0] };
+    vector<SVIS::BlendSpan> spans;
+    SVIS::CompileBlend (&src, &mask, 0, 0, 0, spans);
+
+    size_t count = 0;
+    time_t t = clock ();
+    while (static_cast<double> (clock () - t) / CLOCKS_PER_SEC < 1.0)
+    {
+        SVIS::BlendSpans (&src, &dest, &mask, &spans[0], spans.size ());
+        ++count;
+    }
+
+    cout << name << " blend " << count << "Hz" << endl;
+}
+
 int main (int argc, char *argv[])
 {
     try
     {
-        benchmark1 ();
+        benchmark1<unsigned char> ("8 bit");
+        benchmark1<unsigned short> ("16 bit");
+        benchmark2<unsigned char> ("8 bit");
+        benchmark2<unsigned short> ("16 bit");
 
         return 0;
     }
@@ -0,0 +1,84 @@
+// Benchmark splitting interleaved images into planes
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// Compare splitting and merging a frame with scalar loops, with
+// Deinterleave and Interleave, and with reducing one of its planes.
+
+#include <chrono>
+#include <cstdlib>
+#include "interleave.h"
+#include <iostream>
+#include <stdexcept>
+#include "svis.h"
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+template<typename F>
+static double Time (F f, unsigned n)
+{
+    chrono::steady_clock::time_point t = chrono::steady_clock::now ();
+    for (unsigned i = 0; i < n; ++i)
+        f ();
+    return chrono::duration<double> (chrono::steady_clock::now () - t).count () / n;
+}
+
+void benchmark1 ()
+{
+    const unsigned W = 1920;
+    const unsigned H = 1080;
+    const unsigned N = 50;
+    const size_t n = static_cast<size_t> (W) * H;
+    vector<unsigned char> frame (n * 4);
+    for (size_t i = 0; i < frame.size (); ++i)
+        frame[i] = rand ();
+    vector<unsigned char> planes (n * 4);
+
+    for (unsigned channels = 3; channels <= 4; ++channels)
+    {
+        unsigned char *p[4];
+        const unsigned char *q[4];
+        for (unsigned c = 0; c < 4; ++c)
+            q[c] = p[c] = &planes[c * n];
+
+        double t = Time ([&] () {
+            for (size_t i = 0; i < n; ++i)
+                for (unsigned c = 0; c < channels; ++c)
+                    planes[c * n + i] = frame[i * channels + c];
+        }, N);
+        cout << channels << " channel scalar split " << t * 1e3 << " ms" << endl;
+        t = Time ([&] () {
+            for (size_t i = 0; i < n; ++i)
+                for (unsigned c = 0; c < channels; ++c)
+                    frame[i * channels + c] = planes[c * n + i];
+        }, N);
+        cout << channels << " channel scalar merge " << t * 1e3 << " ms" << endl;
+        t = Time ([&] () { Deinterleave (&frame[0], 0, W, H, channels, p); }, N);
+        cout << channels << " channel Deinterleave " << t * 1e3 << " ms" << endl;
+        t = Time ([&] () { Interleave (q, 0, W, H, channels, &frame[0]); }, N);
+        cout << channels << " channel Interleave " << t * 1e3 << " ms" << endl;
+    }
+
+    CODEC codec (W, H, &planes[0], &planes[n]);
+    double t = Time ([&] () { codec.Reduce (); }, N);
+    cout << "Reduce one plane " << t * 1e3 << " ms" << endl;
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        benchmark1 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,92 @@
+// Benchmark memory mapped PNM files
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// Compare loading and saving a large image through iostreams with
+// reading and writing it through a memory map.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "pnm_mmap.h"
+#include "pnm_util.h"
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+template<typename F>
+static double Time (F f, unsigned n)
+{
+    chrono::steady_clock::time_point t = chrono::steady_clock::now ();
+    for (unsigned i = 0; i < n; ++i)
+        f ();
+    return chrono::duration<double> (chrono::steady_clock::now () - t).count () / n;
+}
+
+void benchmark1 ()
+{
+    const unsigned W = 4096;
+    const unsigned H = 4096;
+    const unsigned N = 10;
+    PNM::Image image (W, H, 1);
+    for (unsigned i = 0; i < W * H; ++i)
+        image.GetPixelsAddress ()[i] = i * 7 + i / W;
+    {
+        ofstream s ("tmp_benchmark.pgm", ios::binary);
+        s << image;
+    }
+    const double mb = W * H / 1e6;
+
+    // Touch every page, since a map only reads pages in when they are
+    // used
+    unsigned sum = 0;
+    double t = Time ([&] () {
+        PNM::Image i;
+        Load (i, "tmp_benchmark.pgm");
+        for (unsigned k = 0; k < i.GetSize (); k += 4096)
+            sum += i.GetPixelsAddress ()[k];
+    }, N);
+    cout << "iostream load " << t * 1e3 << " ms, " << mb / t << " MB/s" << endl;
+    t = Time ([&] () {
+        PNM::MappedImage i ("tmp_benchmark.pgm");
+        for (unsigned k = 0; k < i.GetSize (); k += 4096)
+            sum += i.GetPixelsAddress ()[k];
+    }, N);
+    cout << "mapped load " << t * 1e3 << " ms, " << mb / t << " MB/s" << endl;
+
+    t = Time ([&] () {
+        ofstream s ("tmp_benchmark.pgm", ios::binary);
+        s << image;
+    }, N);
+    cout << "iostream save " << t * 1e3 << " ms, " << mb / t << " MB/s" << endl;
+    t = Time ([&] () {
+        PNM::MappedImageWriter w ("tmp_benchmark.pgm", W, H, 1);
+        memcpy (w.GetPixelsAddress (), image.GetPixelsAddress (), W * H);
+        w.Close ();
+    }, N);
+    cout << "mapped save " << t * 1e3 << " ms, " << mb / t << " MB/s" << endl;
+    remove ("tmp_benchmark.pgm");
+    // Use the sum, so the loads are not optimized away
+    if (sum == 0)
+        cout << "sum " << sum << endl;
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        benchmark1 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
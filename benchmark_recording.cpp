@@ -0,0 +1,92 @@
+// Benchmark recording routines
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// Report how long the frame loop waits to queue a frame, how long
+// closing takes to write out the rest, and how fast random frames
+// are decoded from the memory mapped recording.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "recording.h"
+#include "pnm_util.h"
+#include "svis.h"
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+void benchmark1 ()
+{
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> dest (W * H);
+    CODEC codec (W, H, src.GetPixelsAddress (), &dest[0]);
+    codec.SetResmap (W * 2, H * 2, pixels);
+    codec.Reduce ();
+
+    // Encode the frames first, so that only the writer is timed
+    const unsigned FRAMES = 200;
+    vector<vector<unsigned char> > streams (FRAMES);
+    for (unsigned f = 0; f < FRAMES; ++f)
+    {
+        codec.Encode (rand () % W, rand () % H);
+        codec.GetBitstream (streams[f]);
+    }
+
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now ();
+    double longest = 0.0;
+    RecordingWriter writer ("tmp_benchmark.svq");
+    for (unsigned f = 0; f < FRAMES; ++f)
+    {
+        chrono::steady_clock::time_point t = chrono::steady_clock::now ();
+        writer.Write (streams[f]);
+        double elapsed = chrono::duration<double> (chrono::steady_clock::now () - t).count ();
+        if (elapsed > longest)
+            longest = elapsed;
+    }
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now ();
+    writer.Close ();
+    chrono::steady_clock::time_point t3 = chrono::steady_clock::now ();
+    cout << "write " << chrono::duration<double> (t2 - t1).count () / FRAMES * 1e6
+        << " us/frame, longest " << longest * 1e6
+        << " us, close " << chrono::duration<double> (t3 - t2).count () * 1e3
+        << " ms" << endl;
+
+    RecordingReader reader ("tmp_benchmark.svq");
+    size_t count = 0;
+    t1 = chrono::steady_clock::now ();
+    double elapsed = 0.0;
+    while (elapsed < 1.0)
+    {
+        unsigned f = rand () % reader.Frames ();
+        codec.DecodeBitstream (reader.GetFrame (f), reader.GetFrameSize (f));
+        ++count;
+        elapsed = chrono::duration<double> (chrono::steady_clock::now () - t1).count ();
+    }
+    cout << "random access decode " << count / elapsed << "Hz" << endl;
+    remove ("tmp_benchmark.svq");
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        benchmark1 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -7,11 +7,13 @@
 // jsp Fri Aug 18 13:32:43 CDT 2006
 
 #include <algorithm>
+#include <chrono>
 #include <ctime>
 #include <iostream>
 #include "svis.h"
 //#include "pnm_util.h"
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -63,11 +65,203 @@ void benchmark1 ()
     cout << count << "Hz" << endl;
 }
 
+void benchmark2 ()
+{
+    const unsigned W = 640;
+    const unsigned H = 480;
+    vector<unsigned char> src (W * H);
+    vector<unsigned char> dest (W * H);
+    generate (src.begin (), src.end (), rand);
+
+    // Setup the codec
+    CODEC codec (W, H, &src[0], &dest[0]);
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, // resmap width
+        H * 2, // resmap height
+        resmap, // resmap pixels
+        2.3, // halfres
+        45.0); // field of view
+    codec.SetResmap (W * 2, H * 2, resmap);
+    codec.Reduce ();
+
+    // Time the decode after a saccade when the landing point was
+    // predicted and the candidates were decoded during the saccade
+    vector<int> x (4);
+    vector<int> y (4);
+    const size_t COUNT = 50;
+    double hit = 0.0;
+    double miss = 0.0;
+    for (size_t count = 0; count < COUNT; ++count)
+    {
+        for (unsigned i = 0; i < x.size (); ++i)
+        {
+            x[i] = rand () % W;
+            y[i] = rand () % H;
+        }
+        // A saccade lasts about 30ms
+        codec.Speculate (x, y);
+        this_thread::sleep_for (chrono::milliseconds (30));
+        chrono::steady_clock::time_point t1 = chrono::steady_clock::now ();
+        codec.DecodeSpeculative (x[0] + 1, y[0] + 1, 4);
+        chrono::steady_clock::time_point t2 = chrono::steady_clock::now ();
+        // ... and when it was not
+        codec.Speculate (x, y);
+        this_thread::sleep_for (chrono::milliseconds (30));
+        chrono::steady_clock::time_point t3 = chrono::steady_clock::now ();
+        codec.DecodeSpeculative (W - x[0], H - y[0], 0);
+        chrono::steady_clock::time_point t4 = chrono::steady_clock::now ();
+        hit += chrono::duration<double> (t2 - t1).count ();
+        miss += chrono::duration<double> (t4 - t3).count ();
+    }
+
+    cout << 1000.0 * hit / COUNT << "ms per predicted landing, "
+        << 1000.0 * miss / COUNT << "ms per unpredicted landing" << endl;
+}
+
+void benchmark3 ()
+{
+    const unsigned W = 640;
+    const unsigned H = 480;
+    vector<unsigned char> src (W * H);
+    vector<unsigned char> dest (W * H);
+    generate (src.begin (), src.end (), rand);
+
+    // Setup the codec
+    CODEC codec (W, H, &src[0], &dest[0]);
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, // resmap width
+        H * 2, // resmap height
+        resmap, // resmap pixels
+        2.3, // halfres
+        45.0); // field of view
+    codec.SetResmap (W * 2, H * 2, resmap);
+    codec.Reduce ();
+
+    // Decode with decreasing budgets
+    const double budgets[] = { 1.0, 0.002, 0.001, 0.0005, 0.0 };
+    for (unsigned i = 0; i < sizeof (budgets) / sizeof (budgets[0]); ++i)
+    {
+        size_t count = 0;
+        size_t skipped_levels = 0;
+        vector<unsigned> skipped;
+        time_t t = clock ();
+        while (static_cast<double> (clock () - t) / CLOCKS_PER_SEC < 1.0)
+        {
+            codec.Encode (rand () % W, rand () % H);
+            codec.Decode (budgets[i], skipped);
+            skipped_levels += skipped.size ();
+            ++count;
+        }
+        cout << budgets[i] * 1000.0 << "ms budget: " << count << "Hz, "
+            << static_cast<double> (skipped_levels) / count
+            << " levels skipped per frame" << endl;
+    }
+}
+
+void benchmark4 ()
+{
+    const unsigned W = 640;
+    const unsigned H = 480;
+    vector<unsigned char> src (W * H);
+    vector<unsigned char> dest (W * H);
+    generate (src.begin (), src.end (), rand);
+
+    // Setup the codec
+    CODEC codec (W, H, &src[0], &dest[0]);
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, // resmap width
+        H * 2, // resmap height
+        resmap, // resmap pixels
+        2.3, // halfres
+        45.0); // field of view
+    codec.SetResmap (W * 2, H * 2, resmap);
+    codec.Reduce ();
+
+    // Fixations that revisit a few places, like reading
+    vector<int> x;
+    vector<int> y;
+    for (unsigned i = 0; i < 32; ++i)
+    {
+        x.push_back (rand () % W);
+        y.push_back (rand () % H);
+    }
+
+    for (unsigned entries = 0; entries <= 64; entries += 64)
+    {
+        codec.SetEncodeCache (entries);
+        size_t count = 0;
+        time_t t = clock ();
+        while (static_cast<double> (clock () - t) / CLOCKS_PER_SEC < 1.0)
+        {
+            unsigned i = rand () % x.size ();
+            codec.Encode (x[i], y[i]);
+            ++count;
+        }
+        cout << entries << " cache entries: " << count << "Hz encode, "
+            << codec.GetEncodeCacheHits () << " hits, "
+            << codec.GetEncodeCacheMisses () << " misses" << endl;
+    }
+}
+
+void benchmark5 ()
+{
+    // Foveate a color frame as three full resolution planes, as RGB,
+    // and as YUV 4:2:0, not counting any color conversion
+    const unsigned W = 640;
+    const unsigned H = 480;
+    vector<unsigned char> src (W * H * 3);
+    vector<unsigned char> dest (W * H * 3);
+    generate (src.begin (), src.end (), rand);
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, H * 2, resmap, 2.3, 45.0);
+
+    CODEC codec (W, H, &src[0], &dest[0]);
+    codec.SetResmap (W * 2, H * 2, resmap);
+    size_t count = 0;
+    time_t t = clock ();
+    while (static_cast<double> (clock () - t) / CLOCKS_PER_SEC < 1.0)
+    {
+        int x = rand () % W;
+        int y = rand () % H;
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            codec.SetSrcImage (&src[c * W * H]);
+            codec.SetDestImage (&dest[c * W * H]);
+            codec.Reduce ();
+            codec.Encode (x, y);
+            codec.Decode ();
+        }
+        ++count;
+    }
+    cout << "RGB planes: " << count << "Hz" << endl;
+
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        YUVFormat format = f ? NV12 : I420;
+        YUVCODEC yuv (W, H, format, &src[0], &dest[0]);
+        yuv.ShareResmap (codec);
+        count = 0;
+        t = clock ();
+        while (static_cast<double> (clock () - t) / CLOCKS_PER_SEC < 1.0)
+        {
+            yuv.Reduce ();
+            yuv.Encode (rand () % W, rand () % H);
+            yuv.Decode ();
+            ++count;
+        }
+        cout << (f ? "NV12: " : "I420: ") << count << "Hz" << endl;
+    }
+}
+
 int main (int argc, char *argv[])
 {
     try
     {
         benchmark1 ();
+        benchmark2 ();
+        benchmark3 ();
+        benchmark4 ();
+        benchmark5 ();
 
         return 0;
     }
@@ -0,0 +1,206 @@
+// Benchmark the SVIS MEX handlers
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// These drive the MEX gateway through the stub in mexstub/, the way
+// the examples do, and report the time per call of each stage.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "mex.h"
+#include "svis.h"
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+// Call svismex with function index 'f', like the .m files, and return
+// the result, if any
+mxArray *svismex (int f,
+    const mxArray *a1 = 0,
+    const mxArray *a2 = 0,
+    const mxArray *a3 = 0,
+    const mxArray *a4 = 0)
+{
+    mxArray *findex = mxCreateDoubleScalar (f);
+    const mxArray *prhs[] = { findex, a1, a2, a3, a4 };
+    int nrhs = 1;
+    while (nrhs < 5 && prhs[nrhs])
+        ++nrhs;
+    mxArray *plhs[1] = { 0 };
+    mexFunction (1, plhs, nrhs, prhs);
+    mxDestroyArray (findex);
+    return plhs[0];
+}
+
+// Function indices in svismex.cpp
+enum { INIT, RELEASE, CODEC_, SETRESMAP, SETSRC, ENCODE, CODECRGB, SETSRCRGB, ENCODERGB };
+
+// Create a random MATLAB image
+mxArray *Random (int rows, int cols, int planes = 1)
+{
+    const int dims[3] = { rows, cols, planes };
+    mxArray *a = mxCreateNumericArray (planes == 1 ? 2 : 3, dims, mxUINT8_CLASS, mxREAL);
+    unsigned char *p = static_cast<unsigned char *> (mxGetData (a));
+    generate (p, p + rows * cols * planes, rand);
+    return a;
+}
+
+// Time a stage for about a second and print the time per call
+template<typename F>
+void Time (const char *stage, F f)
+{
+    size_t count = 0;
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now ();
+    double elapsed = 0.0;
+    while (elapsed < 1.0)
+    {
+        f (count);
+        ++count;
+        elapsed = chrono::duration<double> (chrono::steady_clock::now () - t1).count ();
+    }
+    cout << setw (44) << left << stage
+        << 1000.0 * elapsed / count << "ms per call" << endl;
+}
+
+void benchmark1 ()
+{
+    const int ROWS = 480;
+    const int COLS = 640;
+    mxArray *resmap = 0;
+    {
+        vector<unsigned char> pixels;
+        CreateResmap (COLS * 2, ROWS * 2, pixels, 2.3, 45.0);
+        const int dims[2] = { ROWS * 2, COLS * 2 };
+        resmap = mxCreateNumericArray (2, dims, mxUINT8_CLASS, mxREAL);
+        copy (pixels.begin (), pixels.end (), static_cast<unsigned char *> (mxGetData (resmap)));
+    }
+    const int FRAMES = 8;
+    vector<mxArray *> frames;
+    for (int i = 0; i < FRAMES; ++i)
+        frames.push_back (Random (ROWS, COLS));
+    vector<mxArray *> rows;
+    vector<mxArray *> cols;
+    for (int i = 0; i < 64; ++i)
+    {
+        rows.push_back (mxCreateDoubleScalar (rand () % ROWS));
+        cols.push_back (mxCreateDoubleScalar (rand () % COLS));
+    }
+
+    Time ("svisinit", [&] (size_t) { svismex (INIT); });
+
+    // Per trial setup, as in the examples
+    Time ("sviscodec+svissetresmap (first)", [&] (size_t)
+    {
+        svismex (INIT);
+        mxArray *c = svismex (CODEC_, frames[0]);
+        svismex (SETRESMAP, c, resmap);
+        mxDestroyArray (c);
+    });
+    svismex (INIT);
+    Time ("sviscodec+svissetresmap (pooled)", [&] (size_t)
+    {
+        mxArray *c = svismex (CODEC_, frames[0]);
+        svismex (SETRESMAP, c, resmap);
+        svismex (RELEASE, c);
+        mxDestroyArray (c);
+    });
+
+    mxArray *c = svismex (CODEC_, frames[0]);
+    svismex (SETRESMAP, c, resmap);
+    Time ("svissetresmap (same)", [&] (size_t) { svismex (SETRESMAP, c, resmap); });
+    Time ("svissetsrc (new frame)", [&] (size_t i) { svismex (SETSRC, c, frames[i % FRAMES]); });
+    Time ("svissetsrc (same frame)", [&] (size_t) { svismex (SETSRC, c, frames[0]); });
+    Time ("svisencode (new fixation)", [&] (size_t i)
+    {
+        mxDestroyArray (svismex (ENCODE, c, rows[i % rows.size ()], cols[i % cols.size ()]));
+    });
+    Time ("svisencode (same fixation)", [&] (size_t)
+    {
+        mxDestroyArray (svismex (ENCODE, c, rows[0], cols[0]));
+    });
+    Time ("svissetsrc+svisencode (new frame)", [&] (size_t i)
+    {
+        svismex (SETSRC, c, frames[i % FRAMES]);
+        mxDestroyArray (svismex (ENCODE, c, rows[i % rows.size ()], cols[i % cols.size ()]));
+    });
+    Time ("svisencode with src (new frame)", [&] (size_t i)
+    {
+        mxDestroyArray (svismex (ENCODE, c, rows[i % rows.size ()], cols[i % cols.size ()], frames[i % FRAMES]));
+    });
+    mxDestroyArray (c);
+
+    // Color, three calls per plane versus one call
+    vector<mxArray *> planes;
+    for (int i = 0; i < 3 * 2; ++i)
+        planes.push_back (Random (ROWS, COLS));
+    vector<mxArray *> codecs;
+    for (int i = 0; i < 3; ++i)
+    {
+        codecs.push_back (svismex (CODEC_, planes[i]));
+        svismex (SETRESMAP, codecs[i], resmap);
+    }
+    Time ("3 x svissetsrc+svisencode (new frame)", [&] (size_t i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            svismex (SETSRC, codecs[k], planes[k + 3 * (i % 2)]);
+            mxDestroyArray (svismex (ENCODE, codecs[k], rows[i % rows.size ()], cols[i % cols.size ()]));
+        }
+    });
+    mxArray *rgb[2] = { Random (ROWS, COLS, 3), Random (ROWS, COLS, 3) };
+    c = svismex (CODECRGB, rgb[0]);
+    svismex (SETRESMAP, c, resmap);
+    Time ("svissetsrcrgb+svisencodergb (new frame)", [&] (size_t i)
+    {
+        svismex (SETSRCRGB, c, rgb[i % 2]);
+        mxDestroyArray (svismex (ENCODERGB, c, rows[i % rows.size ()], cols[i % cols.size ()]));
+    });
+    Time ("svisencodergb with src (new frame)", [&] (size_t i)
+    {
+        mxDestroyArray (svismex (ENCODERGB, c, rows[i % rows.size ()], cols[i % cols.size ()], rgb[i % 2]));
+    });
+
+    svismex (RELEASE);
+    mxDestroyArray (c);
+    mxDestroyArray (rgb[0]);
+    mxDestroyArray (rgb[1]);
+    for (int i = 0; i < 3; ++i)
+        mxDestroyArray (codecs[i]);
+    for (size_t i = 0; i < planes.size (); ++i)
+        mxDestroyArray (planes[i]);
+    for (size_t i = 0; i < rows.size (); ++i)
+    {
+        mxDestroyArray (rows[i]);
+        mxDestroyArray (cols[i]);
+    }
+    for (int i = 0; i < FRAMES; ++i)
+        mxDestroyArray (frames[i]);
+    mxDestroyArray (resmap);
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        benchmark1 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+    catch (const mexError &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,610 @@
+// Read and write encoded pyramids as a stream of bytes.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "bitstream.h"
+#include "entropy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace SVIS
+{
+
+static const unsigned char MAGIC[4] = { 'S', 'V', 'I', 'S' };
+static const unsigned VERSION = 2;
+
+static void Put32 (vector<unsigned char> &s, unsigned x)
+{
+    s.push_back (x & 0xFF);
+    s.push_back ((x >> 8) & 0xFF);
+    s.push_back ((x >> 16) & 0xFF);
+    s.push_back ((x >> 24) & 0xFF);
+}
+
+// Read the stream a field at a time, checking that it does not run
+// out
+class Reader
+{
+    public:
+    Reader (const unsigned char *stream, size_t size) :
+        p (stream),
+        end (stream + size)
+    {
+    }
+    const unsigned char *Get (size_t bytes)
+    {
+        if (static_cast<size_t> (end - p) < bytes)
+            throw runtime_error ("The bitstream is truncated");
+        const unsigned char *q = p;
+        p += bytes;
+        return q;
+    }
+    const unsigned char *Here () const
+    {
+        return p;
+    }
+    size_t Left () const
+    {
+        return end - p;
+    }
+    void Skip (size_t bytes)
+    {
+        Get (bytes);
+    }
+    unsigned Get8 ()
+    {
+        return *Get (1);
+    }
+    unsigned Get32 ()
+    {
+        const unsigned char *q = Get (4);
+        return q[0] | (q[1] << 8) | (q[2] << 16) | (static_cast<unsigned> (q[3]) << 24);
+    }
+    private:
+    const unsigned char *p;
+    const unsigned char *end;
+};
+
+// A block at its level's scale
+struct Block
+{
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+};
+
+// Get the non-empty blocks of a level
+static void GetBlocks (const FoveationPyramid &p, unsigned n, vector<Block> &blocks)
+{
+    const Image &i = p.images[n];
+    blocks.clear ();
+    for (unsigned r = 0; r < p.regions[n].size (); ++r)
+    {
+        const Region &region = p.regions[n][r];
+        // Convert to the level's scale
+        Block b;
+        b.x = region.x1 >> i.scale;
+        b.y = region.y1 >> i.scale;
+        b.width = (region.x2 >> i.scale) - b.x;
+        b.height = (region.y2 >> i.scale) - b.y;
+        // Cropped regions may be empty
+        if (b.width != 0 && b.height != 0)
+            blocks.push_back (b);
+    }
+}
+
+static void PutBlock (const Block &b, vector<unsigned char> &stream)
+{
+    Put32 (stream, b.x);
+    Put32 (stream, b.y);
+    Put32 (stream, b.width);
+    Put32 (stream, b.height);
+}
+
+// The header's coding byte has this bit set in an inter frame
+static const unsigned INTER = 128;
+// and this bit set if it holds Laplacian residuals
+static const unsigned RESIDUAL = 64;
+// and this bit set if its blocks are sent in order of priority
+static const unsigned PROGRESSIVE = 32;
+// The bytes before the values of a block in a progressive stream
+static const size_t PROGRESSIVE_BLOCK_SIZE = 21;
+
+// Return true if no pixel of a block differs from the reference by
+// more than 'threshold'
+static bool Unchanged (const Image &i, const Image &ref, const Block &b, unsigned threshold)
+{
+    for (unsigned j = 0; j < b.height; ++j)
+    {
+        const unsigned char *p = i.pixels + (b.y + j) * Pitch (i) + b.x;
+        const unsigned char *q = ref.pixels + (b.y + j) * Pitch (ref) + b.x;
+        if (threshold == 0)
+        {
+            if (memcmp (p, q, b.width) != 0)
+                return false;
+            continue;
+        }
+        for (unsigned k = 0; k < b.width; ++k)
+            if (static_cast<unsigned> (abs (p[k] - q[k])) > threshold)
+                return false;
+    }
+    return true;
+}
+
+// Get the values that are sent for a block
+static void GetValues (const Image &i,
+    const Image *ref,
+    const Block &b,
+    BitstreamCoding coding,
+    unsigned char *values)
+{
+    if (ref)
+    {
+        // Differences from the reference
+        for (unsigned j = 0; j < b.height; ++j)
+        {
+            const unsigned char *p = i.pixels + (b.y + j) * Pitch (i) + b.x;
+            const unsigned char *q = ref->pixels + (b.y + j) * Pitch (*ref) + b.x;
+            for (unsigned k = 0; k < b.width; ++k)
+                *values++ = p[k] - q[k];
+        }
+    }
+    else if (coding == BITSTREAM_RANS)
+        Predict (i.pixels + b.y * Pitch (i) + b.x, Pitch (i), b.width, b.height, values);
+    else
+    {
+        for (unsigned j = 0; j < b.height; ++j)
+        {
+            const unsigned char *p = i.pixels + (b.y + j) * Pitch (i) + b.x;
+            values = copy (p, p + b.width, values);
+        }
+    }
+}
+
+// Undo GetValues
+static void SetValues (const unsigned char *values,
+    bool inter,
+    BitstreamCoding coding,
+    const Block &b,
+    Image &i)
+{
+    unsigned pitch = Pitch (i);
+    if (inter)
+    {
+        for (unsigned j = 0; j < b.height; ++j)
+        {
+            unsigned char *p = i.pixels + (b.y + j) * pitch + b.x;
+            for (unsigned k = 0; k < b.width; ++k)
+                p[k] += *values++;
+        }
+    }
+    else if (coding == BITSTREAM_RANS)
+        Unpredict (values, b.width, b.height, i.pixels + b.y * pitch + b.x, pitch);
+    else
+    {
+        for (unsigned j = 0; j < b.height; ++j, values += b.width)
+            memcpy (i.pixels + (b.y + j) * pitch + b.x, values, b.width);
+    }
+}
+
+// Copy a block into the reference
+static void CopyBlock (const Image &i, const Block &b, Image &ref)
+{
+    for (unsigned j = 0; j < b.height; ++j)
+        memcpy (ref.pixels + (b.y + j) * Pitch (ref) + b.x,
+            i.pixels + (b.y + j) * Pitch (i) + b.x,
+            b.width);
+}
+
+// Set every pixel of a pyramid to zero
+static void Clear (FoveationPyramid &p)
+{
+    for (unsigned n = 0; n < p.levels; ++n)
+    {
+        Image &i = p.images[n];
+        for (unsigned j = 0; j < (i.height >> i.scale); ++j)
+            memset (i.pixels + j * Pitch (i), 0, i.width >> i.scale);
+    }
+}
+
+static void PutHeader (const FoveationPyramid &p,
+    bool column_major,
+    unsigned coding,
+    vector<unsigned char> &stream)
+{
+    stream.insert (stream.end (), MAGIC, MAGIC + 4);
+    stream.push_back (VERSION);
+    stream.push_back (column_major ? 1 : 0);
+    stream.push_back (p.levels);
+    stream.push_back (coding | (p.residual ? RESIDUAL : 0));
+    Put32 (stream, p.images[0].width);
+    Put32 (stream, p.images[0].height);
+    Put32 (stream, p.fixation_x);
+    Put32 (stream, p.fixation_y);
+}
+
+static void Write (const FoveationPyramid &p,
+    bool column_major,
+    vector<unsigned char> &stream,
+    BitstreamCoding coding,
+    FoveationPyramid *reference,
+    unsigned threshold)
+{
+    assert (p.levels > 0);
+    assert (p.regions.size () == p.levels);
+    if (reference && (reference->levels != p.levels ||
+        reference->images[0].width != p.images[0].width ||
+        reference->images[0].height != p.images[0].height))
+        throw runtime_error ("The reference dimensions do not match the pyramid");
+    PutHeader (p, column_major, coding | (reference ? INTER : 0), stream);
+    // Blocks
+    vector<Block> blocks;
+    vector<bool> sent;
+    vector<unsigned char> values;
+    for (unsigned n = 0; n < p.levels; ++n)
+    {
+        const Image &i = p.images[n];
+        const Image *ref = reference ? &reference->images[n] : 0;
+        GetBlocks (p, n, blocks);
+        // Decide which blocks to send
+        sent.assign (blocks.size (), true);
+        size_t total = 0;
+        for (unsigned k = 0; k < blocks.size (); ++k)
+        {
+            if (ref)
+                sent[k] = !Unchanged (i, *ref, blocks[k], threshold);
+            if (sent[k])
+                total += blocks[k].width * blocks[k].height;
+        }
+        values.resize (total);
+        size_t offset = 0;
+        for (unsigned k = 0; k < blocks.size (); ++k)
+        {
+            if (!sent[k])
+                continue;
+            GetValues (i, ref, blocks[k], coding, &values[offset]);
+            offset += blocks[k].width * blocks[k].height;
+        }
+        Put32 (stream, blocks.size ());
+        if (coding == BITSTREAM_RAW)
+        {
+            offset = 0;
+            for (unsigned k = 0; k < blocks.size (); ++k)
+            {
+                PutBlock (blocks[k], stream);
+                if (ref)
+                    stream.push_back (sent[k]);
+                if (!sent[k])
+                    continue;
+                size_t size = blocks[k].width * blocks[k].height;
+                stream.insert (stream.end (), &values[offset], &values[offset] + size);
+                offset += size;
+            }
+        }
+        else
+        {
+            assert (coding == BITSTREAM_RANS);
+            for (unsigned k = 0; k < blocks.size (); ++k)
+                PutBlock (blocks[k], stream);
+            if (ref)
+                for (unsigned k = 0; k < blocks.size (); ++k)
+                    stream.push_back (sent[k]);
+            // Code the values, and send them raw instead if that did
+            // not help
+            size_t level_offset = stream.size ();
+            stream.push_back (1);
+            RansEncode (total ? &values[0] : 0, total, stream);
+            if (stream.size () - level_offset - 1 >= total)
+            {
+                stream.resize (level_offset);
+                stream.push_back (0);
+                stream.insert (stream.end (), values.begin (), values.end ());
+            }
+        }
+        // The receiver now holds the blocks that were sent
+        if (ref)
+            for (unsigned k = 0; k < blocks.size (); ++k)
+                if (sent[k])
+                    CopyBlock (i, blocks[k], reference->images[n]);
+    }
+}
+
+void WriteBitstream (const FoveationPyramid &p,
+    bool column_major,
+    vector<unsigned char> &stream,
+    BitstreamCoding coding)
+{
+    Write (p, column_major, stream, coding, 0, 0);
+}
+
+void WriteBitstream (const FoveationPyramid &p,
+    bool column_major,
+    vector<unsigned char> &stream,
+    BitstreamCoding coding,
+    FoveationPyramid &reference,
+    bool keyframe,
+    unsigned threshold)
+{
+    if (!keyframe)
+    {
+        Write (p, column_major, stream, coding, &reference, threshold);
+        return;
+    }
+    Write (p, column_major, stream, coding, 0, 0);
+    // The receiver clears its pyramid and reads every block
+    vector<Block> blocks;
+    Clear (reference);
+    for (unsigned n = 0; n < p.levels; ++n)
+    {
+        GetBlocks (p, n, blocks);
+        for (unsigned k = 0; k < blocks.size (); ++k)
+            CopyBlock (p.images[n], blocks[k], reference.images[n]);
+    }
+}
+
+// A block of a progressive stream and how soon it is sent
+struct Priority
+{
+    unsigned level;
+    Block block;
+    // The squared distance from the fixation point to the nearest
+    // pixel of the block, at full resolution
+    double distance;
+};
+
+// The top level comes first.  Blocks nearer the fixation point come
+// before those farther away, and coarser blocks before finer ones at
+// the same distance.
+static bool operator< (const Priority &a, const Priority &b)
+{
+    if (a.distance != b.distance)
+        return a.distance < b.distance;
+    return a.level > b.level;
+}
+
+// Return the distance from the fixation point to a block
+static double Distance (const FoveationPyramid &p, unsigned n, const Block &b)
+{
+    const unsigned scale = p.images[n].scale;
+    double x1 = static_cast<double> (b.x) * (1 << scale);
+    double y1 = static_cast<double> (b.y) * (1 << scale);
+    double x2 = static_cast<double> (b.x + b.width) * (1 << scale);
+    double y2 = static_cast<double> (b.y + b.height) * (1 << scale);
+    double dx = p.fixation_x < x1 ? x1 - p.fixation_x :
+        p.fixation_x >= x2 ? p.fixation_x - x2 + 1 : 0;
+    double dy = p.fixation_y < y1 ? y1 - p.fixation_y :
+        p.fixation_y >= y2 ? p.fixation_y - y2 + 1 : 0;
+    return dx * dx + dy * dy;
+}
+
+void WriteProgressiveBitstream (const FoveationPyramid &p,
+    bool column_major,
+    vector<unsigned char> &stream,
+    BitstreamCoding coding)
+{
+    assert (p.levels > 0);
+    assert (p.regions.size () == p.levels);
+    if (p.residual)
+        throw runtime_error ("A pyramid of residuals cannot be sent progressively");
+    PutHeader (p, column_major, coding | PROGRESSIVE, stream);
+
+    // Order the blocks
+    vector<Priority> order;
+    vector<Block> blocks;
+    for (unsigned n = 0; n < p.levels; ++n)
+    {
+        GetBlocks (p, n, blocks);
+        for (unsigned k = 0; k < blocks.size (); ++k)
+        {
+            Priority e;
+            e.level = n;
+            e.block = blocks[k];
+            e.distance = n + 1 == p.levels ? -1.0 : Distance (p, n, blocks[k]);
+            order.push_back (e);
+        }
+    }
+    stable_sort (order.begin (), order.end ());
+
+    // Each block is coded on its own so that a prefix of the stream
+    // can be decoded
+    vector<unsigned char> values;
+    for (unsigned k = 0; k < order.size (); ++k)
+    {
+        const Block &b = order[k].block;
+        size_t total = b.width * b.height;
+        values.resize (total);
+        GetValues (p.images[order[k].level], 0, b, coding, &values[0]);
+        stream.push_back (order[k].level);
+        PutBlock (b, stream);
+        size_t size_offset = stream.size ();
+        Put32 (stream, 0);
+        size_t size = total;
+        if (coding == BITSTREAM_RANS)
+        {
+            RansEncode (&values[0], total, stream);
+            size = stream.size () - size_offset - 4;
+            if (size >= total)
+            {
+                stream.resize (size_offset + 4);
+                size = total;
+            }
+        }
+        if (size == total)
+            stream.insert (stream.end (), values.begin (), values.end ());
+        for (unsigned j = 0; j < 4; ++j)
+            stream[size_offset + j] = (size >> (8 * j)) & 0xFF;
+    }
+}
+
+void ReadBitstreamHeader (const unsigned char *stream,
+    size_t size,
+    BitstreamHeader &h)
+{
+    Reader r (stream, size);
+    if (memcmp (r.Get (4), MAGIC, 4) != 0)
+        throw runtime_error ("The stream is not a bitstream");
+    h.version = r.Get8 ();
+    if (h.version != 1 && h.version != VERSION)
+        throw runtime_error ("The bitstream version is not supported");
+    h.column_major = r.Get8 () != 0;
+    h.levels = r.Get8 ();
+    unsigned coding = r.Get8 ();
+    // Version 1 only has raw streams
+    if (h.version == 1 && coding != 0)
+        throw runtime_error ("The bitstream coding is not supported");
+    h.inter = (coding & INTER) != 0;
+    h.residual = (coding & RESIDUAL) != 0;
+    h.progressive = (coding & PROGRESSIVE) != 0;
+    coding &= ~(INTER | RESIDUAL | PROGRESSIVE);
+    if (coding > BITSTREAM_RANS)
+        throw runtime_error ("The bitstream coding is not supported");
+    if (h.progressive && (h.inter || h.residual))
+        throw runtime_error ("The bitstream coding is not supported");
+    h.coding = static_cast<BitstreamCoding> (coding);
+    h.width = r.Get32 ();
+    h.height = r.Get32 ();
+    h.fixation_x = static_cast<int> (r.Get32 ());
+    h.fixation_y = static_cast<int> (r.Get32 ());
+}
+
+// Read the blocks of a progressive stream up to the first one that
+// was cut short, and set the regions of the pyramid to those that
+// were read
+static void ReadProgressive (Reader &r, BitstreamCoding coding, FoveationPyramid &p)
+{
+    p.regions.assign (p.levels, vector<Region> ());
+    p.spans.assign (p.levels, vector<BlendSpan> ());
+    vector<unsigned char> values;
+    while (r.Left () >= PROGRESSIVE_BLOCK_SIZE)
+    {
+        unsigned n = r.Get8 ();
+        if (n >= p.levels)
+            throw runtime_error ("A bitstream block is outside of the pyramid");
+        Image &i = p.images[n];
+        unsigned width = i.width >> i.scale;
+        unsigned height = i.height >> i.scale;
+        Block b;
+        b.x = r.Get32 ();
+        b.y = r.Get32 ();
+        b.width = r.Get32 ();
+        b.height = r.Get32 ();
+        if (b.x > width || b.width > width - b.x || b.y > height || b.height > height - b.y)
+            throw runtime_error ("A bitstream block is outside of the pyramid");
+        size_t total = b.width * b.height;
+        size_t size = r.Get32 ();
+        if (size > total || (coding == BITSTREAM_RAW && size != total))
+            throw runtime_error ("A bitstream block is not valid");
+        if (r.Left () < size)
+            break;
+        const unsigned char *v;
+        if (size == total)
+            v = r.Get (total);
+        else
+        {
+            values.resize (total);
+            if (RansDecode (r.Get (size), size, &values[0], total) != size)
+                throw runtime_error ("A bitstream block is not valid");
+            v = &values[0];
+        }
+        SetValues (v, false, coding, b, i);
+        Region region;
+        region.x1 = b.x << i.scale;
+        region.y1 = b.y << i.scale;
+        region.x2 = (b.x + b.width) << i.scale;
+        region.y2 = (b.y + b.height) << i.scale;
+        p.regions[n].push_back (region);
+    }
+}
+
+void ReadBitstream (const unsigned char *stream,
+    size_t size,
+    FoveationPyramid &p)
+{
+    BitstreamHeader h;
+    ReadBitstreamHeader (stream, size, h);
+    if (h.levels != p.levels ||
+        h.width != p.images[0].width ||
+        h.height != p.images[0].height)
+        throw runtime_error ("The bitstream dimensions do not match the pyramid");
+    if (h.inter && h.residual != p.residual)
+        throw runtime_error ("An inter frame does not match the stream before it");
+    p.fixation_x = h.fixation_x;
+    p.fixation_y = h.fixation_y;
+    p.residual = h.residual;
+    if (!h.inter)
+        Clear (p);
+    Reader r (stream + BITSTREAM_HEADER_SIZE, size - BITSTREAM_HEADER_SIZE);
+    vector<Block> blocks;
+    vector<unsigned char> values;
+    if (h.progressive)
+    {
+        ReadProgressive (r, h.coding, p);
+        return;
+    }
+    for (unsigned n = 0; n < p.levels; ++n)
+    {
+        Image &i = p.images[n];
+        unsigned width = i.width >> i.scale;
+        unsigned height = i.height >> i.scale;
+        unsigned count = r.Get32 ();
+        blocks.clear ();
+        size_t total = 0;
+        for (unsigned k = 0; k < count; ++k)
+        {
+            Block b;
+            b.x = r.Get32 ();
+            b.y = r.Get32 ();
+            b.width = r.Get32 ();
+            b.height = r.Get32 ();
+            if (b.x > width || b.width > width - b.x || b.y > height || b.height > height - b.y)
+                throw runtime_error ("A bitstream block is outside of the pyramid");
+            if (h.coding == BITSTREAM_RAW)
+            {
+                if (h.inter && r.Get8 () == 0)
+                    continue;
+                SetValues (r.Get (b.width * b.height), h.inter, h.coding, b, i);
+                continue;
+            }
+            blocks.push_back (b);
+        }
+        if (h.coding == BITSTREAM_RAW)
+            continue;
+        // Drop the blocks that were skipped
+        if (h.inter)
+        {
+            const unsigned char *sent = r.Get (blocks.size ());
+            unsigned m = 0;
+            for (unsigned k = 0; k < blocks.size (); ++k)
+                if (sent[k])
+                    blocks[m++] = blocks[k];
+            blocks.resize (m);
+        }
+        for (unsigned k = 0; k < blocks.size (); ++k)
+            total += blocks[k].width * blocks[k].height;
+        const unsigned char *v;
+        if (r.Get8 () == 0)
+            v = r.Get (total);
+        else
+        {
+            values.resize (total);
+            r.Skip (RansDecode (r.Here (), r.Left (), total ? &values[0] : 0, total));
+            v = total ? &values[0] : 0;
+        }
+        for (unsigned k = 0; k < blocks.size (); ++k)
+        {
+            SetValues (v, h.inter, h.coding, blocks[k], i);
+            v += blocks[k].width * blocks[k].height;
+        }
+    }
+}
+
+} // namespace SVIS
@@ -0,0 +1,178 @@
+// Read and write encoded pyramids as a stream of bytes.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include "foveate.h"
+#include <cstddef>
+#include <vector>
+
+namespace SVIS
+{
+
+// The bitstream holds only the blocks of an encoded pyramid, so it
+// can be sent over a link and decoded by a receiver that has the same
+// masks.  The receiver encodes its own pyramid at the fixation point
+// in the header to recover the regions and blending spans, so they
+// are not sent.
+//
+// Version 1 had a reserved byte, always 0, where the coding is now.
+// It is read as a raw stream; other versions are rejected.
+//
+// All integers are little endian.  The dimensions and coordinates are
+// those of the buffer that was encoded, so they are swapped in a
+// column major stream.
+//
+//     Header
+//         4 bytes     "SVIS"
+//         1 byte      version, 2
+//         1 byte      memory order, 0 for row major, 1 for column major
+//         1 byte      pyramid levels
+//         1 byte      coding, 0 for raw pixels, 1 for rANS, plus 128
+//                     if the stream is an inter frame, plus 64 if
+//                     it holds Laplacian residuals, plus 32 if it is
+//                     progressive
+//         4 bytes     width
+//         4 bytes     height
+//         4 bytes     fixation x, signed
+//         4 bytes     fixation y, signed
+//     Then for each pyramid level, finest first
+//         4 bytes     number of blocks
+//         For each block
+//             4 bytes     x
+//             4 bytes     y
+//             4 bytes     width
+//             4 bytes     height
+//             In an inter frame, 1 byte, 0 if the block is skipped, 1
+//             if it is sent
+//             If the block is sent, width * height bytes of values,
+//             row by row
+//
+// When the coding is rANS, each level is instead
+//
+//         4 bytes     number of blocks
+//         For each block
+//             4 bytes     x
+//             4 bytes     y
+//             4 bytes     width
+//             4 bytes     height
+//         In an inter frame, 1 byte for each block, 0 if it is
+//         skipped, 1 if it is sent
+//         1 byte      0 if the values are raw, 1 if they are coded
+//         The values of every block that is sent, in order, raw or
+//         coded by RansEncode (see entropy.h)
+//
+// With raw coding, the values are the pixels.  With rANS coding, they
+// are the residuals of the pixels after Predict.  A level is sent raw
+// when coding it would not make it smaller.
+//
+// A progressive stream sends the blocks of every level in order of
+// priority, each coded on its own, so that any prefix of it can be
+// decoded.  After the header, for each block
+//
+//         1 byte      level
+//         4 bytes     x
+//         4 bytes     y
+//         4 bytes     width
+//         4 bytes     height
+//         4 bytes     size of the values
+//         The values of the block, raw if the size is width * height
+//         and otherwise coded by RansEncode
+//
+// The top level comes first, then the blocks of the other levels in
+// order of their distance from the fixation point, coarser blocks
+// first when they are the same distance away.  A progressive stream
+// is always a keyframe, and does not hold Laplacian residuals, whose
+// prediction needs every block of the levels above them.
+//
+// A stream of Laplacian residuals is written from a pyramid made by
+// FoveationResidual, and is read into a pyramid that FoveationDecode
+// decodes the same way.
+//
+// An inter frame is coded relative to the pixels the receiver holds
+// after reading the stream before it.  Blocks that have not changed
+// are skipped, and the values of the others are their differences,
+// modulo 256, from those pixels.  Any other stream is a keyframe,
+// which does not depend on earlier streams.  The receiver clears its
+// pyramid before reading a keyframe.
+//
+// Block coordinates are at the level's scale.  The top level is
+// always sent as a single block holding the whole level.
+
+// How the pixels of the blocks are coded
+enum BitstreamCoding { BITSTREAM_RAW, BITSTREAM_RANS };
+
+struct BitstreamHeader
+{
+    unsigned version;
+    bool column_major;
+    BitstreamCoding coding;
+    bool inter;
+    bool residual;
+    bool progressive;
+    unsigned levels;
+    unsigned width;
+    unsigned height;
+    int fixation_x;
+    int fixation_y;
+};
+
+// The size of the header in bytes
+const size_t BITSTREAM_HEADER_SIZE = 24;
+
+// Append the header and the blocks of an encoded pyramid to 'stream'
+void WriteBitstream (const FoveationPyramid &p,
+    bool column_major,
+    std::vector<unsigned char> &stream,
+    BitstreamCoding coding = BITSTREAM_RAW);
+
+// Append a stream that may be coded relative to the stream before it.
+// 'reference' holds the pixels the receiver holds after reading the
+// stream before it, and is updated to hold the pixels it will hold
+// after reading this one.  It must have the same dimensions as 'p'.
+// If 'keyframe' is true, a keyframe is written.  Otherwise, blocks
+// in which no pixel differs from the reference by more than
+// 'threshold' are skipped, so a threshold of zero is lossless.
+void WriteBitstream (const FoveationPyramid &p,
+    bool column_major,
+    std::vector<unsigned char> &stream,
+    BitstreamCoding coding,
+    FoveationPyramid &reference,
+    bool keyframe,
+    unsigned threshold = 0);
+
+// Append a progressive stream.  Throw if 'p' holds Laplacian
+// residuals.
+void WriteProgressiveBitstream (const FoveationPyramid &p,
+    bool column_major,
+    std::vector<unsigned char> &stream,
+    BitstreamCoding coding = BITSTREAM_RAW);
+
+// Read the header of a stream.  Throw if it is not a bitstream.
+void ReadBitstreamHeader (const unsigned char *stream,
+    size_t size,
+    BitstreamHeader &h);
+
+// Copy the blocks of a stream into a pyramid with the same dimensions
+// and set its fixation point and whether it holds Laplacian
+// residuals.  The pyramid is cleared first if the stream is a
+// keyframe.  An inter frame must be read into the pyramid that the
+// stream before it was read into.  Throw if the stream is truncated
+// or does not fit the pyramid.
+//
+// A progressive stream may be cut short anywhere after its header.
+// The blocks that arrived whole are read, and the regions of the
+// pyramid are set to them, so FoveationCompile rather than
+// FoveationEncode prepares it for decoding.  The levels of the
+// blocks that did not arrive are upsampled from the levels above.
+void ReadBitstream (const unsigned char *stream,
+    size_t size,
+    FoveationPyramid &p);
+
+} // namespace SVIS
+
+#endif // BITSTREAM_H
@@ -24,9 +24,18 @@ if (nargin<1)
     mex_args='';
 end
 
+% The sources need C++11.  Visual C++ 2015 and later use it without
+% being asked.
+if (ispc)
+    std_args='';
+else
+    std_args=' CXXFLAGS="$CXXFLAGS -std=c++11 -pthread" LDFLAGS="$LDFLAGS -pthread"';
+end
+
 cmd=['mex ',...
         mex_args,...
-        ' svismex.cpp svishandlers.cpp svis.cpp foveate.cpp mask.cpp filter.cpp region.cpp ecc.cpp'];
+        std_args,...
+        ' svismex.cpp svishandlers.cpp svis.cpp foveate.cpp mask.cpp filter.cpp region.cpp ecc.cpp arena.cpp bitstream.cpp entropy.cpp interleave.cpp'];
 
 fprintf('Evaluating "%s"\n',cmd)
 eval(cmd)
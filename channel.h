@@ -0,0 +1,86 @@
+// A bounded queue between threads.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace SVIS
+{
+
+// A queue of work between two threads.  It holds at most 'capacity'
+// items, so a fast producer waits for a slow consumer.  Items are
+// moved in and out with their swap member, so large buffers are not
+// copied.
+template<typename T>
+class Channel
+{
+    public:
+    explicit Channel (size_t capacity) :
+        capacity (capacity),
+        closed (false)
+    {
+    }
+    // Add an item.  Return false if the channel has been closed.
+    bool Push (T &item)
+    {
+        std::unique_lock<std::mutex> l (lock);
+        while (items.size () >= capacity && !closed)
+            changed.wait (l);
+        if (closed)
+            return false;
+        items.push_back (T ());
+        items.back ().swap (item);
+        changed.notify_all ();
+        return true;
+    }
+    // Remove the next item.  Return false if the channel has been
+    // closed and is empty.
+    bool Pop (T &item)
+    {
+        std::unique_lock<std::mutex> l (lock);
+        while (items.empty () && !closed)
+            changed.wait (l);
+        if (items.empty ())
+            return false;
+        item.swap (items.front ());
+        items.pop_front ();
+        changed.notify_all ();
+        return true;
+    }
+    // No more items will be added.  If 'error' is not empty, the
+    // producer failed.
+    void Close (const std::string &error = std::string ())
+    {
+        std::lock_guard<std::mutex> l (lock);
+        closed = true;
+        if (this->error.empty ())
+            this->error = error;
+        changed.notify_all ();
+    }
+    std::string Error ()
+    {
+        std::lock_guard<std::mutex> l (lock);
+        return error;
+    }
+
+    private:
+    size_t capacity;
+    bool closed;
+    std::string error;
+    std::deque<T> items;
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+} // namespace SVIS
+
+#endif // CHANNEL_H
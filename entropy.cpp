@@ -0,0 +1,352 @@
+// Lossless compression of encoded image blocks.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "entropy.h"
+
+#include <cassert>
+#include <stdexcept>
+
+using namespace std;
+
+namespace SVIS
+{
+
+// Predict a pixel from its left, upper and upper left neighbors.
+// This is the median of a, b and a + b - c, computed without branches.
+static inline int MedianEdge (int a, int b, int c)
+{
+    int lo = a < b ? a : b;
+    int hi = a < b ? b : a;
+    int p = a + b - c;
+    p = p < lo ? lo : p;
+    return p > hi ? hi : p;
+}
+
+void Predict (const unsigned char *pixels,
+    unsigned pitch,
+    unsigned width,
+    unsigned height,
+    unsigned char *residuals)
+{
+    if (width == 0 || height == 0)
+        return;
+    // The first row only has left neighbors
+    residuals[0] = pixels[0] - 128;
+    for (unsigned x = 1; x < width; ++x)
+        residuals[x] = pixels[x] - pixels[x - 1];
+    for (unsigned y = 1; y < height; ++y)
+    {
+        const unsigned char *p = pixels + y * pitch;
+        const unsigned char *up = p - pitch;
+        unsigned char *r = residuals + y * width;
+        // The first column only has upper neighbors
+        r[0] = p[0] - up[0];
+        for (unsigned x = 1; x < width; ++x)
+            r[x] = p[x] - MedianEdge (p[x - 1], up[x], up[x - 1]);
+    }
+}
+
+void Unpredict (const unsigned char *residuals,
+    unsigned width,
+    unsigned height,
+    unsigned char *pixels,
+    unsigned pitch)
+{
+    if (width == 0 || height == 0)
+        return;
+    pixels[0] = residuals[0] + 128;
+    for (unsigned x = 1; x < width; ++x)
+        pixels[x] = residuals[x] + pixels[x - 1];
+    for (unsigned y = 1; y < height; ++y)
+    {
+        unsigned char *p = pixels + y * pitch;
+        const unsigned char *up = p - pitch;
+        const unsigned char *r = residuals + y * width;
+        p[0] = r[0] + up[0];
+        for (unsigned x = 1; x < width; ++x)
+            p[x] = r[x] + MedianEdge (p[x - 1], up[x], up[x - 1]);
+    }
+}
+
+// Frequencies are scaled to sum to 1 << PROB_BITS
+static const unsigned PROB_BITS = 12;
+static const unsigned PROB_SCALE = 1 << PROB_BITS;
+// The state is kept in [RANS_L, RANS_L << 8)
+static const unsigned RANS_L = 1 << 23;
+
+// Scale symbol counts so that they sum to PROB_SCALE.  Every symbol
+// that occurs gets a frequency of at least 1.
+static void Normalize (const size_t *counts, size_t total, unsigned *freqs)
+{
+    assert (total > 0);
+    unsigned sum = 0;
+    for (unsigned s = 0; s < 256; ++s)
+    {
+        if (counts[s] == 0)
+        {
+            freqs[s] = 0;
+            continue;
+        }
+        freqs[s] = static_cast<unsigned> (counts[s] * PROB_SCALE / total);
+        if (freqs[s] == 0)
+            freqs[s] = 1;
+        sum += freqs[s];
+    }
+    // Give or take the difference from the most frequent symbols
+    while (sum != PROB_SCALE)
+    {
+        unsigned m = 0;
+        for (unsigned s = 1; s < 256; ++s)
+            if (freqs[s] > freqs[m])
+                m = s;
+        if (sum < PROB_SCALE)
+        {
+            freqs[m] += PROB_SCALE - sum;
+            sum = PROB_SCALE;
+        }
+        else
+        {
+            unsigned d = sum - PROB_SCALE;
+            if (d > freqs[m] - 1)
+                d = freqs[m] - 1;
+            assert (d > 0);
+            freqs[m] -= d;
+            sum -= d;
+        }
+    }
+}
+
+// The table is a frequency for each symbol in one byte if it is less
+// than 128, otherwise in two.  A zero frequency is followed by the
+// number of zeros after it.
+static void PutTable (const unsigned *freqs, vector<unsigned char> &stream)
+{
+    for (unsigned s = 0; s < 256; ++s)
+    {
+        if (freqs[s] == 0)
+        {
+            unsigned run = 0;
+            while (s + 1 < 256 && freqs[s + 1] == 0)
+            {
+                ++run;
+                ++s;
+            }
+            stream.push_back (0);
+            stream.push_back (run);
+        }
+        else if (freqs[s] < 128)
+            stream.push_back (freqs[s]);
+        else
+        {
+            stream.push_back (0x80 | (freqs[s] >> 8));
+            stream.push_back (freqs[s] & 0xFF);
+        }
+    }
+}
+
+static size_t GetTable (const unsigned char *stream, size_t size, unsigned *freqs)
+{
+    size_t i = 0;
+    unsigned sum = 0;
+    for (unsigned s = 0; s < 256; ++s)
+    {
+        if (i >= size)
+            throw runtime_error ("The frequency table is truncated");
+        unsigned f = stream[i++];
+        if (f == 0)
+        {
+            if (i >= size)
+                throw runtime_error ("The frequency table is truncated");
+            unsigned run = stream[i++];
+            if (s + run >= 256)
+                throw runtime_error ("The frequency table is not valid");
+            for (unsigned j = 0; j <= run; ++j)
+                freqs[s + j] = 0;
+            s += run;
+            continue;
+        }
+        if (f & 0x80)
+        {
+            if (i >= size)
+                throw runtime_error ("The frequency table is truncated");
+            f = ((f & 0x7F) << 8) | stream[i++];
+        }
+        freqs[s] = f;
+        sum += f;
+    }
+    if (sum != PROB_SCALE)
+        throw runtime_error ("The frequency table is not valid");
+    return i;
+}
+
+// How to code a symbol.  The division by its frequency is done by
+// multiplying by its reciprocal, as in Fabian Giesen's rans_byte.h.
+struct EncodeSymbol
+{
+    unsigned x_max;
+    unsigned rcp_freq;
+    unsigned rcp_shift;
+    unsigned bias;
+    unsigned cmpl_freq;
+};
+
+static void InitSymbol (EncodeSymbol &e, unsigned start, unsigned freq)
+{
+    e.x_max = ((RANS_L >> PROB_BITS) << 8) * freq;
+    e.cmpl_freq = PROB_SCALE - freq;
+    if (freq < 2)
+    {
+        e.rcp_freq = ~0u;
+        e.rcp_shift = 0;
+        e.bias = start + PROB_SCALE - 1;
+    }
+    else
+    {
+        unsigned shift = 0;
+        while (freq > (1u << shift))
+            ++shift;
+        e.rcp_freq = static_cast<unsigned> (((1ull << (shift + 31)) + freq - 1) / freq);
+        e.rcp_shift = shift - 1;
+        e.bias = start;
+    }
+}
+
+// Code a symbol into state x, shifting bytes out in front of q
+static inline void Put (unsigned &x, unsigned char *&q, const EncodeSymbol &e)
+{
+    while (x >= e.x_max)
+    {
+        *--q = x & 0xFF;
+        x >>= 8;
+    }
+    unsigned d = static_cast<unsigned> ((static_cast<unsigned long long> (x) * e.rcp_freq) >> 32) >> e.rcp_shift;
+    x += e.bias + d * e.cmpl_freq;
+}
+
+static inline void PutState (unsigned x, unsigned char *&q)
+{
+    q -= 4;
+    q[0] = x & 0xFF;
+    q[1] = (x >> 8) & 0xFF;
+    q[2] = (x >> 16) & 0xFF;
+    q[3] = (x >> 24) & 0xFF;
+}
+
+void RansEncode (const unsigned char *p,
+    size_t size,
+    vector<unsigned char> &stream)
+{
+    // Count the symbols
+    size_t counts[256] = { 0 };
+    for (size_t i = 0; i < size; ++i)
+        ++counts[p[i]];
+    unsigned freqs[256];
+    if (size == 0)
+    {
+        // Any valid table will do
+        counts[0] = 1;
+        Normalize (counts, 1, freqs);
+    }
+    else
+        Normalize (counts, size, freqs);
+    EncodeSymbol symbols[256];
+    unsigned start = 0;
+    for (unsigned s = 0; s < 256; ++s)
+    {
+        InitSymbol (symbols[s], start, freqs[s]);
+        start += freqs[s];
+    }
+    PutTable (freqs, stream);
+
+    // rANS works backwards, so code the symbols from last to first
+    // into the back of a buffer.  A symbol never shifts out more than
+    // two bytes.  Even and odd symbols are coded into two states so
+    // that the decoder can work on both at once.
+    vector<unsigned char> buffer (size * 2 + 8);
+    unsigned char *end = &buffer[0] + buffer.size ();
+    unsigned char *q = end;
+    unsigned x[2] = { RANS_L, RANS_L };
+    for (size_t i = size; i-- > 0; )
+        Put (x[i & 1], q, symbols[p[i]]);
+    PutState (x[1], q);
+    PutState (x[0], q);
+    assert (q >= &buffer[0]);
+
+    size_t n = end - q;
+    for (unsigned k = 0; k < 4; ++k)
+        stream.push_back ((n >> (8 * k)) & 0xFF);
+    stream.insert (stream.end (), q, end);
+}
+
+// Decode a symbol from state x, shifting bytes in from q.  Each slot
+// holds its symbol in the low 8 bits, its frequency minus one in the
+// next 12 and the start of its symbol's slots in the high 12.
+static inline unsigned Get (unsigned &x,
+    const unsigned char *&q,
+    const unsigned char *end,
+    const unsigned *slots)
+{
+    unsigned slot = x & (PROB_SCALE - 1);
+    unsigned e = slots[slot];
+    x = ((e >> 8) & (PROB_SCALE - 1)) * (x >> PROB_BITS) + (x >> PROB_BITS) + slot - (e >> 20);
+    while (x < RANS_L)
+    {
+        if (q == end)
+            throw runtime_error ("The rANS stream is truncated");
+        x = (x << 8) | *q++;
+    }
+    return e & 0xFF;
+}
+
+static inline unsigned GetState (const unsigned char *&q)
+{
+    unsigned x = q[0] | (q[1] << 8) | (q[2] << 16) | (static_cast<unsigned> (q[3]) << 24);
+    q += 4;
+    return x;
+}
+
+size_t RansDecode (const unsigned char *stream,
+    size_t stream_size,
+    unsigned char *p,
+    size_t size)
+{
+    unsigned freqs[256];
+    size_t used = GetTable (stream, stream_size, freqs);
+    if (stream_size - used < 4)
+        throw runtime_error ("The rANS stream is truncated");
+    const unsigned char *q = stream + used;
+    size_t n = q[0] | (q[1] << 8) | (q[2] << 16) | (static_cast<size_t> (q[3]) << 24);
+    q += 4;
+    used += 4;
+    if (n < 8 || stream_size - used < n)
+        throw runtime_error ("The rANS stream is truncated");
+    const unsigned char *end = q + n;
+
+    // Map each slot to its symbol
+    unsigned slots[PROB_SCALE];
+    unsigned start = 0;
+    for (unsigned s = 0; s < 256; ++s)
+    {
+        for (unsigned j = 0; j < freqs[s]; ++j)
+            slots[start + j] = s | ((freqs[s] - 1) << 8) | (start << 20);
+        start += freqs[s];
+    }
+
+    unsigned x[2];
+    x[0] = GetState (q);
+    x[1] = GetState (q);
+    size_t i = 0;
+    for (; i + 1 < size; i += 2)
+    {
+        p[i] = Get (x[0], q, end, slots);
+        p[i + 1] = Get (x[1], q, end, slots);
+    }
+    if (i < size)
+        p[i] = Get (x[0], q, end, slots);
+    return used + n;
+}
+
+} // namespace SVIS
@@ -0,0 +1,56 @@
+// Lossless compression of encoded image blocks.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <cstddef>
+#include <vector>
+
+namespace SVIS
+{
+
+// Replace each pixel of a 'width' by 'height' block with the
+// difference, modulo 256, between it and a prediction made from its
+// left, upper and upper left neighbors.  The predictor is the median
+// edge detector used by LOCO-I.  Pixels in the first row are predicted
+// from their left neighbor and pixels in the first column from their
+// upper neighbor.  The top left pixel is predicted to be 128.  The
+// residuals are packed.
+void Predict (const unsigned char *pixels,
+    unsigned pitch,
+    unsigned width,
+    unsigned height,
+    unsigned char *residuals);
+
+// Undo Predict
+void Unpredict (const unsigned char *residuals,
+    unsigned width,
+    unsigned height,
+    unsigned char *pixels,
+    unsigned pitch);
+
+// Code 'size' bytes with a static order 0 range asymmetric numeral
+// system (rANS) coder and append them to 'stream'.  The coded bytes
+// are a table of the symbol frequencies, scaled to sum to 4096, then
+// 4 bytes giving the number of bytes that follow, then the two rANS
+// states that the even and odd bytes are coded into, and the bytes
+// shifted out of them.
+void RansEncode (const unsigned char *p,
+    size_t size,
+    std::vector<unsigned char> &stream);
+
+// Decode 'size' bytes from a stream written by RansEncode.  Return
+// the number of bytes of the stream that were used.  Throw if the
+// stream is not valid.
+size_t RansDecode (const unsigned char *stream,
+    size_t stream_size,
+    unsigned char *p,
+    size_t size);
+
+} // namespace SVIS
+
+#endif // ENTROPY_H
@@ -7,18 +7,246 @@
 //
 // jsp 2001/05/17
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <string>
 
 #include "filter.h"
 
+// The SSE2 routines for 16 bit pixels are compiled for SSE2 whatever
+// the compiler flags are, and are only called if the processor has it
+#if defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+#define HAVE_SSE2
+#define SSE2_TARGET __attribute__ ((target ("sse2")))
+#include <emmintrin.h>
+#elif defined (_MSC_VER) && (defined (_M_IX86) || defined (_M_X64))
+#define HAVE_SSE2
+#define SSE2_TARGET
+#include <intrin.h>
+#include <emmintrin.h>
+#endif
+
+using std::numeric_limits;
 using std::runtime_error;
 
 namespace SVIS
 {
 
+#ifdef HAVE_SSE2
+
+static bool HasSSE2 ()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid (info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports ("sse2") != 0;
+#endif
+}
+
+SSE2_TARGET static inline __m128i Load (const unsigned short *p)
+{
+    return _mm_loadu_si128 (reinterpret_cast<const __m128i *> (p));
+}
+
+SSE2_TARGET static inline void Store (unsigned short *p, __m128i v)
+{
+    _mm_storeu_si128 (reinterpret_cast<__m128i *> (p), v);
+}
+
+// Pack two vectors of 32 bit lanes that hold 16 bit values.  SSE2 only
+// packs signed values, so they are offset by 32768 and back.
+SSE2_TARGET static inline __m128i Pack16 (__m128i lo, __m128i hi)
+{
+    const __m128i offset32 = _mm_set1_epi32 (32768);
+    const __m128i offset16 = _mm_set1_epi16 (-32768);
+    lo = _mm_sub_epi32 (lo, offset32);
+    hi = _mm_sub_epi32 (hi, offset32);
+    return _mm_add_epi16 (_mm_packs_epi32 (lo, hi), offset16);
+}
+
+// Return the 1 2 1 sums of pixels 0 to 2, 2 to 4, 4 to 6 and 6 to 8
+// of a row, in 32 bit lanes
+SSE2_TARGET static inline __m128i Sum121 (const unsigned short *p)
+{
+    const __m128i low = _mm_set1_epi32 (0xFFFF);
+    __m128i a = Load (p);
+    __m128i b = Load (p + 2);
+    __m128i even = _mm_and_si128 (a, low);
+    __m128i odd = _mm_srli_epi32 (a, 16);
+    __m128i next = _mm_and_si128 (b, low);
+    return _mm_add_epi32 (_mm_add_epi32 (even, next), _mm_slli_epi32 (odd, 1));
+}
+
+// Reduce a row from three source rows, eight pixels at a time, as long
+// as no edge pixel is needed.  Return the first source column left.
+SSE2_TARGET static int Reduce3x3SSE2 (const unsigned short *src_p1,
+    const unsigned short *src_p2,
+    const unsigned short *src_p3,
+    unsigned short *dest_p,
+    int src_width)
+{
+    const __m128i round = _mm_set1_epi32 (8);
+    int x = 0;
+    for (; x + 18 <= src_width; x += 16)
+    {
+        __m128i p[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            __m128i sum = _mm_add_epi32 (Sum121 (src_p1 + x + i * 8), Sum121 (src_p3 + x + i * 8));
+            sum = _mm_add_epi32 (sum, _mm_slli_epi32 (Sum121 (src_p2 + x + i * 8), 1));
+            p[i] = _mm_srli_epi32 (_mm_add_epi32 (sum, round), 4);
+        }
+        Store (dest_p + x / 2, Pack16 (p[0], p[1]));
+    }
+    return x;
+}
+
+// Expand the center of two dest rows from two source rows, sixteen
+// pixels at a time.  Return the first dest column left.
+SSE2_TARGET static int ExpandOddSSE2 (const unsigned short *src_p1,
+    const unsigned short *src_p2,
+    unsigned short *dest_p1,
+    unsigned short *dest_p2,
+    int dest_width)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i round = _mm_set1_epi32 (2);
+    int x = 1;
+    for (; x + 14 < dest_width - 2; x += 16)
+    {
+        const int i = x / 2;
+        __m128i a = Load (src_p1 + i);
+        __m128i b = Load (src_p1 + i + 1);
+        __m128i c = Load (src_p2 + i);
+        __m128i d = Load (src_p2 + i + 1);
+        // _mm_avg_epu16 rounds up, like the scalar code
+        __m128i ab = _mm_avg_epu16 (a, b);
+        __m128i ac = _mm_avg_epu16 (a, c);
+        __m128i lo = _mm_add_epi32 (_mm_unpacklo_epi16 (a, zero), _mm_unpacklo_epi16 (b, zero));
+        lo = _mm_add_epi32 (lo, _mm_add_epi32 (_mm_unpacklo_epi16 (c, zero), _mm_unpacklo_epi16 (d, zero)));
+        __m128i hi = _mm_add_epi32 (_mm_unpackhi_epi16 (a, zero), _mm_unpackhi_epi16 (b, zero));
+        hi = _mm_add_epi32 (hi, _mm_add_epi32 (_mm_unpackhi_epi16 (c, zero), _mm_unpackhi_epi16 (d, zero)));
+        lo = _mm_srli_epi32 (_mm_add_epi32 (lo, round), 2);
+        hi = _mm_srli_epi32 (_mm_add_epi32 (hi, round), 2);
+        __m128i abcd = Pack16 (lo, hi);
+        Store (dest_p1 + x, _mm_unpacklo_epi16 (a, ab));
+        Store (dest_p1 + x + 8, _mm_unpackhi_epi16 (a, ab));
+        Store (dest_p2 + x, _mm_unpacklo_epi16 (ac, abcd));
+        Store (dest_p2 + x + 8, _mm_unpackhi_epi16 (ac, abcd));
+    }
+    return x;
+}
+
+// Blend a span whose mask pixels are adjacent, eight pixels at a time.
+// Return the first pixel left.
+template<bool residual>
+SSE2_TARGET static unsigned BlendSSE2 (const unsigned short *src_p,
+    unsigned short *dest_p,
+    const unsigned char *mask_p,
+    unsigned length)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i full = _mm_set1_epi16 (255);
+    const __m128i bias = _mm_set1_epi16 (static_cast<short> (ResidualBias<unsigned short> ()));
+    const __m128 divisor = _mm_set1_ps (255.0f);
+    unsigned x = 0;
+    for (; x + 8 <= length; x += 8)
+    {
+        __m128i s = Load (src_p + x);
+        __m128i d = Load (dest_p + x);
+        if (residual)
+            s = _mm_sub_epi16 (_mm_add_epi16 (s, d), bias);
+        __m128i m = _mm_unpacklo_epi8 (_mm_loadl_epi64 (reinterpret_cast<const __m128i *> (mask_p + x)), zero);
+        __m128i n = _mm_sub_epi16 (full, m);
+        // The products take 24 bits
+        __m128i sl = _mm_mullo_epi16 (s, m);
+        __m128i sh = _mm_mulhi_epu16 (s, m);
+        __m128i dl = _mm_mullo_epi16 (d, n);
+        __m128i dh = _mm_mulhi_epu16 (d, n);
+        __m128i lo = _mm_add_epi32 (_mm_unpacklo_epi16 (sl, sh), _mm_unpacklo_epi16 (dl, dh));
+        __m128i hi = _mm_add_epi32 (_mm_unpackhi_epi16 (sl, sh), _mm_unpackhi_epi16 (dl, dh));
+        // A sum below 2^24 is exact in single precision, and a quotient
+        // that is not whole is at least 1/255 below the next integer,
+        // more than half a unit in the last place, so truncating the
+        // rounded quotient gives the same result as integer division
+        lo = _mm_cvttps_epi32 (_mm_div_ps (_mm_cvtepi32_ps (lo), divisor));
+        hi = _mm_cvttps_epi32 (_mm_div_ps (_mm_cvtepi32_ps (hi), divisor));
+        Store (dest_p + x, Pack16 (lo, hi));
+    }
+    return x;
+}
+
+#endif // HAVE_SSE2
+
+// The SIMD versions of the inner loops, where there are any.  They do
+// some or all of a row and return where the scalar loop is to carry
+// on.  The results are identical.
+template<typename T>
+static int Reduce3x3Fast (const T *, const T *, const T *, T *, int)
+{
+    return 0;
+}
+
+static int Reduce3x3Fast (const unsigned short *src_p1,
+    const unsigned short *src_p2,
+    const unsigned short *src_p3,
+    unsigned short *dest_p,
+    int src_width)
+{
+#ifdef HAVE_SSE2
+    static const bool sse2 = HasSSE2 ();
+    if (sse2)
+        return Reduce3x3SSE2 (src_p1, src_p2, src_p3, dest_p, src_width);
+#endif
+    return 0;
+}
+
+template<typename T>
+static int ExpandOddFast (const T *, const T *, T *, T *, int)
+{
+    return 1;
+}
+
+static int ExpandOddFast (const unsigned short *src_p1,
+    const unsigned short *src_p2,
+    unsigned short *dest_p1,
+    unsigned short *dest_p2,
+    int dest_width)
+{
+#ifdef HAVE_SSE2
+    static const bool sse2 = HasSSE2 ();
+    if (sse2)
+        return ExpandOddSSE2 (src_p1, src_p2, dest_p1, dest_p2, dest_width);
+#endif
+    return 1;
+}
+
+template<bool residual, typename T>
+static unsigned BlendFast (const T *, T *, const unsigned char *, unsigned)
+{
+    return 0;
+}
+
+template<bool residual>
+static unsigned BlendFast (const unsigned short *src_p,
+    unsigned short *dest_p,
+    const unsigned char *mask_p,
+    unsigned length)
+{
+#ifdef HAVE_SSE2
+    static const bool sse2 = HasSSE2 ();
+    if (sse2)
+        return BlendSSE2<residual> (src_p, dest_p, mask_p, length);
+#endif
+    return 0;
+}
+
 /*
 static void FixRect (int width, int height, Rect *rect)
 {
@@ -50,6 +278,8 @@ void Reduce2x2 (const Image *src, Image *dest)
     int src_height;
     int dest_width;
     int dest_height;
+    int src_pitch;
+    int dest_pitch;
     unsigned char *src_p1, *src_p2, *dest_p;
     unsigned int p1, p2, p3, p4;
 
@@ -66,20 +296,22 @@ void Reduce2x2 (const Image *src, Image *dest)
     src_height = src->height >> src->scale;
     dest_width = dest->width >> dest->scale;
     dest_height = dest->height >> dest->scale;
+    src_pitch = Pitch (*src);
+    dest_pitch = Pitch (*dest);
 
     for (y = 0; y < src_height; y += 2)
     {
         if (y / 2 >= dest_height)
             break;
         else
-            dest_p = &dest->pixels[y / 2 * dest_width];
+            dest_p = &dest->pixels[y / 2 * dest_pitch];
 
-        src_p1 = &src->pixels[y * src_width];
+        src_p1 = &src->pixels[y * src_pitch];
 
         if (y + 1 >= src_height)
             src_p2 = src_p1; // Clamp the edge.
         else
-            src_p2 = &src->pixels[(y + 1) * src_width];
+            src_p2 = &src->pixels[(y + 1) * src_pitch];
 
         for (x = 0; x < src_width; x += 2)
         {
@@ -105,7 +337,8 @@ void Reduce2x2 (const Image *src, Image *dest)
     }
 }
 
-void Reduce3x3 (const Image *src, Image *dest)
+template<typename T>
+void Reduce3x3 (const ImageT<T> *src, ImageT<T> *dest)
 {
     int x;
     int y;
@@ -113,7 +346,9 @@ void Reduce3x3 (const Image *src, Image *dest)
     int src_height;
     int dest_width;
     int dest_height;
-    unsigned char *src_p1, *src_p2, *src_p3, *dest_p;
+    int src_pitch;
+    int dest_pitch;
+    T *src_p1, *src_p2, *src_p3, *dest_p;
     unsigned int p1, p2, p3, p4, p5, p6, p7, p8, p9;
 
     // Make sure we have valid pointers and that
@@ -129,27 +364,29 @@ void Reduce3x3 (const Image *src, Image *dest)
     src_height = src->height >> src->scale;
     dest_width = dest->width >> dest->scale;
     dest_height = dest->height >> dest->scale;
+    src_pitch = Pitch (*src);
+    dest_pitch = Pitch (*dest);
 
     for (y = 0; y < src_height; y += 2)
     {
         if (y / 2 >= dest_height)
             break;
         else
-            dest_p = &dest->pixels[y / 2 * dest_width];
+            dest_p = &dest->pixels[y / 2 * dest_pitch];
 
-        src_p1 = &src->pixels[y * src_width];
+        src_p1 = &src->pixels[y * src_pitch];
 
         if (y + 1 >= src_height)
             src_p2 = src_p1; // Clamp the edge.
         else
-            src_p2 = &src->pixels[(y + 1) * src_width];
+            src_p2 = &src->pixels[(y + 1) * src_pitch];
 
         if (y + 2 >= src_height)
             src_p3 = src_p2; // Clamp the edge.
         else
-            src_p3 = &src->pixels[(y + 2) * src_width];
+            src_p3 = &src->pixels[(y + 2) * src_pitch];
 
-        for (x = 0; x < src_width; x += 2)
+        for (x = Reduce3x3Fast (src_p1, src_p2, src_p3, dest_p, src_width); x < src_width; x += 2)
         {
             if (x / 2 >= dest_width)
                 break;
@@ -194,8 +431,36 @@ void Reduce3x3 (const Image *src, Image *dest)
     }
 }
 
+template<typename T>
+void Copy (const ImageT<T> *src, ImageT<T> *dest)
+{
+    if (!src || !dest)
+        throw runtime_error ("Copy: Invalid parameters");
+    if (src->width != dest->width || src->height != dest->height ||
+        src->scale != dest->scale)
+        throw runtime_error ("Copy: Invalid dimensions");
+
+    const unsigned width = src->width >> src->scale;
+    const unsigned height = src->height >> src->scale;
+    const unsigned src_pitch = Pitch (*src);
+    const unsigned dest_pitch = Pitch (*dest);
+
+    // Copy packed images in one go
+    if (src_pitch == width && dest_pitch == width)
+    {
+        std::copy (src->pixels, src->pixels + width * height, dest->pixels);
+        return;
+    }
+
+    for (unsigned y = 0; y < height; ++y)
+        std::copy (src->pixels + y * src_pitch,
+            src->pixels + y * src_pitch + width,
+            dest->pixels + y * dest_pitch);
+}
+
 // Slow helper functions to get/set pixels.  Note that x and y are already converted to i's scale.
-static unsigned char GetPixel (const Image *i, int x, int y)
+template<typename T>
+static T GetPixel (const ImageT<T> *i, int x, int y)
 {
     int w, h;
 
@@ -210,10 +475,11 @@ static unsigned char GetPixel (const Image *i, int x, int y)
     if (y >= h)
         y = h - 1;
 
-    return i->pixels[y * w + x];
+    return i->pixels[y * Pitch (*i) + x];
 }
 
-static void SetPixel (Image *i, int x, int y, unsigned char p)
+template<typename T>
+static void SetPixel (ImageT<T> *i, int x, int y, T p)
 {
     int w, h;
 
@@ -228,7 +494,7 @@ static void SetPixel (Image *i, int x, int y, unsigned char p)
     if (y >= h)
         y = h - 1;
 
-    i->pixels[y * w + x] = p;
+    i->pixels[y * Pitch (*i) + x] = p;
 }
 
 void ExpandEven (const Image *src, Image *dest)
@@ -239,6 +505,8 @@ void ExpandEven (const Image *src, Image *dest)
     int src_height;
     int dest_width;
     int dest_height;
+    int src_pitch;
+    int dest_pitch;
     unsigned char *src_p1, *src_p2;
     unsigned char *dest_p1, *dest_p2;
     unsigned int p1, p2, p3, p4;
@@ -257,6 +525,8 @@ void ExpandEven (const Image *src, Image *dest)
     src_height = src->height >> src->scale;
     dest_width = dest->width >> dest->scale;
     dest_height = dest->height >> dest->scale;
+    src_pitch = Pitch (*src);
+    dest_pitch = Pitch (*dest);
 
     // If the source is too small, don't expand it.
     if (src_width < 2 || src_height < 2)
@@ -265,10 +535,10 @@ void ExpandEven (const Image *src, Image *dest)
     // Do the center part of the image.
     for (y = 1; y < dest_height - 2; y += 2)
     {
-        src_p1 = &src->pixels[(y / 2) * src_width];
-        src_p2 = &src->pixels[(y / 2 + 1) * src_width];
-        dest_p1 = &dest->pixels[y * dest_width];
-        dest_p2 = &dest->pixels[(y + 1) * dest_width];
+        src_p1 = &src->pixels[(y / 2) * src_pitch];
+        src_p2 = &src->pixels[(y / 2 + 1) * src_pitch];
+        dest_p1 = &dest->pixels[y * dest_pitch];
+        dest_p2 = &dest->pixels[(y + 1) * dest_pitch];
 
         for (x = 1; x < dest_width - 2; x += 2)
         {
@@ -322,7 +592,8 @@ void ExpandEven (const Image *src, Image *dest)
     }
 }
 
-void ExpandOdd (const Image *src, Image *dest)
+template<typename T>
+void ExpandOdd (const ImageT<T> *src, ImageT<T> *dest)
 {
     int x;
     int y;
@@ -330,9 +601,11 @@ void ExpandOdd (const Image *src, Image *dest)
     int src_height;
     int dest_width;
     int dest_height;
-    unsigned char *src_p1, *src_p2;
-    unsigned char *dest_p0, *dest_p1, *dest_p2;
-    unsigned char p;
+    int src_pitch;
+    int dest_pitch;
+    T *src_p1, *src_p2;
+    T *dest_p1, *dest_p2;
+    T p;
 
     // Make sure we have valid pointers and that
     // src and dest have the same dimensions.
@@ -347,6 +620,8 @@ void ExpandOdd (const Image *src, Image *dest)
     src_height = src->height >> src->scale;
     dest_width = dest->width >> dest->scale;
     dest_height = dest->height >> dest->scale;
+    src_pitch = Pitch (*src);
+    dest_pitch = Pitch (*dest);
 
     // If the source is too small, don't expand it.
     if (src_width < 2 || src_height < 2)
@@ -378,13 +653,12 @@ void ExpandOdd (const Image *src, Image *dest)
     // Do the center part of the image.
     for (y = 1; y < dest_height - 2; y += 2)
     {
-        src_p1 = &src->pixels[(y / 2) * src_width];
-        src_p2 = &src->pixels[(y / 2 + 1) * src_width];
-        dest_p0 = &dest->pixels[(y - 1) * dest_width];
-        dest_p1 = &dest->pixels[y * dest_width];
-        dest_p2 = &dest->pixels[(y + 1) * dest_width];
+        src_p1 = &src->pixels[(y / 2) * src_pitch];
+        src_p2 = &src->pixels[(y / 2 + 1) * src_pitch];
+        dest_p1 = &dest->pixels[y * dest_pitch];
+        dest_p2 = &dest->pixels[(y + 1) * dest_pitch];
 
-        for (x = 1; x < dest_width - 2; x += 2)
+        for (x = ExpandOddFast (src_p1, src_p2, dest_p1, dest_p2, dest_width); x < dest_width - 2; x += 2)
         {
             // This way of upsampling produces artifacts that are
             // typical of bilinear interpolation.
@@ -395,8 +669,10 @@ void ExpandOdd (const Image *src, Image *dest)
 
             // This way of upsampling mitigates the artifacts, but it
             // is a total kludge and introduces other types of high
-            // frequency artifacts, so don't use it.
+            // frequency artifacts, so don't use it.  It also reads the
+            // row above.
             /*
+            const T *dest_p0 = &dest->pixels[(y - 1) * dest_pitch];
             dest_p2[x + 1] = (src_p1[x / 2] + src_p1[(x + 1) / 2] + src_p2[x / 2] + src_p2[(x + 1) / 2] + 2) / 4;
             dest_p1[x + 1] = (src_p1[x / 2] + src_p1[(x + 1) / 2] + dest_p0[x + 1] + dest_p2[x + 1] + 2) / 4;
             dest_p2[x    ] = (src_p1[x / 2] + src_p2[x / 2] + dest_p2[x - 1] + dest_p2[x + 1] + 2) / 4;
@@ -444,8 +720,9 @@ void ExpandOdd (const Image *src, Image *dest)
     }
 }
 
-void Blend (const Image *src,
-    Image *dest,
+template<typename T>
+void Blend (const ImageT<T> *src,
+    ImageT<T> *dest,
     const AutoImage *mask,
     const Rect *rect,
     int mask_offset_x,
@@ -494,17 +771,16 @@ void Blend (const Image *src,
     // Do the blending.
     for (unsigned y = y1; y < y2; y += inc)
     {
-        unsigned char *src_p;
-        unsigned char *dest_p;
+        T *src_p;
+        T *dest_p;
         const unsigned char *mask_p;
-        unsigned src_y, src_width;
+        unsigned src_y;
         int mask_y, mask_width;
 
         // Convert to src coordinates.
         // Dest uses same coordinates as src.
         assert (src->scale < 32);
         src_y = (y >> src->scale);
-        src_width = (src->width >> src->scale);
 
         // Check y.  It may go past the end of the buffer because of truncation.
         if (src_y >= (src->height >> src->scale))
@@ -516,8 +792,8 @@ void Blend (const Image *src,
         mask_width = (mask->width >> mask->scale);
 
         // Get scanline pointers.
-        src_p = &src->pixels[src_y * src_width];
-        dest_p = &dest->pixels[src_y * src_width];
+        src_p = &src->pixels[src_y * Pitch (*src)];
+        dest_p = &dest->pixels[src_y * Pitch (*dest)];
 
         // If the mask coordinate falls outside the boundary, don't blend.
         if (mask_y < 0)
@@ -555,10 +831,195 @@ void Blend (const Image *src,
             p1 = src_p[src_x] * m;
             p2 = dest_p[src_x] * (255 - m);
             p = (p1 + p2) / 255;
-            assert (p >= 0 && p <= 255);
+            assert (p >= 0 && p <= numeric_limits<T>::max ());
             dest_p[src_x] = p;
         }
     }
 }
 
+// The number of mask pixels between two adjacent src pixels
+template<typename T>
+static unsigned MaskStep (const ImageT<T> *src, const Image *mask)
+{
+    assert (src->scale < 32);
+    return (1 << src->scale) >> mask->scale;
+}
+
+template<typename T>
+void CompileBlend (const ImageT<T> *src,
+    const Image *mask,
+    const Rect *rect,
+    int mask_offset_x,
+    int mask_offset_y,
+    std::vector<BlendSpan> &spans)
+{
+    if (!src || !mask)
+        throw runtime_error ("CompileBlend: Invalid parameters");
+    if (mask->scale > src->scale)
+        throw runtime_error ("CompileBlend: Invalid dimensions");
+
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+
+    if (rect)
+    {
+        x1 = rect->x1;
+        y1 = rect->y1;
+        x2 = rect->x2;
+        y2 = rect->y2;
+    }
+    else
+    {
+        // Default is the entire src.
+        x1 = 0;
+        y1 = 0;
+        x2 = src->width;
+        y2 = src->height;
+    }
+
+    assert (x1 >= 0 && x1 <= static_cast<int> (src->width));
+    assert (y1 >= 0 && y1 <= static_cast<int> (src->height));
+    assert (x2 >= 0 && x2 <= static_cast<int> (src->width));
+    assert (y2 >= 0 && y2 <= static_cast<int> (src->height));
+
+    if (x2 <= x1 || y2 <= y1)
+        return;
+
+    // Stepping 'inc' pixels at normal resolution moves one pixel in
+    // src and 'step' pixels in the mask.
+    const int inc = 1 << src->scale;
+    const int step = MaskStep (src, mask);
+    const int src_width = src->width >> src->scale;
+    const int src_height = src->height >> src->scale;
+    const int mask_width = mask->width >> mask->scale;
+    const int mask_height = mask->height >> mask->scale;
+
+    // Find the range of pixels in a row that fall inside both src and
+    // the mask.
+    const int columns = (x2 - x1 + inc - 1) / inc;
+    const int src_x = x1 >> src->scale;
+    const int mask_x = (x1 >> mask->scale) - (mask_offset_x >> mask->scale);
+    int first = 0;
+    if (mask_x < 0)
+        first = (-mask_x + step - 1) / step;
+    int last = columns;
+    if (last > src_width - src_x)
+        last = src_width - src_x;
+    if (mask_x < mask_width)
+    {
+        int n = (mask_width - mask_x + step - 1) / step;
+        if (last > n)
+            last = n;
+    }
+    else
+        last = 0;
+
+    if (first >= last)
+        return;
+
+    for (int y = y1; y < y2; y += inc)
+    {
+        int src_y = y >> src->scale;
+
+        // It may go past the end of the buffer because of truncation.
+        if (src_y >= src_height)
+            break;
+
+        int mask_y = (y >> mask->scale) - (mask_offset_y >> mask->scale);
+
+        // If the mask coordinate falls outside the boundary, don't blend.
+        if (mask_y < 0)
+            continue;
+        if (mask_y >= mask_height)
+            break;
+
+        BlendSpan span;
+        span.x = src_x + first;
+        span.y = src_y;
+        span.mask_offset = mask_y * Pitch (*mask) + mask_x + first * step;
+        span.length = last - first;
+        spans.push_back (span);
+    }
+}
+
+// Blend over compiled spans.  If 'residual' is true, src holds the
+// differences between the source pixels and dest, plus ResidualBias.
+template<typename T, bool residual>
+static void BlendCompiled (const char *name,
+    const ImageT<T> *src,
+    ImageT<T> *dest,
+    const Image *mask,
+    const BlendSpan *spans,
+    size_t total)
+{
+    if (!src || !dest || !mask || (total && !spans))
+        throw runtime_error (std::string (name) + ": Invalid parameters");
+    if (src->width != dest->width || src->height != dest->height ||
+        src->scale != dest->scale || mask->scale > src->scale)
+        throw runtime_error (std::string (name) + ": Invalid dimensions");
+
+    const unsigned step = MaskStep (src, mask);
+    const unsigned src_pitch = Pitch (*src);
+    const unsigned dest_pitch = Pitch (*dest);
+
+    for (size_t i = 0; i < total; ++i)
+    {
+        assert (spans[i].x + spans[i].length <= (src->width >> src->scale));
+        const T *src_p = &src->pixels[spans[i].y * src_pitch + spans[i].x];
+        T *dest_p = &dest->pixels[spans[i].y * dest_pitch + spans[i].x];
+        const unsigned char *mask_p = mask->pixels + spans[i].mask_offset;
+        const unsigned length = spans[i].length;
+
+        assert (spans[i].mask_offset % Pitch (*mask) + (length - 1) * step < (mask->width >> mask->scale));
+        assert (spans[i].mask_offset / Pitch (*mask) < (mask->height >> mask->scale));
+
+        unsigned x = step == 1 ? BlendFast<residual> (src_p, dest_p, mask_p, length) : 0;
+        for (; x < length; ++x)
+        {
+            // Recover the source pixel
+            int s = residual ? static_cast<T> (src_p[x] + dest_p[x] - ResidualBias<T> ()) : src_p[x];
+            // Blend the pixel.
+            int m = mask_p[x * step];
+            int p = (s * m + dest_p[x] * (255 - m)) / 255;
+            assert (p >= 0 && p <= numeric_limits<T>::max ());
+            dest_p[x] = p;
+        }
+    }
+}
+
+template<typename T>
+void BlendSpans (const ImageT<T> *src,
+    ImageT<T> *dest,
+    const Image *mask,
+    const BlendSpan *spans,
+    size_t total)
+{
+    BlendCompiled<T, false> ("BlendSpans", src, dest, mask, spans, total);
+}
+
+template<typename T>
+void BlendResidualSpans (const ImageT<T> *src,
+    ImageT<T> *dest,
+    const Image *mask,
+    const BlendSpan *spans,
+    size_t total)
+{
+    BlendCompiled<T, true> ("BlendResidualSpans", src, dest, mask, spans, total);
+}
+
+// Instantiate the templates for 8 and 16 bit pixels
+#define INSTANTIATE(T) \
+    template void Reduce3x3 (const ImageT<T> *, ImageT<T> *); \
+    template void Copy (const ImageT<T> *, ImageT<T> *); \
+    template void ExpandOdd (const ImageT<T> *, ImageT<T> *); \
+    template void Blend (const ImageT<T> *, ImageT<T> *, const AutoImage *, const Rect *, int, int); \
+    template void CompileBlend (const ImageT<T> *, const Image *, const Rect *, int, int, std::vector<BlendSpan> &); \
+    template void BlendSpans (const ImageT<T> *, ImageT<T> *, const Image *, const BlendSpan *, size_t); \
+    template void BlendResidualSpans (const ImageT<T> *, ImageT<T> *, const Image *, const BlendSpan *, size_t);
+
+INSTANTIATE (unsigned char)
+INSTANTIATE (unsigned short)
+
 } // namespace SVIS
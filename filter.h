@@ -11,6 +11,8 @@
 #define FILTER_H
 
 #include "image.h"
+#include <cstddef>
+#include <vector>
 
 namespace SVIS
 {
@@ -21,26 +23,93 @@ struct Rect
     int x2, y2; // Non-inclusive
 };
 
+// The routines that are templated on the pixel type are instantiated
+// for 8 bit Images and 16 bit Image16s.  Masks are always 8 bits.
+// Reduce3x3, ExpandOdd, BlendSpans and BlendResidualSpans use SSE2 for
+// 16 bit pixels on processors that have it, with the same results.
+
 void Reduce2x2 (const Image *src, Image *dest);
-void Reduce3x3 (const Image *src, Image *dest);
+template<typename T>
+void Reduce3x3 (const ImageT<T> *src, ImageT<T> *dest);
+
+// Copy src to dest.  They must have the same dimensions, but may have
+// different pitches.
+template<typename T>
+void Copy (const ImageT<T> *src, ImageT<T> *dest);
 
 // Use ExpandEven on an image that was reduced by an even-tap filter.
 void ExpandEven (const Image *src, Image *dest);
 
 // Use ExpandOdd on an image that was reduced by an odd-tap filter.
-void ExpandOdd (const Image *src, Image *dest);
+template<typename T>
+void ExpandOdd (const ImageT<T> *src, ImageT<T> *dest);
 
 // Blend src and dest together and store result in dest.
 // Only blend over the src rect region if one is specified.
 // mask_offset_x and _y specify where the mask's top left
 // pixel is relative to the src's top left pixel.
-void Blend (const Image *src,
-    Image *dest,
+template<typename T>
+void Blend (const ImageT<T> *src,
+    ImageT<T> *dest,
     const AutoImage *mask,
     const Rect *rect,
     int mask_offset_x,
     int mask_offset_y);
 
+// A horizontal run of pixels to blend.
+//
+// The position is in pixels at the image's scale, and the mask offset
+// is counted in pixels from the first pixel of the mask, so a span
+// stays valid when the image buffers move or have different pitches.
+// The mask offset includes the mask's pitch.
+struct BlendSpan
+{
+    unsigned x; // Position in src and dest
+    unsigned y;
+    unsigned mask_offset; // Offset into mask
+    unsigned length;
+};
+
+// Compile the pixels that Blend() would process into a list of spans
+// and append them to 'spans'.  The parameters have the same meaning as
+// they do in Blend().  The mask's scale may not be larger than the
+// src's scale.
+template<typename T>
+void CompileBlend (const ImageT<T> *src,
+    const Image *mask,
+    const Rect *rect,
+    int mask_offset_x,
+    int mask_offset_y,
+    std::vector<BlendSpan> &spans);
+
+// Blend src and dest together over a list of compiled spans and store
+// result in dest.
+template<typename T>
+void BlendSpans (const ImageT<T> *src,
+    ImageT<T> *dest,
+    const Image *mask,
+    const BlendSpan *spans,
+    size_t total);
+
+// Like BlendSpans, but src holds the differences, plus ResidualBias
+// and modulo the pixel range, between the source pixels and dest.
+// Each source pixel is recovered from its difference and the dest
+// pixel before they are blended.
+template<typename T>
+void BlendResidualSpans (const ImageT<T> *src,
+    ImageT<T> *dest,
+    const Image *mask,
+    const BlendSpan *spans,
+    size_t total);
+
+// The value that residuals are offset by, half the range of a pixel:
+// 128 for 8 bit pixels
+template<typename T>
+inline unsigned ResidualBias ()
+{
+    return 1u << (8 * sizeof (T) - 1);
+}
+
 } // namespace SVIS
 
 #endif // FILTER_H
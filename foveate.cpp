@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include "foveate.h"
 #include <stdexcept>
 
@@ -17,7 +18,8 @@ using namespace std;
 namespace SVIS
 {
 
-void FoveationPyramid::Create (Image &base, unsigned levels)
+template<typename T>
+void FoveationPyramidT<T>::Create (ImageT<T> &base, unsigned levels)
 {
     // Levels must be between 1 and 16.
     if (levels < 1 || levels > 16)
@@ -26,38 +28,47 @@ void FoveationPyramid::Create (Image &base, unsigned levels)
     // Allocate the vector of images.
     images.resize (levels);
 
-    // Allocate the vector of regions.
+    // Allocate the vector of regions and their spans.
     regions.resize (levels);
+    spans.resize (levels);
 
     this->levels = levels;
+    this->residual = false;
     this->fixation_x = base.width / 2;
     this->fixation_y = base.height / 2;
 
-    // Allocate the image buffers and setup pointers.
-    buffers.resize (levels);
+    // Find out how much storage the levels need
+    size_t bytes = 0;
+    for (unsigned n = 1; n < levels; n++)
+    {
+        unsigned width = base.width >> (base.scale + n);
+        unsigned height = base.height >> (base.scale + n);
+        // Make sure the image has at least one pixel so that we may address pixels[0]
+        bytes += Arena::Size (width ? width : 1, height ? height : 1, sizeof (T));
+    }
+    arena.Reset (bytes);
+
+    // Setup pointers to the base and to the arena.
     for (unsigned n = 0; n < levels; n++)
     {
-        images[n].width = buffers[n].width = base.width;
-        images[n].height = buffers[n].height = base.height;
-        images[n].scale = buffers[n].scale = base.scale + n;
+        images[n].width = base.width;
+        images[n].height = base.height;
+        images[n].scale = base.scale + n;
 
         if (n == 0)
         {
             // If this is level 0, point the image to the base...
             assert (base.pixels);
             images[0].pixels = &base.pixels[0];
+            images[0].pitch = base.pitch;
         }
         else
         {
-            // ... otherwise, resize the buffer according to its scale,
-            // and point the image to the buffer
-            unsigned size = (buffers[n].width >> buffers[n].scale) *
-                (buffers[n].height >> buffers[n].scale);
-            // Make sure the image has at least one pixel so that we may address pixels[0]
-            if (!size)
-                size = 1;
-            buffers[n].pixels.resize (size);
-            images[n].pixels = &buffers[n].pixels[0];
+            // ... otherwise, allocate it in the arena
+            unsigned width = images[n].width >> images[n].scale;
+            unsigned height = images[n].height >> images[n].scale;
+            images[n].pitch = Arena::Pitch (width ? width : 1);
+            images[n].pixels = reinterpret_cast<T *> (arena.Allocate (Arena::Size (width ? width : 1, height ? height : 1, sizeof (T))));
         }
     }
 }
@@ -70,8 +81,10 @@ void FoveationMasks::Create (const AutoImage &resmap, unsigned levels)
 
     this->levels = levels;
 
-    // Allocate vectors
-    masks.resize (levels);
+    // Allocate vectors.  The masks are created here and moved into
+    // the arena when they are finished.
+    vector<AutoImage> masks (levels);
+    this->masks.resize (levels);
     center_xs.resize (levels);
     center_ys.resize (levels);
     regions.resize (levels);
@@ -137,9 +150,40 @@ void FoveationMasks::Create (const AutoImage &resmap, unsigned levels)
             start_y = r.y1; // top
         }
     }
+
+    // Copy the masks into the arena
+    size_t bytes = 0;
+    for (unsigned n = 0; n < levels; n++)
+        bytes += Arena::Size (masks[n].width >> masks[n].scale, masks[n].height >> masks[n].scale);
+    arena.Reset (bytes);
+    for (unsigned n = 0; n < levels; n++)
+    {
+        Image &m = this->masks[n];
+        m.width = masks[n].width;
+        m.height = masks[n].height;
+        m.scale = masks[n].scale;
+        m.pitch = Arena::Pitch (m.width >> m.scale);
+        m.pixels = arena.Allocate (Arena::Size (m.width >> m.scale, m.height >> m.scale));
+        Image packed = { m.width, m.height, m.scale, masks[n].pixels.empty () ? 0 : &masks[n].pixels[0] };
+        if (packed.pixels)
+            Copy (&packed, &m);
+    }
 }
 
-void FoveationPyramid::Reduce ()
+void FoveationMasks::Share (const FoveationMasks &m, unsigned first)
+{
+    if (first > m.levels)
+        throw runtime_error ("Invalid 'first' parameter");
+    levels = m.levels - first;
+    // The images point into the arena of 'm'
+    masks.assign (m.masks.begin () + first, m.masks.end ());
+    center_xs.assign (m.center_xs.begin () + first, m.center_xs.end ());
+    center_ys.assign (m.center_ys.begin () + first, m.center_ys.end ());
+    regions.assign (m.regions.begin () + first, m.regions.end ());
+}
+
+template<typename T>
+void FoveationPyramidT<T>::Reduce ()
 {
     // Reduce the images.
     assert (images.size () > 0);
@@ -147,9 +191,49 @@ void FoveationPyramid::Reduce ()
         Reduce3x3 (&images[n], &images[n + 1]);
 }
 
-void FoveationEncode (FoveationPyramid &p, const FoveationMasks &m, int x, int y)
+// Compile the spans that blend the regions of a level
+template<typename T>
+static void Compile (const ImageT<T> &image,
+    const Image &mask,
+    const vector<Region> &regions,
+    int mask_offset_x,
+    int mask_offset_y,
+    vector<BlendSpan> &spans)
+{
+    spans.clear ();
+    for (unsigned r = 0; r < regions.size (); ++r)
+    {
+        Rect rect;
+        rect.x1 = regions[r].x1;
+        rect.y1 = regions[r].y1;
+        rect.x2 = regions[r].x2;
+        rect.y2 = regions[r].y2;
+
+        // It is possible that the region has a zero dimension.
+        // In this case, do not blend.
+        if (rect.x2 == rect.x1 || rect.y2 == rect.y1)
+            continue;
+
+        CompileBlend (&image,
+            &mask,
+            &rect,
+            mask_offset_x,
+            mask_offset_y,
+            spans);
+    }
+}
+
+template<typename T>
+void FoveationEncode (const FoveationPyramidT<T> &p,
+    const FoveationMasks &m,
+    int x,
+    int y,
+    vector<vector<Region> > &regions,
+    vector<vector<BlendSpan> > &spans)
 {
     // Compute the regions relative to x, y.
+    regions.resize (p.levels);
+    spans.resize (p.levels);
 
     // For each region in each mask level, convert the region to
     // coordinates relative to the pyramid image.
@@ -159,9 +243,9 @@ void FoveationEncode (FoveationPyramid &p, const FoveationMasks &m, int x, int y
         int mask_offset_y = y - m.center_ys[n];
 
         // If this is the first time we are calling this routine, we need
-        // to allocate space in the pyramid for the regions
-        if (p.regions[n].size () != m.regions[n].size ())
-            p.regions[n].resize (m.regions[n].size ());
+        // to allocate space for the regions
+        if (regions[n].size () != m.regions[n].size ())
+            regions[n].resize (m.regions[n].size ());
 
         for (unsigned r = 0; r < m.regions[n].size (); ++r)
         {
@@ -203,28 +287,95 @@ void FoveationEncode (FoveationPyramid &p, const FoveationMasks &m, int x, int y
                 y2 = p.images[n].height;
 
             // Now set the unsigned rect
-            p.regions[n][r].x1 = x1;
-            p.regions[n][r].y1 = y1;
-            p.regions[n][r].x2 = x2;
-            p.regions[n][r].y2 = y2;
+            regions[n][r].x1 = x1;
+            regions[n][r].y1 = y1;
+            regions[n][r].x2 = x2;
+            regions[n][r].y2 = y2;
         }
+
+        // Compile the blending spans for this level so that decoding
+        // only has to execute them.
+        Compile (p.images[n], m.masks[n], regions[n], mask_offset_x, mask_offset_y, spans[n]);
     }
 
     // Always set the top level of the pyramid to include the entire
     // image
     unsigned top = p.levels - 1;
-    p.regions[top].resize (1);
-    p.regions[top][0].x1 = 0;
-    p.regions[top][0].y1 = 0;
-    p.regions[top][0].x2 = p.images[top].width;
-    p.regions[top][0].y2 = p.images[top].height;
+    regions[top].resize (1);
+    regions[top][0].x1 = 0;
+    regions[top][0].y1 = 0;
+    regions[top][0].x2 = p.images[top].width;
+    regions[top][0].y2 = p.images[top].height;
+    // The top level is copied, not blended
+    spans[top].clear ();
+}
+
+template<typename T>
+void FoveationEncode (FoveationPyramidT<T> &p, const FoveationMasks &m, int x, int y)
+{
+    FoveationEncode (p, m, x, y, p.regions, p.spans);
 
     // Set the fixation point.
     p.fixation_x = x;
     p.fixation_y = y;
 }
 
-void FoveationDecode (const FoveationPyramid &src, const FoveationMasks &masks, FoveationPyramid &dest)
+template<typename T>
+void FoveationCompile (FoveationPyramidT<T> &p, const FoveationMasks &m)
+{
+    if (p.regions.size () != p.levels)
+        throw runtime_error ("The pyramid has no regions");
+    p.spans.resize (p.levels);
+    for (unsigned n = 0; n < p.levels - 1; ++n)
+        Compile (p.images[n],
+            m.masks[n],
+            p.regions[n],
+            p.fixation_x - m.center_xs[n],
+            p.fixation_y - m.center_ys[n],
+            p.spans[n]);
+    // The top level is copied, not blended
+    p.spans[p.levels - 1].clear ();
+}
+
+// Save the differences, plus ResidualBias, between the regions of a
+// level and the same pixels of another image of the same dimensions
+template<typename T>
+static void Subtract (const ImageT<T> &src,
+    const vector<Region> &regions,
+    const ImageT<T> &prediction,
+    ImageT<T> &residual)
+{
+    for (unsigned r = 0; r < regions.size (); ++r)
+    {
+        unsigned x1 = regions[r].x1 >> src.scale;
+        unsigned y1 = regions[r].y1 >> src.scale;
+        unsigned x2 = regions[r].x2 >> src.scale;
+        unsigned y2 = regions[r].y2 >> src.scale;
+        for (unsigned y = y1; y < y2; ++y)
+        {
+            const T *s = src.pixels + y * Pitch (src);
+            const T *p = prediction.pixels + y * Pitch (prediction);
+            T *d = residual.pixels + y * Pitch (residual);
+            for (unsigned x = x1; x < x2; ++x)
+                d[x] = s[x] - p[x] + ResidualBias<T> ();
+        }
+    }
+}
+
+// Decode a pyramid by executing its compiled blending spans.  If
+// 'deadline' is specified, stop blending when it passes and save the
+// levels that were only upsampled in 'skipped'.  If 'residual' is
+// specified, save the Laplacian residuals of the regions in it.
+template<typename T>
+static void Decode (const FoveationPyramidT<T> &src,
+    const vector<vector<BlendSpan> > &spans,
+    int x,
+    int y,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest,
+    const chrono::steady_clock::time_point *deadline,
+    vector<unsigned> *skipped,
+    FoveationPyramidT<T> *residual = 0)
 {
     // Make sure the pyramid bases are the same dimension.
     if (src.levels != dest.levels ||
@@ -242,53 +393,125 @@ void FoveationDecode (const FoveationPyramid &src, const FoveationMasks &masks,
         src.images[top].scale != dest.images[top].scale)
         throw runtime_error ("Pyramid dimensions must be equal");
 
-    unsigned top_size = (src.images[top].width >> src.images[top].scale) *
-        (src.images[top].height >> src.images[top].scale);
-
     // Copy top level of src to dest.
-    copy (&src.images[top].pixels[0],
-        &src.images[top].pixels[top_size],
-        &dest.images[top].pixels[0]);
+    Copy (&src.images[top], &dest.images[top]);
+    if (residual)
+        Copy (&src.images[top], &residual->images[top]);
 
     // Set the fixation point.
-    dest.fixation_x = src.fixation_x;
-    dest.fixation_y = src.fixation_y;
+    dest.fixation_x = x;
+    dest.fixation_y = y;
+
+    if (skipped)
+        skipped->clear ();
+    bool late = false;
 
     // Expand and copy over regions as you go, starting with the top
     // and working down...
     for (unsigned n = dest.levels - 1; n > 0; --n)
     {
-        int mask_offset_x = dest.fixation_x - masks.center_xs[n - 1];
-        int mask_offset_y = dest.fixation_y - masks.center_ys[n - 1];
-
         // Upsample and interpolate
         ExpandOdd (&dest.images[n], &dest.images[n - 1]);
 
-        // Now blend the regions
-        for (unsigned r = 0; r < masks.regions[n - 1].size (); r++)
+        // Once the deadline has passed, the finer levels are only
+        // upsampled from the finest level that was blended.
+        if (!late && deadline)
+            late = chrono::steady_clock::now () >= *deadline;
+        if (late)
         {
-            Rect rect;
-            rect.x1 = src.regions[n - 1][r].x1;
-            rect.y1 = src.regions[n - 1][r].y1;
-            rect.x2 = src.regions[n - 1][r].x2;
-            rect.y2 = src.regions[n - 1][r].y2;
-
-            // It is possible that the region has a zero dimension.
-            // In this case, do not blend.
-            assert ((rect.x2 - rect.x1) * (rect.y2 - rect.y1) >= 0);
+            assert (skipped);
+            skipped->push_back (n - 1);
+            continue;
+        }
 
-            if ((rect.x2 - rect.x1) * (rect.y2 - rect.y1) == 0)
-                continue;
+        // The expanded level predicts the regions
+        if (residual)
+            Subtract (src.images[n - 1], src.regions[n - 1], dest.images[n - 1], residual->images[n - 1]);
 
-            // Do the blending
-            Blend (&src.images[n - 1],
+        // Now blend the regions
+        if (spans[n - 1].empty ())
+            continue;
+        if (src.residual)
+            BlendResidualSpans (&src.images[n - 1],
                 &dest.images[n - 1],
                 &masks.masks[n - 1],
-                &rect,
-                mask_offset_x,
-                mask_offset_y);
-        }
+                &spans[n - 1][0],
+                spans[n - 1].size ());
+        else
+            BlendSpans (&src.images[n - 1],
+                &dest.images[n - 1],
+                &masks.masks[n - 1],
+                &spans[n - 1][0],
+                spans[n - 1].size ());
     }
 }
 
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src,
+    const vector<vector<BlendSpan> > &spans,
+    int x,
+    int y,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest)
+{
+    Decode (src, spans, x, y, masks, dest, 0, 0);
+}
+
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest,
+    double budget,
+    vector<unsigned> &skipped)
+{
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now () +
+        chrono::duration_cast<chrono::steady_clock::duration> (chrono::duration<double> (budget));
+    Decode (src, src.spans, src.fixation_x, src.fixation_y, masks, dest, &deadline, &skipped);
+}
+
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src, const FoveationMasks &masks, FoveationPyramidT<T> &dest)
+{
+    FoveationDecode (src, src.spans, src.fixation_x, src.fixation_y, masks, dest);
+}
+
+template<typename T>
+void FoveationResidual (const FoveationPyramidT<T> &src,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest,
+    FoveationPyramidT<T> &residual)
+{
+    if (src.residual)
+        throw runtime_error ("The pyramid already holds residuals");
+    if (src.levels != residual.levels ||
+        src.images[0].width != residual.images[0].width ||
+        src.images[0].height != residual.images[0].height ||
+        src.images[0].scale != residual.images[0].scale)
+        throw runtime_error ("Pyramid dimensions must be equal");
+    Decode (src, src.spans, src.fixation_x, src.fixation_y, masks, dest, 0, 0, &residual);
+    residual.fixation_x = src.fixation_x;
+    residual.fixation_y = src.fixation_y;
+    residual.regions = src.regions;
+    residual.spans = src.spans;
+    residual.residual = true;
+}
+
+// Instantiate the templates for 8 and 16 bit pixels
+#define INSTANTIATE(T) \
+    template struct FoveationPyramidT<T>; \
+    template void FoveationEncode (FoveationPyramidT<T> &, const FoveationMasks &, int, int); \
+    template void FoveationEncode (const FoveationPyramidT<T> &, const FoveationMasks &, int, int, \
+        vector<vector<Region> > &, vector<vector<BlendSpan> > &); \
+    template void FoveationCompile (FoveationPyramidT<T> &, const FoveationMasks &); \
+    template void FoveationDecode (const FoveationPyramidT<T> &, const FoveationMasks &, FoveationPyramidT<T> &); \
+    template void FoveationDecode (const FoveationPyramidT<T> &, const FoveationMasks &, FoveationPyramidT<T> &, \
+        double, vector<unsigned> &); \
+    template void FoveationDecode (const FoveationPyramidT<T> &, const vector<vector<BlendSpan> > &, int, int, \
+        const FoveationMasks &, FoveationPyramidT<T> &); \
+    template void FoveationResidual (const FoveationPyramidT<T> &, const FoveationMasks &, \
+        FoveationPyramidT<T> &, FoveationPyramidT<T> &);
+
+INSTANTIATE (unsigned char)
+INSTANTIATE (unsigned short)
+
 } // namespace SVIS
@@ -10,6 +10,7 @@
 #ifndef FOVEATE_H
 #define FOVEATE_H
 
+#include "arena.h"
 #include "ecc.h"
 #include "filter.h"
 #include "mask.h"
@@ -20,45 +21,130 @@
 namespace SVIS
 {
 
-struct FoveationPyramid
+// A pyramid of 8 bit pixels, or 16 bit pixels in a FoveationPyramid16.
+// The routines below are instantiated for both.
+template<typename T>
+struct FoveationPyramidT
 {
-    void Create (Image &base, unsigned levels);
+    void Create (ImageT<T> &base, unsigned levels);
     void Reduce ();
     unsigned levels;
-    std::vector<Image> images;
+    std::vector<ImageT<T> > images;
     int fixation_x;
     int fixation_y;
     std::vector<std::vector<Region> > regions;
-    FoveationPyramid () { }
-    ~FoveationPyramid () { }
+    // The blending spans that decode the regions
+    std::vector<std::vector<BlendSpan> > spans;
+    // If true, the regions of every level but the top hold Laplacian
+    // residuals.  See FoveationResidual.
+    bool residual;
+    FoveationPyramidT () { }
+    ~FoveationPyramidT () { }
 
     private:
-    // This member provides temporary storage that gets deallocated
-    // automatically when the object is destroyed.
-    std::vector<AutoImage> buffers;
+    // Storage for every level but the base.  The levels are cache line
+    // aligned and their rows are padded to the vector width.
+    Arena arena;
     // Disable copying
-    FoveationPyramid (const FoveationPyramid &);
-    FoveationPyramid &operator= (const FoveationPyramid &);
+    FoveationPyramidT (const FoveationPyramidT &);
+    FoveationPyramidT &operator= (const FoveationPyramidT &);
 };
 
+typedef FoveationPyramidT<unsigned char> FoveationPyramid;
+typedef FoveationPyramidT<unsigned short> FoveationPyramid16;
+
 struct FoveationMasks
 {
     void Create (const AutoImage &resmap, unsigned levels);
+    // Use the masks of another set, starting at level 'first', without
+    // copying them.  Level n of a pyramid whose base is 'first' levels
+    // coarser, such as a subsampled chroma plane, is then blended with
+    // the mask that level n + first of a full resolution pyramid is.
+    // 'm' must outlive this set.
+    void Share (const FoveationMasks &m, unsigned first);
     unsigned levels;
-    std::vector<AutoImage> masks;
+    // The masks are stored like the pyramid levels, in one arena with
+    // padded rows
+    std::vector<Image> masks;
     // Center x and y values tell where the center of the mask lies
     // relative to some arbitrary point, like, for example, the center of
     // the retina.
     std::vector<int> center_xs;
     std::vector<int> center_ys;
     std::vector<std::vector<Region> > regions;
+    FoveationMasks () { }
+
+    private:
+    Arena arena;
+    // Disable copying
+    FoveationMasks (const FoveationMasks &);
+    FoveationMasks &operator= (const FoveationMasks &);
 };
 
 // Encode a pyramid given its masks and the fixation point
-void FoveationEncode (FoveationPyramid &p, const FoveationMasks &masks, int x, int y);
+template<typename T>
+void FoveationEncode (FoveationPyramidT<T> &p, const FoveationMasks &masks, int x, int y);
+
+// Compute the regions that encode fixation point x, y, and compile the
+// spans that blend them, without modifying the pyramid.  This allows
+// several fixations to be encoded from the same reduced pyramid at
+// once.
+template<typename T>
+void FoveationEncode (const FoveationPyramidT<T> &p,
+    const FoveationMasks &masks,
+    int x,
+    int y,
+    std::vector<std::vector<Region> > &regions,
+    std::vector<std::vector<BlendSpan> > &spans);
+
+// Compile the spans that blend the regions a pyramid already has at
+// its fixation point.  The regions may be any of those that
+// FoveationEncode would compute there, such as the blocks that have
+// arrived from a progressive bitstream.  Levels whose regions are
+// missing are upsampled from the level above when decoded.
+template<typename T>
+void FoveationCompile (FoveationPyramidT<T> &p, const FoveationMasks &masks);
 
 // Decode a pyramid given its masks and a place to decode it into
-void FoveationDecode (const FoveationPyramid &src, const FoveationMasks &masks, FoveationPyramid &dest);
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src, const FoveationMasks &masks, FoveationPyramidT<T> &dest);
+
+// Decode a pyramid, but stop blending once 'budget' seconds have
+// elapsed.  The remaining levels are upsampled from the finest level
+// that was blended, and the levels that were not blended are returned
+// in 'skipped', coarsest first.
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest,
+    double budget,
+    std::vector<unsigned> &skipped);
+
+// Decode a pyramid that was encoded at fixation point x, y by blending
+// the given spans.
+template<typename T>
+void FoveationDecode (const FoveationPyramidT<T> &src,
+    const std::vector<std::vector<BlendSpan> > &spans,
+    int x,
+    int y,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest);
+
+// Decode an encoded pyramid into 'dest', and write its Laplacian
+// residuals into 'residual', which must have the same dimensions.
+//
+// The regions of each level but the top are replaced by their
+// differences, plus ResidualBias and modulo the pixel range, from the
+// level above as it is decoded and expanded, which is known to the
+// decoder before it blends them.  The residuals carry less of the
+// image than the pixels do, so they compress better.  The top level is
+// copied.  The residual pyramid gets the fixation point, regions and
+// spans of 'src', and decodes to the same image.
+template<typename T>
+void FoveationResidual (const FoveationPyramidT<T> &src,
+    const FoveationMasks &masks,
+    FoveationPyramidT<T> &dest,
+    FoveationPyramidT<T> &residual);
 
 } // namespace SVIS
 
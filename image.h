@@ -13,28 +13,50 @@
 namespace SVIS
 {
 
-// Grayscale image -- user is responsible for allocating pixels
-struct Image
+// Grayscale image -- user is responsible for allocating pixels.
+// Pixels are 8 bits, or 16 bits in an Image16.
+template<typename T>
+struct ImageT
 {
     unsigned width;
     unsigned height;
     // When accessing pixels in the image, coordinates are always
     // shifted 'scale' number of bits to the right.
     unsigned scale;
-    unsigned char *pixels;
+    T *pixels;
+    // The number of pixels from the start of one row to the start of
+    // the next, at the image's scale.  Zero means that the rows are
+    // packed, i.e. the pitch is 'width' >> 'scale'.  It is last, and
+    // so zero, when it is left out of an initializer.
+    unsigned pitch;
 };
 
+typedef ImageT<unsigned char> Image;
+typedef ImageT<unsigned short> Image16;
+
+// Return the number of pixels from the start of one row to the start
+// of the next
+template<typename T>
+inline unsigned Pitch (const ImageT<T> &i)
+{
+    return i.pitch ? i.pitch : i.width >> i.scale;
+}
+
 // Grayscale image -- pixels are deallocted upon destruction
-struct AutoImage
+template<typename T>
+struct AutoImageT
 {
     unsigned width;
     unsigned height;
     // When accessing pixels in the image, coordinates are always
     // shifted 'scale' number of bits to the right.
     unsigned scale;
-    std::vector<unsigned char> pixels;
+    std::vector<T> pixels;
 };
 
+typedef AutoImageT<unsigned char> AutoImage;
+typedef AutoImageT<unsigned short> AutoImage16;
+
 } // namespace SVIS
 
 #endif // IMAGE_H
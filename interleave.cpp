@@ -0,0 +1,248 @@
+// Split interleaved color images into planes, and merge them back
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "interleave.h"
+
+#include <cstring>
+#include <stdexcept>
+
+// The SSSE3 routines are compiled for SSSE3 whatever the compiler
+// flags are, and are only called if the processor has it
+#if defined (__GNUC__) && (defined (__i386__) || defined (__x86_64__))
+#define HAVE_SSSE3
+#define SSSE3_TARGET __attribute__ ((target ("ssse3")))
+#include <tmmintrin.h>
+#elif defined (_MSC_VER) && (defined (_M_IX86) || defined (_M_X64))
+#define HAVE_SSSE3
+#define SSSE3_TARGET
+#include <intrin.h>
+#include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+namespace SVIS
+{
+
+// Split pixels x1 to x2 of a row
+static inline void DeinterleaveRow (const unsigned char *src,
+    unsigned channels,
+    unsigned char *const *planes,
+    unsigned x1,
+    unsigned x2)
+{
+    for (unsigned x = x1; x < x2; ++x)
+        for (unsigned c = 0; c < channels; ++c)
+            planes[c][x] = src[x * channels + c];
+}
+
+// Merge pixels x1 to x2 of a row
+static inline void InterleaveRow (const unsigned char *const *planes,
+    unsigned channels,
+    unsigned char *dest,
+    unsigned x1,
+    unsigned x2)
+{
+    for (unsigned x = x1; x < x2; ++x)
+        for (unsigned c = 0; c < channels; ++c)
+            dest[x * channels + c] = planes[c][x];
+}
+
+#ifdef HAVE_SSSE3
+
+static bool HasSSSE3 ()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid (info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports ("ssse3") != 0;
+#endif
+}
+
+// Sixteen pixels of C channels are C vectors of interleaved samples,
+// or C vectors of planar samples.  Sample i of plane c is byte
+// i * C + c of the interleaved vectors, so each vector of one kind is
+// the OR of C shuffles of the vectors of the other kind.
+//
+// Fill 'split' with the shuffles that take interleaved vector v to
+// plane c, and 'merge' with those that take plane c to interleaved
+// vector v.  Bytes with the high bit set are zeroed by the shuffle.
+template<unsigned C>
+static void ShuffleMasks (unsigned char split[C][C][16], unsigned char merge[C][C][16])
+{
+    for (unsigned c = 0; c < C; ++c)
+        for (unsigned v = 0; v < C; ++v)
+            for (unsigned i = 0; i < 16; ++i)
+            {
+                // Where sample i of plane c is interleaved
+                unsigned s = i * C + c;
+                split[c][v][i] = s / 16 == v ? s % 16 : 0x80;
+                // Which plane and sample byte i of vector v is
+                unsigned t = v * 16 + i;
+                merge[v][c][i] = t % C == c ? t / C : 0x80;
+            }
+}
+
+template<unsigned C>
+SSSE3_TARGET static void DeinterleaveSSSE3 (const unsigned char *src,
+    size_t src_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned char *const *planes,
+    size_t plane_pitch)
+{
+    unsigned char split[C][C][16];
+    unsigned char merge[C][C][16];
+    ShuffleMasks<C> (split, merge);
+    __m128i masks[C][C];
+    for (unsigned c = 0; c < C; ++c)
+        for (unsigned v = 0; v < C; ++v)
+            masks[c][v] = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (split[c][v]));
+
+    const unsigned w16 = width & ~15u;
+    for (unsigned y = 0; y < height; ++y)
+    {
+        const unsigned char *s = src + y * src_pitch;
+        unsigned char *p[C];
+        for (unsigned c = 0; c < C; ++c)
+            p[c] = planes[c] + y * plane_pitch;
+        for (unsigned x = 0; x < w16; x += 16)
+        {
+            __m128i in[C];
+            for (unsigned v = 0; v < C; ++v)
+                in[v] = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (s + x * C + v * 16));
+            for (unsigned c = 0; c < C; ++c)
+            {
+                __m128i out = _mm_shuffle_epi8 (in[0], masks[c][0]);
+                for (unsigned v = 1; v < C; ++v)
+                    out = _mm_or_si128 (out, _mm_shuffle_epi8 (in[v], masks[c][v]));
+                _mm_storeu_si128 (reinterpret_cast<__m128i *> (p[c] + x), out);
+            }
+        }
+        DeinterleaveRow (s, C, p, w16, width);
+    }
+}
+
+template<unsigned C>
+SSSE3_TARGET static void InterleaveSSSE3 (const unsigned char *const *planes,
+    size_t plane_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned char *dest,
+    size_t dest_pitch)
+{
+    unsigned char split[C][C][16];
+    unsigned char merge[C][C][16];
+    ShuffleMasks<C> (split, merge);
+    __m128i masks[C][C];
+    for (unsigned v = 0; v < C; ++v)
+        for (unsigned c = 0; c < C; ++c)
+            masks[v][c] = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (merge[v][c]));
+
+    const unsigned w16 = width & ~15u;
+    for (unsigned y = 0; y < height; ++y)
+    {
+        unsigned char *d = dest + y * dest_pitch;
+        const unsigned char *p[C];
+        for (unsigned c = 0; c < C; ++c)
+            p[c] = planes[c] + y * plane_pitch;
+        for (unsigned x = 0; x < w16; x += 16)
+        {
+            __m128i in[C];
+            for (unsigned c = 0; c < C; ++c)
+                in[c] = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (p[c] + x));
+            for (unsigned v = 0; v < C; ++v)
+            {
+                __m128i out = _mm_shuffle_epi8 (in[0], masks[v][0]);
+                for (unsigned c = 1; c < C; ++c)
+                    out = _mm_or_si128 (out, _mm_shuffle_epi8 (in[c], masks[v][c]));
+                _mm_storeu_si128 (reinterpret_cast<__m128i *> (d + x * C + v * 16), out);
+            }
+        }
+        InterleaveRow (p, C, d, w16, width);
+    }
+}
+
+#endif // HAVE_SSSE3
+
+void Deinterleave (const unsigned char *src,
+    unsigned src_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned channels,
+    unsigned char *const *planes,
+    unsigned plane_pitch)
+{
+    if (channels < 1 || channels > 4)
+        throw runtime_error ("Invalid 'channels' parameter");
+    if (!src_pitch)
+        src_pitch = width * channels;
+    if (!plane_pitch)
+        plane_pitch = width;
+    if (src_pitch < width * channels || plane_pitch < width)
+        throw runtime_error ("Invalid pitch");
+
+#ifdef HAVE_SSSE3
+    static const bool ssse3 = HasSSSE3 ();
+    if (ssse3 && channels == 3)
+        return DeinterleaveSSSE3<3> (src, src_pitch, width, height, planes, plane_pitch);
+    if (ssse3 && channels == 4)
+        return DeinterleaveSSSE3<4> (src, src_pitch, width, height, planes, plane_pitch);
+#endif
+
+    unsigned char *p[4];
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned c = 0; c < channels; ++c)
+            p[c] = planes[c] + static_cast<size_t> (y) * plane_pitch;
+        // A grey image is copied
+        if (channels == 1)
+            memcpy (p[0], src + static_cast<size_t> (y) * src_pitch, width);
+        else
+            DeinterleaveRow (src + static_cast<size_t> (y) * src_pitch, channels, p, 0, width);
+    }
+}
+
+void Interleave (const unsigned char *const *planes,
+    unsigned plane_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned channels,
+    unsigned char *dest,
+    unsigned dest_pitch)
+{
+    if (channels < 1 || channels > 4)
+        throw runtime_error ("Invalid 'channels' parameter");
+    if (!dest_pitch)
+        dest_pitch = width * channels;
+    if (!plane_pitch)
+        plane_pitch = width;
+    if (dest_pitch < width * channels || plane_pitch < width)
+        throw runtime_error ("Invalid pitch");
+
+#ifdef HAVE_SSSE3
+    static const bool ssse3 = HasSSSE3 ();
+    if (ssse3 && channels == 3)
+        return InterleaveSSSE3<3> (planes, plane_pitch, width, height, dest, dest_pitch);
+    if (ssse3 && channels == 4)
+        return InterleaveSSSE3<4> (planes, plane_pitch, width, height, dest, dest_pitch);
+#endif
+
+    const unsigned char *p[4];
+    for (unsigned y = 0; y < height; ++y)
+    {
+        for (unsigned c = 0; c < channels; ++c)
+            p[c] = planes[c] + static_cast<size_t> (y) * plane_pitch;
+        if (channels == 1)
+            memcpy (dest + static_cast<size_t> (y) * dest_pitch, p[0], width);
+        else
+            InterleaveRow (p, channels, dest + static_cast<size_t> (y) * dest_pitch, 0, width);
+    }
+}
+
+} // namespace SVIS
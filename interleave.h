@@ -0,0 +1,81 @@
+// Split interleaved color images into planes, and merge them back
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#include "pnm.h"
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace SVIS
+{
+
+// A codec foveates one plane at a time, so an image with interleaved
+// samples, such as a PPM image or an RGBA camera frame, is split into
+// planes before it is foveated and merged again afterwards.
+//
+// 'channels' is the number of samples per pixel, from 1 to 4.  3 and
+// 4 channels use SSSE3 shuffles on processors that have them.  The
+// pitches are the distances between rows in bytes, or 0 if the rows
+// are packed.  A plane pitch is what CODEC::SetSrcImage takes.
+
+// Copy the samples of 'src' into 'channels' planes
+void Deinterleave (const unsigned char *src,
+    unsigned src_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned channels,
+    unsigned char *const *planes,
+    unsigned plane_pitch = 0);
+
+// Copy 'channels' planes into the samples of 'dest'
+void Interleave (const unsigned char *const *planes,
+    unsigned plane_pitch,
+    unsigned width,
+    unsigned height,
+    unsigned channels,
+    unsigned char *dest,
+    unsigned dest_pitch = 0);
+
+// Split an image into packed planes, one after another in 'planes'
+inline void Deinterleave (const PNM::Image &image, std::vector<unsigned char> &planes)
+{
+    const unsigned w = image.GetWidth ();
+    const unsigned h = image.GetHeight ();
+    const unsigned d = image.GetPixelDepth ();
+    const size_t n = static_cast<size_t> (w) * h;
+    planes.resize (n * d);
+    if (planes.empty ())
+        return;
+    std::vector<unsigned char *> p (d);
+    for (unsigned c = 0; c < d; ++c)
+        p[c] = &planes[c * n];
+    Deinterleave (&image.GetPixels ()[0], 0, w, h, d, &p[0]);
+}
+
+// Merge packed planes, one after another in 'planes', into an image,
+// which must already have their size
+inline void Interleave (const std::vector<unsigned char> &planes, PNM::Image &image)
+{
+    const unsigned w = image.GetWidth ();
+    const unsigned h = image.GetHeight ();
+    const unsigned d = image.GetPixelDepth ();
+    const size_t n = static_cast<size_t> (w) * h;
+    if (planes.size () != n * d)
+        throw std::runtime_error ("Incorrect pixel buffer size");
+    if (planes.empty ())
+        return;
+    std::vector<const unsigned char *> p (d);
+    for (unsigned c = 0; c < d; ++c)
+        p[c] = &planes[c * n];
+    Interleave (&p[0], 0, w, h, d, image.GetPixelsAddress ());
+}
+
+} // namespace SVIS
+
+#endif // INTERLEAVE_H
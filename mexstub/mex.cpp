@@ -0,0 +1,123 @@
+// A stand-in for the MATLAB MEX API
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "mex.h"
+
+#include <cassert>
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// A column major, real, numeric array
+struct mxArray
+{
+    mxClassID c;
+    vector<int> dims;
+    vector<double> doubles;
+    vector<unsigned char> uint8s;
+};
+
+void mexErrMsgTxt (const char *msg)
+{
+    throw mexError (msg);
+}
+
+int mexPrintf (const char *fmt, ...)
+{
+    va_list ap;
+    va_start (ap, fmt);
+    int n = vprintf (fmt, ap);
+    va_end (ap);
+    return n;
+}
+
+mxArray *mxCreateNumericArray (int ndims, const int *dims, mxClassID c, mxComplexity f)
+{
+    assert (ndims >= 2);
+    if (f != mxREAL)
+        mexErrMsgTxt ("The stub only supports real arrays");
+    mxArray *a = new mxArray;
+    a->c = c;
+    a->dims.assign (dims, dims + ndims);
+    size_t n = 1;
+    for (int i = 0; i < ndims; ++i)
+        n *= dims[i];
+    switch (c)
+    {
+        case mxDOUBLE_CLASS: a->doubles.resize (n); break;
+        case mxUINT8_CLASS: a->uint8s.resize (n); break;
+        default: delete a; mexErrMsgTxt ("The stub does not support this class");
+    }
+    return a;
+}
+
+mxArray *mxCreateDoubleScalar (double x)
+{
+    const int d[2] = { 1, 1 };
+    mxArray *a = mxCreateNumericArray (2, d, mxDOUBLE_CLASS, mxREAL);
+    a->doubles[0] = x;
+    return a;
+}
+
+void mxDestroyArray (mxArray *a)
+{
+    delete a;
+}
+
+int mxGetNumberOfDimensions (const mxArray *a)
+{
+    return a->dims.size ();
+}
+
+const int *mxGetDimensions (const mxArray *a)
+{
+    return &a->dims[0];
+}
+
+size_t mxGetM (const mxArray *a)
+{
+    return a->dims[0];
+}
+
+size_t mxGetN (const mxArray *a)
+{
+    // MATLAB folds the trailing dimensions into N
+    size_t n = 1;
+    for (size_t i = 1; i < a->dims.size (); ++i)
+        n *= a->dims[i];
+    return n;
+}
+
+void *mxGetData (const mxArray *a)
+{
+    mxArray *p = const_cast<mxArray *> (a);
+    if (p->c == mxDOUBLE_CLASS)
+        return p->doubles.empty () ? 0 : &p->doubles[0];
+    return p->uint8s.empty () ? 0 : &p->uint8s[0];
+}
+
+double *mxGetPr (const mxArray *a)
+{
+    assert (a->c == mxDOUBLE_CLASS);
+    return static_cast<double *> (mxGetData (a));
+}
+
+bool mxIsUint8 (const mxArray *a)
+{
+    return a->c == mxUINT8_CLASS;
+}
+
+bool mxIsDouble (const mxArray *a)
+{
+    return a->c == mxDOUBLE_CLASS;
+}
+
+bool mxIsComplex (const mxArray *)
+{
+    return false;
+}
@@ -0,0 +1,54 @@
+// A stand-in for the MATLAB MEX API
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// This implements just enough of mex.h to run the MEX handlers
+// without MATLAB, so that they can be tested and benchmarked.  Build
+// with -Imexstub, and never in the same directory as the real mex.h.
+
+#ifndef MEX_H
+#define MEX_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+typedef enum { mxUNKNOWN_CLASS, mxDOUBLE_CLASS, mxUINT8_CLASS } mxClassID;
+typedef enum { mxREAL, mxCOMPLEX } mxComplexity;
+
+struct mxArray;
+
+// MATLAB unwinds the MEX call when mexErrMsgTxt is called.  The stub
+// throws this instead.  It is not a std::exception, so that the
+// handlers do not catch it.
+struct mexError
+{
+    explicit mexError (const char *msg) : msg (msg) { }
+    const char *what () const { return msg.c_str (); }
+    // A copy, since the message is often the what () of an exception
+    // that is destroyed as this one propagates
+    std::string msg;
+};
+
+// The MEX gateway
+void mexFunction (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+void mexErrMsgTxt (const char *msg);
+int mexPrintf (const char *fmt, ...);
+
+mxArray *mxCreateNumericArray (int ndims, const int *dims, mxClassID c, mxComplexity f);
+mxArray *mxCreateDoubleScalar (double x);
+void mxDestroyArray (mxArray *a);
+int mxGetNumberOfDimensions (const mxArray *a);
+const int *mxGetDimensions (const mxArray *a);
+size_t mxGetM (const mxArray *a);
+size_t mxGetN (const mxArray *a);
+void *mxGetData (const mxArray *a);
+double *mxGetPr (const mxArray *a);
+bool mxIsUint8 (const mxArray *a);
+bool mxIsDouble (const mxArray *a);
+bool mxIsComplex (const mxArray *a);
+
+#endif // MEX_H
@@ -11,6 +11,7 @@
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -18,20 +19,26 @@
 namespace PNM
 {
 
-class Image
+// A PGM or PPM image.  An Image has 8 bit samples.  An Image16 has 16
+// bit samples, which are read from and written to files with a maxval
+// above 255 as two bytes, most significant first.
+template<typename T>
+class BasicImage
 {
     public:
-    Image () :
+    BasicImage () :
         width (0),
         height (0),
-        depth (1)
+        depth (1),
+        maxval (std::numeric_limits<T>::max ())
     {
     }
-    Image (unsigned w, unsigned h, unsigned d)
+    BasicImage (unsigned w, unsigned h, unsigned d) :
+        maxval (std::numeric_limits<T>::max ())
     {
         SetSize (w, h, d);
     }
-    ~Image ()
+    ~BasicImage ()
     {
     }
     unsigned GetSize () const
@@ -72,6 +79,17 @@ class Image
         depth = d;
         pixels.resize (width * height * depth);
     }
+    // The largest sample value, which is written to the header
+    unsigned GetMaxval () const
+    {
+        return maxval;
+    }
+    void SetMaxval (unsigned m)
+    {
+        if (m < 1 || m > std::numeric_limits<T>::max ())
+            throw std::runtime_error ("Invalid PNM maxval");
+        maxval = m;
+    }
     std::string GetComments () const
     {
         return comments;
@@ -80,48 +98,48 @@ class Image
     {
         comments = c;
     }
-    const std::vector<unsigned char> &GetPixels () const
+    const std::vector<T> &GetPixels () const
     {
         return pixels;
     }
-    unsigned char *GetPixelsAddress ()
+    T *GetPixelsAddress ()
     {
         return &pixels[0];
     }
-    unsigned char GetPixel (unsigned x, unsigned y, unsigned d)
+    T GetPixel (unsigned x, unsigned y, unsigned d)
     {
         size_t i = (y * width + x) * depth + d;
         assert (i < pixels.size ());
         return pixels[i];
     }
-    void SetPixel (unsigned x, unsigned y, unsigned d, unsigned char p)
+    void SetPixel (unsigned x, unsigned y, unsigned d, T p)
     {
         size_t i = (y * width + x) * depth + d;
         assert (i < pixels.size ());
         pixels[i] = p;
     }
     // Set all pixels in the image to 'p'
-    void SetPixels (unsigned char p)
+    void SetPixels (T p)
     {
         pixels.clear (); // probably won't dealloc
         pixels.resize (GetSize (), p); // set them all to 'p'
     }
-    void SetPixels (const std::vector<unsigned char> &p)
+    void SetPixels (const std::vector<T> &p)
     {
         if (p.size () != width * height * depth)
             throw std::runtime_error ("Incorrect pixel buffer size");
         pixels = p;
     }
     // Relational operators
-    friend bool operator== (const Image &i1, const Image &i2)
+    friend bool operator== (const BasicImage &i1, const BasicImage &i2)
     {
         return i1.width == i2.width &&
             i1.height == i2.height &&
             i1.comments == i2.comments &&
-            (memcmp (&i1.pixels[0], &i2.pixels[0], i1.width * i1.height * i1.depth) == 0);
+            (memcmp (&i1.pixels[0], &i2.pixels[0], i1.width * i1.height * i1.depth * sizeof (T)) == 0);
     }
     // I/O
-    friend std::istream& operator>> (std::istream &s, Image &i)
+    friend std::istream& operator>> (std::istream &s, BasicImage &i)
     {
         char ch;
 
@@ -154,8 +172,13 @@ class Image
 
         s >> maxval;
 
-        if (maxval > 255)
-            throw std::runtime_error ("Only 8 bpp greyscale or 24 bpp RGB is supported");
+        if (maxval > std::numeric_limits<T>::max ())
+            throw std::runtime_error (sizeof (T) == 1 ?
+                "Only 8 bpp greyscale or 24 bpp RGB is supported" :
+                "Only 16 bpp greyscale or 48 bpp RGB is supported");
+        if (maxval < 1)
+            throw std::runtime_error ("Invalid PNM maxval");
+        i.maxval = maxval;
 
         // Read a single WS
         s.get (ch);
@@ -168,9 +191,20 @@ class Image
 
         i.pixels.resize (i.width * i.height * i.depth);
 
+        // Samples above 255 take two bytes, most significant first, so
+        // wider samples are converted through a buffer
+        const size_t bytes = maxval > 255 ? 2 : 1;
+        std::vector<unsigned char> buffer;
+        unsigned char *p = reinterpret_cast<unsigned char *> (&i.pixels[0]);
+        if (sizeof (T) != 1)
+        {
+            buffer.resize (i.pixels.size () * bytes);
+            p = &buffer[0];
+        }
+
         const std::streamsize sz =
-            static_cast<std::streamsize> (i.pixels.size ());
-        s.read (reinterpret_cast<char *> (&i.pixels[0]), sz);
+            static_cast<std::streamsize> (i.pixels.size () * bytes);
+        s.read (reinterpret_cast<char *> (p), sz);
 
         if (s.eof ())
             throw std::runtime_error ("Unexpected EOF");
@@ -178,9 +212,13 @@ class Image
         if (!s)
             throw std::runtime_error ("Error reading from stream");
 
+        if (!buffer.empty ())
+            for (size_t n = 0; n < i.pixels.size (); ++n)
+                i.pixels[n] = bytes == 2 ? (buffer[2 * n] << 8) | buffer[2 * n + 1] : buffer[n];
+
         return s;
     }
-    friend std::ostream& operator<< (std::ostream &s, const Image &i)
+    friend std::ostream& operator<< (std::ostream &s, const BasicImage &i)
     {
         s << 'P';
 
@@ -203,12 +241,31 @@ class Image
         s << ' ';
         s << i.height;
         s << '\n';
-        s << 255;
+        s << i.maxval;
         s << '\n';
 
+        // Samples above 255 take two bytes, most significant first, so
+        // wider samples are converted through a buffer
+        const size_t bytes = i.maxval > 255 ? 2 : 1;
+        std::vector<unsigned char> buffer;
+        const unsigned char *p = reinterpret_cast<const unsigned char *> (&i.pixels[0]);
+        if (sizeof (T) != 1)
+        {
+            buffer.resize (i.pixels.size () * bytes);
+            for (size_t n = 0; n < i.pixels.size (); ++n)
+                if (bytes == 2)
+                {
+                    buffer[2 * n] = i.pixels[n] >> 8;
+                    buffer[2 * n + 1] = i.pixels[n] & 0xFF;
+                }
+                else
+                    buffer[n] = static_cast<unsigned char> (i.pixels[n]);
+            p = &buffer[0];
+        }
+
         const std::streamsize sz =
-            static_cast<std::streamsize> (i.pixels.size ());
-        s.write (reinterpret_cast<const char *> (&i.pixels[0]), sz);
+            static_cast<std::streamsize> (i.pixels.size () * bytes);
+        s.write (reinterpret_cast<const char *> (p), sz);
 
         if (!s)
             throw std::runtime_error ("Error writing to stream");
@@ -237,10 +294,14 @@ class Image
     unsigned width;
     unsigned height;
     unsigned depth;
+    unsigned maxval;
     std::string comments;
-    std::vector<unsigned char> pixels;
+    std::vector<T> pixels;
 };
 
+typedef BasicImage<unsigned char> Image;
+typedef BasicImage<unsigned short> Image16;
+
 } // namespace PNM
 
 #endif
@@ -0,0 +1,406 @@
+// Memory mapped PNM files
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "pnm_mmap.h"
+
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace PNM
+{
+
+// Parse a PGM or PPM header the way operator>> in pnm.h does, but from
+// memory.  Return the offset of the pixels.
+static size_t ParseHeader (const unsigned char *data,
+    size_t size,
+    unsigned &width,
+    unsigned &height,
+    unsigned &depth,
+    unsigned &maxval,
+    string &comments)
+{
+    size_t i = 0;
+    if (size < 2 || data[0] != 'P')
+        throw runtime_error ("Invalid PNM magic number");
+    switch (data[1])
+    {
+        case '5':
+        depth = 1;
+        break;
+        case '6':
+        depth = 3;
+        break;
+        default:
+        throw runtime_error ("Unsupported PNM file type: Only PGM and PPM are supported");
+    }
+    i = 2;
+    unsigned values[3];
+    for (unsigned v = 0; v < 3; ++v)
+    {
+        // Skip whitespace and comment lines
+        for (;;)
+        {
+            while (i < size && isspace (data[i]))
+                ++i;
+            if (i == size || data[i] != '#')
+                break;
+            size_t start = i;
+            while (i < size && data[i] != '\n')
+                ++i;
+            comments.append (data + start, data + i);
+            comments += "\n";
+        }
+        if (i == size || !isdigit (data[i]))
+            throw runtime_error ("Invalid PNM header");
+        unsigned long n = 0;
+        while (i < size && isdigit (data[i]))
+        {
+            n = n * 10 + (data[i++] - '0');
+            if (n > 0xFFFFFF)
+                throw runtime_error ("Invalid PNM header");
+        }
+        values[v] = static_cast<unsigned> (n);
+    }
+    width = values[0];
+    height = values[1];
+    if (values[2] > 255)
+        throw runtime_error ("Only 8 bpp greyscale or 24 bpp RGB is supported");
+    if (values[2] < 1)
+        throw runtime_error ("Invalid PNM maxval");
+    maxval = values[2];
+    // Read a single WS
+    if (i == size || !isspace (data[i]))
+        throw runtime_error ("Unexpected EOF");
+    ++i;
+    if (size - i < static_cast<size_t> (width) * height * depth)
+        throw runtime_error ("Unexpected EOF");
+    return i;
+}
+
+// The MappedImage implementation
+struct MappedImage::MappedImageImpl
+{
+    unsigned char *data;
+    size_t size;
+    unsigned char *pixels;
+    unsigned width;
+    unsigned height;
+    unsigned depth;
+    unsigned maxval;
+    string comments;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    MappedImageImpl () :
+        data (0),
+        size (0),
+        pixels (0),
+        width (0),
+        height (0),
+        depth (1),
+        maxval (255)
+#ifdef _WIN32
+        , file (INVALID_HANDLE_VALUE),
+        mapping (0)
+#endif
+    {
+    }
+    ~MappedImageImpl ()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile (data);
+        if (mapping)
+            CloseHandle (mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle (file);
+#else
+        if (data)
+            munmap (data, size);
+#endif
+    }
+    // Map the file copy on write
+    void Map (const string &filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA (filename.c_str (), GENERIC_READ, FILE_SHARE_READ,
+            0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE)
+            throw runtime_error ("Could not open file for reading");
+        LARGE_INTEGER s;
+        if (!GetFileSizeEx (file, &s))
+            throw runtime_error ("Could not open file for reading");
+        size = static_cast<size_t> (s.QuadPart);
+        if (size == 0)
+            return;
+        mapping = CreateFileMappingA (file, 0, PAGE_WRITECOPY, 0, 0, 0);
+        if (!mapping)
+            throw runtime_error ("Could not map file");
+        data = static_cast<unsigned char *> (MapViewOfFile (mapping, FILE_MAP_COPY, 0, 0, 0));
+        if (!data)
+            throw runtime_error ("Could not map file");
+#else
+        int fd = open (filename.c_str (), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error ("Could not open file for reading");
+        struct stat s;
+        if (fstat (fd, &s) != 0)
+        {
+            close (fd);
+            throw runtime_error ("Could not open file for reading");
+        }
+        size = static_cast<size_t> (s.st_size);
+        if (size == 0)
+        {
+            close (fd);
+            return;
+        }
+        void *p = mmap (0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        // The mapping keeps the file open
+        close (fd);
+        if (p == MAP_FAILED)
+            throw runtime_error ("Could not map file");
+        data = static_cast<unsigned char *> (p);
+#endif
+    }
+};
+
+MappedImage::MappedImage (const string &filename) :
+    pimpl (new MappedImageImpl)
+{
+    pimpl->Map (filename);
+    size_t offset = ParseHeader (pimpl->data, pimpl->size,
+        pimpl->width, pimpl->height, pimpl->depth, pimpl->maxval, pimpl->comments);
+    pimpl->pixels = pimpl->data + offset;
+}
+
+MappedImage::~MappedImage ()
+{
+}
+
+unsigned MappedImage::GetWidth () const
+{
+    return pimpl->width;
+}
+
+unsigned MappedImage::GetHeight () const
+{
+    return pimpl->height;
+}
+
+unsigned MappedImage::GetPixelDepth () const
+{
+    return pimpl->depth;
+}
+
+unsigned MappedImage::GetSize () const
+{
+    return pimpl->width * pimpl->height * pimpl->depth;
+}
+
+unsigned MappedImage::GetMaxval () const
+{
+    return pimpl->maxval;
+}
+
+string MappedImage::GetComments () const
+{
+    return pimpl->comments;
+}
+
+unsigned char *MappedImage::GetPixelsAddress ()
+{
+    return pimpl->pixels;
+}
+
+const unsigned char *MappedImage::GetPixelsAddress () const
+{
+    return pimpl->pixels;
+}
+
+// The MappedImageWriter implementation
+struct MappedImageWriter::MappedImageWriterImpl
+{
+    unsigned char *data;
+    size_t size;
+    unsigned char *pixels;
+    unsigned width;
+    unsigned height;
+    unsigned depth;
+    unsigned maxval;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    MappedImageWriterImpl () :
+        data (0),
+        size (0),
+        pixels (0),
+        width (0),
+        height (0),
+        depth (1),
+        maxval (255)
+#ifdef _WIN32
+        , file (INVALID_HANDLE_VALUE),
+        mapping (0)
+#endif
+    {
+    }
+    ~MappedImageWriterImpl ()
+    {
+        Unmap ();
+    }
+    // Create the file at 'size' bytes and map it for writing
+    void Map (const string &filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA (filename.c_str (), GENERIC_READ | GENERIC_WRITE, 0,
+            0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE)
+            throw runtime_error ("Could not open file for writing");
+        unsigned long long s = size;
+        mapping = CreateFileMappingA (file, 0, PAGE_READWRITE,
+            static_cast<DWORD> (s >> 32), static_cast<DWORD> (s & 0xFFFFFFFF), 0);
+        if (!mapping)
+            throw runtime_error ("Could not map file");
+        data = static_cast<unsigned char *> (MapViewOfFile (mapping, FILE_MAP_WRITE, 0, 0, 0));
+        if (!data)
+            throw runtime_error ("Could not map file");
+#else
+        int fd = open (filename.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0)
+            throw runtime_error ("Could not open file for writing");
+        // Allocate the blocks now rather than a page at a time as they
+        // are written, which is much faster, and means a full disk is
+        // an error here rather than a signal later
+#ifdef __APPLE__
+        if (ftruncate (fd, static_cast<off_t> (size)) != 0)
+#else
+        if (posix_fallocate (fd, 0, static_cast<off_t> (size)) != 0)
+#endif
+        {
+            close (fd);
+            throw runtime_error ("Could not open file for writing");
+        }
+        void *p = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        // The mapping keeps the file open
+        close (fd);
+        if (p == MAP_FAILED)
+            throw runtime_error ("Could not map file");
+        data = static_cast<unsigned char *> (p);
+#endif
+    }
+    // Return false if the file could not be written
+    bool Unmap ()
+    {
+        bool ok = true;
+#ifdef _WIN32
+        if (data && !UnmapViewOfFile (data))
+            ok = false;
+        if (mapping)
+            CloseHandle (mapping);
+        if (file != INVALID_HANDLE_VALUE && !CloseHandle (file))
+            ok = false;
+        mapping = 0;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data && munmap (data, size) != 0)
+            ok = false;
+#endif
+        data = 0;
+        pixels = 0;
+        return ok;
+    }
+};
+
+MappedImageWriter::MappedImageWriter (const string &filename,
+    unsigned width,
+    unsigned height,
+    unsigned depth,
+    const string &comments,
+    unsigned maxval) :
+    pimpl (new MappedImageWriterImpl)
+{
+    if (depth != 1 && depth != 3)
+        throw runtime_error ("Unknown PNM pixel depth");
+    if (maxval < 1 || maxval > 65535)
+        throw runtime_error ("Invalid PNM maxval");
+    // The same header as operator<<
+    ostringstream s;
+    s << 'P' << (depth == 1 ? '5' : '6') << '\n'
+        << comments << '\n'
+        << width << ' ' << height << '\n'
+        << maxval << '\n';
+    const string header = s.str ();
+    const size_t bytes = maxval > 255 ? 2 : 1;
+    pimpl->width = width;
+    pimpl->height = height;
+    pimpl->depth = depth;
+    pimpl->maxval = maxval;
+    pimpl->size = header.size () + static_cast<size_t> (width) * height * depth * bytes;
+    pimpl->Map (filename);
+    header.copy (reinterpret_cast<char *> (pimpl->data), header.size ());
+    pimpl->pixels = pimpl->data + header.size ();
+}
+
+MappedImageWriter::~MappedImageWriter ()
+{
+}
+
+unsigned MappedImageWriter::GetWidth () const
+{
+    return pimpl->width;
+}
+
+unsigned MappedImageWriter::GetHeight () const
+{
+    return pimpl->height;
+}
+
+unsigned MappedImageWriter::GetPixelDepth () const
+{
+    return pimpl->depth;
+}
+
+unsigned MappedImageWriter::GetSize () const
+{
+    return pimpl->width * pimpl->height * pimpl->depth;
+}
+
+unsigned MappedImageWriter::GetMaxval () const
+{
+    return pimpl->maxval;
+}
+
+unsigned char *MappedImageWriter::GetPixelsAddress ()
+{
+    if (!pimpl->pixels)
+        throw runtime_error ("The file has been closed");
+    return pimpl->pixels;
+}
+
+void MappedImageWriter::Close ()
+{
+    if (!pimpl->data)
+        return;
+    if (!pimpl->Unmap ())
+        throw runtime_error ("Error writing to file");
+}
+
+} // namespace PNM
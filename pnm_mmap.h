@@ -0,0 +1,93 @@
+// Memory mapped PNM files
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef PNM_MMAP_H
+#define PNM_MMAP_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace PNM
+{
+
+// Read a PGM or PPM file through a memory map of it.  Only the header
+// is parsed; the pixels are used where they lie in the file, so they
+// are only paged in as they are used, and are never copied into a
+// buffer.
+//
+// The map is private, so the pixels may be changed without changing
+// the file.  Only the pages that are written to are copied.
+class MappedImage
+{
+    public:
+    // Map the file and parse its header.  Throw if it cannot be mapped
+    // or is not an 8 bit PGM or PPM file.
+    explicit MappedImage (const std::string &filename);
+    ~MappedImage ();
+    unsigned GetWidth () const;
+    unsigned GetHeight () const;
+    unsigned GetPixelDepth () const;
+    unsigned GetSize () const;
+    // The largest sample value, which is at most 255
+    unsigned GetMaxval () const;
+    std::string GetComments () const;
+    // Return the pixels, which stay valid for the life of the image.
+    // The pointer can be passed straight to CODEC::SetSrcImage.
+    unsigned char *GetPixelsAddress ();
+    const unsigned char *GetPixelsAddress () const;
+
+    private:
+    struct MappedImageImpl;
+    std::unique_ptr<MappedImageImpl> pimpl;
+    // Disable copying
+    MappedImage (const MappedImage &);
+    MappedImage &operator= (const MappedImage &);
+};
+
+// Write a PGM or PPM file through a memory map of it.  The file is
+// created at its full size, and the caller fills in the pixels, for
+// example by passing GetPixelsAddress to CODEC::SetDestImage and
+// decoding into it.  The file has the same bytes as one written with
+// operator<< from pnm.h.  With a maxval above 255, each sample takes
+// two bytes, most significant first, which the caller writes.
+class MappedImageWriter
+{
+    public:
+    // Create the file and write its header.  Throw if it cannot be
+    // created or mapped, if 'depth' is not 1 or 3, or if 'maxval' is
+    // not from 1 to 65535.
+    MappedImageWriter (const std::string &filename,
+        unsigned width,
+        unsigned height,
+        unsigned depth,
+        const std::string &comments = std::string (),
+        unsigned maxval = 255);
+    // Close the file, if it has not been closed.  Errors are ignored,
+    // so call Close to see them.
+    ~MappedImageWriter ();
+    unsigned GetWidth () const;
+    unsigned GetHeight () const;
+    unsigned GetPixelDepth () const;
+    unsigned GetSize () const;
+    unsigned GetMaxval () const;
+    // Return the pixels, which are valid until the file is closed.
+    // There are GetSize () samples of one or two bytes.
+    unsigned char *GetPixelsAddress ();
+    // Unmap and close the file.  Throw if it could not be written.
+    void Close ();
+
+    private:
+    struct MappedImageWriterImpl;
+    std::unique_ptr<MappedImageWriterImpl> pimpl;
+    // Disable copying
+    MappedImageWriter (const MappedImageWriter &);
+    MappedImageWriter &operator= (const MappedImageWriter &);
+};
+
+} // namespace PNM
+
+#endif // PNM_MMAP_H
@@ -0,0 +1,341 @@
+// Record foveated sequences to a file and read them back.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "recording.h"
+#include "bitstream.h"
+#include "channel.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace SVIS
+{
+
+static const unsigned char MAGIC[4] = { 'S', 'V', 'S', 'Q' };
+static const unsigned char TRAILER_MAGIC[4] = { 'S', 'V', 'S', 'X' };
+static const unsigned VERSION = 1;
+static const size_t HEADER_SIZE = 8;
+static const size_t ENTRY_SIZE = 24;
+static const size_t TRAILER_SIZE = 16;
+// The most frames that may wait to be written
+static const size_t QUEUED_FRAMES = 16;
+
+static void Put32 (vector<unsigned char> &s, unsigned x)
+{
+    s.push_back (x & 0xFF);
+    s.push_back ((x >> 8) & 0xFF);
+    s.push_back ((x >> 16) & 0xFF);
+    s.push_back ((x >> 24) & 0xFF);
+}
+
+static void Put64 (vector<unsigned char> &s, unsigned long long x)
+{
+    Put32 (s, static_cast<unsigned> (x & 0xFFFFFFFF));
+    Put32 (s, static_cast<unsigned> (x >> 32));
+}
+
+static unsigned Get32 (const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<unsigned> (p[3]) << 24);
+}
+
+static unsigned long long Get64 (const unsigned char *p)
+{
+    return Get32 (p) | (static_cast<unsigned long long> (Get32 (p + 4)) << 32);
+}
+
+// The RecordingWriter implementation
+struct RecordingWriter::RecordingWriterImpl
+{
+    RecordingWriterImpl () :
+        queue (QUEUED_FRAMES)
+    {
+    }
+    FILE *file;
+    // The index is kept by the caller's thread
+    vector<unsigned char> index;
+    unsigned frames;
+    unsigned long long offset;
+    bool closing;
+    // Frames waiting to be written.  The writing thread closes it with
+    // an error if a frame cannot be written.
+    Channel<vector<unsigned char> > queue;
+    thread writer;
+    // Write the queued frames until the recording is closed.  This
+    // runs on its own thread.
+    void Run ()
+    {
+        vector<unsigned char> frame;
+        while (queue.Pop (frame))
+        {
+            // The frames after one that is lost are useless
+            if (fwrite (&frame[0], 1, frame.size (), file) != frame.size ())
+            {
+                queue.Close ("The recording could not be written");
+                return;
+            }
+        }
+    }
+};
+
+RecordingWriter::RecordingWriter (const string &filename) :
+    pimpl (new RecordingWriterImpl)
+{
+    pimpl->file = fopen (filename.c_str (), "wb");
+    if (!pimpl->file)
+        throw runtime_error ("The recording could not be created");
+    pimpl->frames = 0;
+    pimpl->offset = HEADER_SIZE;
+    pimpl->closing = false;
+    vector<unsigned char> header (MAGIC, MAGIC + 4);
+    Put32 (header, VERSION);
+    if (fwrite (&header[0], 1, header.size (), pimpl->file) != header.size ())
+    {
+        fclose (pimpl->file);
+        throw runtime_error ("The recording could not be written");
+    }
+    pimpl->writer = thread (&RecordingWriterImpl::Run, pimpl.get ());
+}
+
+RecordingWriter::~RecordingWriter ()
+{
+    try
+    {
+        Close ();
+    }
+    catch (...)
+    {
+    }
+}
+
+void RecordingWriter::Write (const unsigned char *stream, size_t size)
+{
+    BitstreamHeader h;
+    ReadBitstreamHeader (stream, size, h);
+    if (pimpl->closing)
+        throw runtime_error ("The recording has been closed");
+    // Wait for room in the queue.  Only the writing thread closes it
+    // before Close is called, when it fails.
+    vector<unsigned char> frame (stream, stream + size);
+    if (!pimpl->queue.Push (frame))
+        throw runtime_error (pimpl->queue.Error ());
+
+    vector<unsigned char> &index = pimpl->index;
+    Put64 (index, pimpl->offset);
+    Put32 (index, static_cast<unsigned> (size));
+    Put32 (index, h.fixation_x);
+    Put32 (index, h.fixation_y);
+    Put32 (index, h.inter ? 0 : 1);
+    pimpl->offset += size;
+    ++pimpl->frames;
+}
+
+void RecordingWriter::Close ()
+{
+    if (pimpl->closing)
+        return;
+    pimpl->closing = true;
+    pimpl->queue.Close ();
+    pimpl->writer.join ();
+
+    // The writing thread is done, so the file is ours again
+    vector<unsigned char> &index = pimpl->index;
+    assert (index.size () == pimpl->frames * ENTRY_SIZE);
+    Put64 (index, pimpl->offset);
+    Put32 (index, pimpl->frames);
+    index.insert (index.end (), TRAILER_MAGIC, TRAILER_MAGIC + 4);
+    bool failed = fwrite (&index[0], 1, index.size (), pimpl->file) != index.size ();
+    if (fclose (pimpl->file) != 0)
+        failed = true;
+    pimpl->file = 0;
+    const string error = pimpl->queue.Error ();
+    if (!error.empty ())
+        throw runtime_error (error);
+    if (failed)
+        throw runtime_error ("The recording could not be written");
+}
+
+unsigned RecordingWriter::Frames () const
+{
+    return pimpl->frames;
+}
+
+// The RecordingReader implementation
+struct RecordingReader::RecordingReaderImpl
+{
+    const unsigned char *data;
+    size_t size;
+    const unsigned char *index;
+    unsigned frames;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+    RecordingReaderImpl () :
+        data (0),
+        size (0),
+        index (0),
+        frames (0)
+#ifdef _WIN32
+        , file (INVALID_HANDLE_VALUE),
+        mapping (0)
+#endif
+    {
+    }
+    ~RecordingReaderImpl ()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile (data);
+        if (mapping)
+            CloseHandle (mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle (file);
+#else
+        if (data)
+            munmap (const_cast<unsigned char *> (data), size);
+#endif
+    }
+    void Map (const string &filename)
+    {
+#ifdef _WIN32
+        file = CreateFileA (filename.c_str (), GENERIC_READ, FILE_SHARE_READ,
+            0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE)
+            throw runtime_error ("The recording could not be opened");
+        LARGE_INTEGER s;
+        if (!GetFileSizeEx (file, &s))
+            throw runtime_error ("The recording could not be opened");
+        size = static_cast<size_t> (s.QuadPart);
+        if (size == 0)
+            return;
+        mapping = CreateFileMappingA (file, 0, PAGE_READONLY, 0, 0, 0);
+        if (!mapping)
+            throw runtime_error ("The recording could not be mapped");
+        data = static_cast<const unsigned char *> (MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data)
+            throw runtime_error ("The recording could not be mapped");
+#else
+        int fd = open (filename.c_str (), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error ("The recording could not be opened");
+        struct stat s;
+        if (fstat (fd, &s) != 0)
+        {
+            close (fd);
+            throw runtime_error ("The recording could not be opened");
+        }
+        size = static_cast<size_t> (s.st_size);
+        if (size == 0)
+        {
+            close (fd);
+            return;
+        }
+        void *p = mmap (0, size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping keeps the file open
+        close (fd);
+        if (p == MAP_FAILED)
+            throw runtime_error ("The recording could not be mapped");
+        data = static_cast<const unsigned char *> (p);
+#endif
+    }
+    const unsigned char *Entry (unsigned i) const
+    {
+        if (i >= frames)
+            throw runtime_error ("The frame is not in the recording");
+        return index + i * ENTRY_SIZE;
+    }
+};
+
+RecordingReader::RecordingReader (const string &filename) :
+    pimpl (new RecordingReaderImpl)
+{
+    pimpl->Map (filename);
+    const unsigned char *data = pimpl->data;
+    const size_t size = pimpl->size;
+    if (size < HEADER_SIZE + TRAILER_SIZE ||
+        memcmp (data, MAGIC, 4) != 0 ||
+        memcmp (data + size - 4, TRAILER_MAGIC, 4) != 0)
+        throw runtime_error ("The file is not a closed recording");
+    if (Get32 (data + 4) != VERSION)
+        throw runtime_error ("The recording version is not supported");
+
+    // Check the index so that frames can be fetched without checks
+    const unsigned char *trailer = data + size - TRAILER_SIZE;
+    unsigned long long index_offset = Get64 (trailer);
+    unsigned long long frames = Get32 (trailer + 8);
+    if (index_offset < HEADER_SIZE ||
+        index_offset > size - TRAILER_SIZE ||
+        (size - TRAILER_SIZE - index_offset) != frames * ENTRY_SIZE)
+        throw runtime_error ("The recording index is not valid");
+    pimpl->index = data + index_offset;
+    pimpl->frames = static_cast<unsigned> (frames);
+    for (unsigned i = 0; i < pimpl->frames; ++i)
+    {
+        const unsigned char *e = pimpl->Entry (i);
+        unsigned long long offset = Get64 (e);
+        unsigned long long frame_size = Get32 (e + 8);
+        if (offset < HEADER_SIZE ||
+            offset > index_offset ||
+            frame_size > index_offset - offset)
+            throw runtime_error ("The recording index is not valid");
+    }
+}
+
+RecordingReader::~RecordingReader ()
+{
+}
+
+unsigned RecordingReader::Frames () const
+{
+    return pimpl->frames;
+}
+
+const unsigned char *RecordingReader::GetFrame (unsigned i) const
+{
+    return pimpl->data + Get64 (pimpl->Entry (i));
+}
+
+size_t RecordingReader::GetFrameSize (unsigned i) const
+{
+    return Get32 (pimpl->Entry (i) + 8);
+}
+
+void RecordingReader::GetFixation (unsigned i, int &x, int &y) const
+{
+    const unsigned char *e = pimpl->Entry (i);
+    x = static_cast<int> (Get32 (e + 12));
+    y = static_cast<int> (Get32 (e + 16));
+}
+
+bool RecordingReader::IsKeyframe (unsigned i) const
+{
+    return Get32 (pimpl->Entry (i) + 20) != 0;
+}
+
+unsigned RecordingReader::GetKeyframe (unsigned i) const
+{
+    for (unsigned k = i + 1; k-- > 0; )
+        if (IsKeyframe (k))
+            return k;
+    throw runtime_error ("The frame has no keyframe before it");
+}
+
+} // namespace SVIS
@@ -0,0 +1,113 @@
+// Record foveated sequences to a file and read them back.
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SVIS
+{
+
+// A recording holds one bitstream (see bitstream.h) for each frame of
+// a sequence, and an index that locates the frames, so that any frame
+// can be found without reading the ones before it.  The fixation point
+// of a frame is in its bitstream header, and is copied into the index
+// so that a gaze trace can be read without touching the frames.
+//
+// All integers are little endian.
+//
+//     Header
+//         4 bytes     "SVSQ"
+//         4 bytes     version, 1
+//     Then the bitstream of each frame, in order
+//     Then for each frame, the index
+//         8 bytes     offset of the bitstream from the start of the file
+//         4 bytes     size of the bitstream
+//         4 bytes     fixation x, signed
+//         4 bytes     fixation y, signed
+//         4 bytes     1 if the bitstream is a keyframe, otherwise 0
+//     Trailer
+//         8 bytes     offset of the index from the start of the file
+//         4 bytes     number of frames
+//         4 bytes     "SVSX"
+//
+// A recording that was not closed has no index or trailer, and cannot
+// be read.
+
+// Write a recording.  The frames are written to the file by a thread
+// of the writer's own, so adding one does not wait for the disk.
+class RecordingWriter
+{
+    public:
+    // Create the file.  Throw if it cannot be created.
+    explicit RecordingWriter (const std::string &filename);
+    // Close the recording, if it has not been closed.  Errors are
+    // ignored, so call Close to see them.
+    ~RecordingWriter ();
+    // Queue a bitstream to be written as the next frame, and return
+    // without waiting for it to be written.  A few frames may wait;
+    // beyond that, wait for the oldest to be written.  Throw if it is
+    // not a bitstream, if the recording has been closed, or if an
+    // earlier frame could not be written, after which nothing more
+    // is written.
+    void Write (const unsigned char *stream, size_t size);
+    void Write (const std::vector<unsigned char> &stream)
+    {
+        Write (stream.empty () ? 0 : &stream[0], stream.size ());
+    }
+    // Wait for the queued frames, then write the index and close the
+    // file.  Throw if anything could not be written.
+    void Close ();
+    // The number of frames that have been queued
+    unsigned Frames () const;
+
+    private:
+    struct RecordingWriterImpl;
+    std::unique_ptr<RecordingWriterImpl> pimpl;
+    // Disable copying
+    RecordingWriter (const RecordingWriter &);
+    RecordingWriter &operator= (const RecordingWriter &);
+};
+
+// Read a recording through a read only memory map of its file, so the
+// frames are only paged in when they are used.
+class RecordingReader
+{
+    public:
+    // Map the file.  Throw if it cannot be mapped or is not a closed
+    // recording.
+    explicit RecordingReader (const std::string &filename);
+    ~RecordingReader ();
+    unsigned Frames () const;
+    // Return the bitstream of frame 'i', which stays valid for the
+    // life of the reader.  Pass it to ReadBitstream or
+    // CODEC::DecodeBitstream to decode the frame.
+    const unsigned char *GetFrame (unsigned i) const;
+    size_t GetFrameSize (unsigned i) const;
+    // Get the fixation point of frame 'i' from the index
+    void GetFixation (unsigned i, int &x, int &y) const;
+    // Return true if frame 'i' is a keyframe.  An inter frame is
+    // decoded by decoding the frames from the keyframe before it.
+    bool IsKeyframe (unsigned i) const;
+    // Return the last keyframe at or before frame 'i'.  Throw if
+    // there is none.
+    unsigned GetKeyframe (unsigned i) const;
+
+    private:
+    struct RecordingReaderImpl;
+    std::unique_ptr<RecordingReaderImpl> pimpl;
+    // Disable copying
+    RecordingReader (const RecordingReader &);
+    RecordingReader &operator= (const RecordingReader &);
+};
+
+} // namespace SVIS
+
+#endif // RECORDING_H
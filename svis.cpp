@@ -6,64 +6,479 @@
 //
 // jsp Mon Aug 21 18:55:48 CDT 2006
 
+#include "bitstream.h"
 #include "image.h"
 #include "foveate.h"
+#include "interleave.h"
 #include "mask.h"
 #include "svis.h"
 
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <list>
+#include <map>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <stdexcept>
+#include <thread>
 
 using namespace std;
 
 namespace SVIS
 {
 
+// A decode that was started before the fixation point was known
+struct Speculation
+{
+    int x;
+    int y;
+    bool valid;
+    vector<vector<Region> > regions;
+    vector<vector<BlendSpan> > spans;
+    AutoImage base;
+    FoveationPyramid dest;
+};
+
+// Decode a speculation from a reduced pyramid.  This runs on its own
+// thread, so exceptions must not escape.
+static void SpeculativeDecode (const FoveationPyramid *src,
+    const FoveationMasks *masks,
+    Speculation *s)
+{
+    try
+    {
+        FoveationEncode (*src, *masks, s->x, s->y, s->regions, s->spans);
+        FoveationDecode (*src, s->spans, s->x, s->y, *masks, s->dest);
+        s->valid = true;
+    }
+    catch (...)
+    {
+        s->valid = false;
+    }
+}
+
+// A fixed set of threads that decode speculations, one per processor.
+// They are started by the first call to Start and wait for more work
+// until they are destroyed.
+class SpeculationThreads
+{
+    public:
+    SpeculationThreads () :
+        src (0),
+        masks (0),
+        next (0),
+        running (0),
+        stop (false)
+    {
+    }
+    ~SpeculationThreads ()
+    {
+        {
+            lock_guard<mutex> l (lock);
+            stop = true;
+        }
+        changed.notify_all ();
+        for (unsigned i = 0; i < threads.size (); ++i)
+            threads[i].join ();
+    }
+    // Decode the first 'n' speculations
+    void Start (const FoveationPyramid *src,
+        const FoveationMasks *masks,
+        const vector<Speculation *> &speculations,
+        unsigned n)
+    {
+        Wait ();
+        if (threads.empty ())
+        {
+            unsigned total = thread::hardware_concurrency ();
+            for (unsigned i = 0; i < (total ? total : 1); ++i)
+                threads.push_back (thread (&SpeculationThreads::Run, this));
+        }
+        lock_guard<mutex> l (lock);
+        this->src = src;
+        this->masks = masks;
+        jobs.assign (speculations.begin (), speculations.begin () + n);
+        next = 0;
+        changed.notify_all ();
+    }
+    // Wait for the decodes to finish
+    void Wait ()
+    {
+        unique_lock<mutex> l (lock);
+        while (next < jobs.size () || running)
+            changed.wait (l);
+    }
+
+    private:
+    void Run ()
+    {
+        unique_lock<mutex> l (lock);
+        for (;;)
+        {
+            while (next == jobs.size () && !stop)
+                changed.wait (l);
+            if (next == jobs.size ())
+                return;
+            Speculation *s = jobs[next++];
+            const FoveationPyramid *p = src;
+            const FoveationMasks *m = masks;
+            ++running;
+            l.unlock ();
+            SpeculativeDecode (p, m, s);
+            l.lock ();
+            --running;
+            changed.notify_all ();
+        }
+    }
+    const FoveationPyramid *src;
+    const FoveationMasks *masks;
+    vector<Speculation *> jobs;
+    // The next job to start, and how many are being decoded
+    size_t next;
+    unsigned running;
+    bool stop;
+    vector<thread> threads;
+    mutex lock;
+    condition_variable changed;
+    // Disable copying
+    SpeculationThreads (const SpeculationThreads &);
+    SpeculationThreads &operator= (const SpeculationThreads &);
+};
+
+// An encoded fixation that may be reused
+struct EncodeCacheEntry
+{
+    int x;
+    int y;
+    vector<vector<Region> > regions;
+    vector<vector<BlendSpan> > spans;
+};
+
+// A least recently used cache of encoded fixations
+class EncodeCache
+{
+    public:
+    EncodeCache () :
+        size (0),
+        quantum (1),
+        hits (0),
+        misses (0)
+    {
+    }
+    void Resize (unsigned entries, unsigned q)
+    {
+        if (q < 1)
+            throw runtime_error ("The cache quantum must be at least 1");
+        Clear ();
+        size = entries;
+        quantum = q;
+        hits = 0;
+        misses = 0;
+    }
+    void Clear ()
+    {
+        entries.clear ();
+        index.clear ();
+    }
+    bool Enabled () const { return size > 0; }
+    unsigned Hits () const { return hits; }
+    unsigned Misses () const { return misses; }
+    // Round a coordinate to the nearest multiple of the quantum
+    int Quantize (int x) const
+    {
+        const int q = quantum;
+        int r = x % q;
+        if (r < 0)
+            r += q;
+        x -= r;
+        if (2 * r >= q)
+            x += q;
+        return x;
+    }
+    // Find an entry and make it the most recently used one
+    const EncodeCacheEntry *Find (int x, int y)
+    {
+        map<pair<int, int>, list<EncodeCacheEntry>::iterator>::iterator i =
+            index.find (make_pair (x, y));
+        if (i == index.end ())
+        {
+            ++misses;
+            return 0;
+        }
+        ++hits;
+        entries.splice (entries.begin (), entries, i->second);
+        return &entries.front ();
+    }
+    // Add an entry, evicting the least recently used one if the cache
+    // is full
+    void Insert (int x, int y,
+        const vector<vector<Region> > &regions,
+        const vector<vector<BlendSpan> > &spans)
+    {
+        assert (Enabled ());
+        assert (index.find (make_pair (x, y)) == index.end ());
+        if (entries.size () < size)
+        {
+            entries.push_front (EncodeCacheEntry ());
+        }
+        else
+        {
+            // Reuse the storage of the evicted entry
+            index.erase (make_pair (entries.back ().x, entries.back ().y));
+            entries.splice (entries.begin (), entries, --entries.end ());
+        }
+        EncodeCacheEntry &e = entries.front ();
+        e.x = x;
+        e.y = y;
+        e.regions = regions;
+        e.spans = spans;
+        index[make_pair (x, y)] = entries.begin ();
+    }
+
+    private:
+    unsigned size;
+    unsigned quantum;
+    unsigned hits;
+    unsigned misses;
+    list<EncodeCacheEntry> entries;
+    map<pair<int, int>, list<EncodeCacheEntry>::iterator> index;
+};
+
+// A resolution map and the masks created from it.  These are never
+// changed once created, so codecs may share them.
+struct Resmap
+{
+    AutoImage image;
+    FoveationMasks masks;
+    // The masks of the chroma planes of a YUVCODEC, which are those
+    // above the first
+    FoveationMasks chroma;
+};
+
+// Create a resolution map and its masks for a pyramid of 'levels'
+static shared_ptr<Resmap> NewResmap (unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels,
+    unsigned levels)
+{
+    shared_ptr<Resmap> r (new Resmap);
+    r->image.width = width;
+    r->image.height = height;
+    r->image.pixels = pixels;
+    r->image.scale = 0;
+
+    // Create the masks from the resmap
+    //
+    // The top level of the pyramid is not blended, so for N levels,
+    // you need N-1 masks.
+    r->masks.Create (r->image, levels - 1);
+    r->chroma.Share (r->masks, 1);
+    return r;
+}
+
+// Return true if a resolution map is 'pixels'
+static bool SameResmap (const shared_ptr<const Resmap> &resmap,
+    unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels)
+{
+    if (!resmap)
+        return false;
+    const AutoImage &r = resmap->image;
+    return r.width == width && r.height == height && r.pixels == pixels;
+}
+
 // The CODEC implementation
 struct CODEC::CODECImpl
 {
-    AutoImage resmap;
-    FoveationMasks masks;
+    shared_ptr<const Resmap> resmap;
     FoveationPyramid src_pyramid;
     FoveationPyramid dest_pyramid;
+    // Bitstreams are read into their own pyramid
+    AutoImage received_base;
+    FoveationPyramid received;
+    // False until the received pyramid holds a whole stream, which
+    // inter frames may be read on top of
+    bool received_valid;
+    // The pixels that the receiver of inter frame bitstreams holds
+    bool inter;
+    unsigned inter_threshold;
+    bool keyframe;
+    AutoImage reference_base;
+    FoveationPyramid reference;
+    // The Laplacian residuals of the source that are sent instead of
+    // its pixels
+    bool residual;
+    AutoImage residual_base;
+    FoveationPyramid residual_pyramid;
+    bool progressive;
+    // Speculative decodes.  Only the first 'total_speculations' are in
+    // use.
+    vector<Speculation *> speculations;
+    unsigned total_speculations;
+    SpeculationThreads threads;
+    EncodeCache cache;
+    // The source generation changes whenever the source or the masks
+    // change.  It is used, along with the fixation point, to skip
+    // encoding and decoding when they would not change the output.
+    unsigned long generation;
+    bool skip_unchanged;
+    bool encoded;
+    bool decoded;
+    unsigned long decoded_generation;
+    int decoded_x;
+    int decoded_y;
+    const unsigned char *decoded_dest;
+    unsigned decoded_pitch;
+    // A column major image is processed as its transpose, which is
+    // the same buffer in row major order
+    bool transposed;
+    CODECImpl () :
+        received_valid (false),
+        inter (false),
+        inter_threshold (0),
+        keyframe (true),
+        residual (false),
+        progressive (false),
+        total_speculations (0),
+        generation (0),
+        skip_unchanged (false),
+        encoded (false),
+        decoded (false),
+        transposed (false)
+    {
+    }
+    // Convert between image and buffer coordinates or dimensions
+    template<typename T>
+    void Transpose (T &x, T &y) const
+    {
+        if (transposed)
+            swap (x, y);
+    }
+    // Return a view of an image in image coordinates
+    ImageView View (const Image &i) const
+    {
+        ImageView v = { i.pixels, i.width >> i.scale, i.height >> i.scale, Pitch (i) };
+        Transpose (v.width, v.height);
+        return v;
+    }
+    ~CODECImpl ()
+    {
+        Join ();
+        for (unsigned i = 0; i < speculations.size (); ++i)
+            delete speculations[i];
+    }
+    // Wait for speculative decodes to finish
+    void Join ()
+    {
+        threads.Wait ();
+    }
+    // A codec that only decodes bitstreams has no source image
+    void CheckSrc () const
+    {
+        assert (src_pyramid.images.size () > 0);
+        if (!src_pyramid.images[0].pixels)
+            throw runtime_error ("The source image has not been set");
+    }
+    // The source has changed
+    void Changed ()
+    {
+        // Speculations read from the pyramid
+        Join ();
+        total_speculations = 0;
+        ++generation;
+    }
+    // Is the dest pyramid already decoded from the current source at
+    // the current fixation?
+    bool Decoded () const
+    {
+        return decoded &&
+            decoded_generation == generation &&
+            decoded_x == src_pyramid.fixation_x &&
+            decoded_y == src_pyramid.fixation_y &&
+            decoded_dest == dest_pyramid.images[0].pixels &&
+            decoded_pitch == dest_pyramid.images[0].pitch;
+    }
+    // Remember what is in the dest pyramid
+    void SetDecoded ()
+    {
+        decoded = true;
+        decoded_generation = generation;
+        decoded_x = src_pyramid.fixation_x;
+        decoded_y = src_pyramid.fixation_y;
+        decoded_dest = dest_pyramid.images[0].pixels;
+        decoded_pitch = dest_pyramid.images[0].pitch;
+    }
 };
 
 CODEC::CODEC (unsigned width,
     unsigned height,
     unsigned char *src,
     unsigned char *dest,
-    unsigned pyramid_levels) :
+    unsigned pyramid_levels,
+    MemoryOrder order) :
     pyramid_levels (pyramid_levels),
     pimpl (new CODECImpl)
 {
-    if (!src)
-        throw runtime_error ("The src image pointer is not valid");
     if (!dest)
         throw runtime_error ("The dest image pointer is not valid");
 
+    pimpl->transposed = (order == COLUMN_MAJOR);
+    pimpl->Transpose (width, height);
+
     // Setup src_image and dest_image to point to the allocated bitmaps.
-    Image src_image = { width, height, 0, src };
+    // Without a source, the pyramid is created on the destination and
+    // then left without a base.
+    Image src_image = { width, height, 0, src ? src : dest };
     Image dest_image = { width, height, 0, dest };
 
     // Create the pyramids.
     pimpl->src_pyramid.Create (src_image, pyramid_levels);
     pimpl->dest_pyramid.Create (dest_image, pyramid_levels);
+    pimpl->src_pyramid.images[0].pixels = src;
 }
 
 CODEC::~CODEC ()
 {
 }
 
+void CODEC::Reset (unsigned char *src, unsigned char *dest)
+{
+    if (!dest)
+        throw runtime_error ("The dest image pointer is not valid");
+    pimpl->Changed ();
+    pimpl->resmap.reset ();
+    pimpl->cache.Resize (0, 1);
+    pimpl->received_valid = false;
+    pimpl->inter = false;
+    pimpl->inter_threshold = 0;
+    pimpl->keyframe = true;
+    pimpl->residual = false;
+    pimpl->progressive = false;
+    pimpl->skip_unchanged = false;
+    pimpl->encoded = false;
+    pimpl->decoded = false;
+    SetSrcImage (src);
+    SetDestImage (dest);
+}
+
 unsigned CODEC::GetImageSize () const
 {
     return GetWidth () * GetHeight ();
 }
 
+MemoryOrder CODEC::GetMemoryOrder () const
+{
+    return pimpl->transposed ? COLUMN_MAJOR : ROW_MAJOR;
+}
+
 unsigned CODEC::GetWidth () const
 {
+    if (pimpl->transposed)
+        return pimpl->src_pyramid.images[0].height;
     assert (pimpl->src_pyramid.images.size () > 0);
     assert (pimpl->dest_pyramid.images.size () > 0);
     // src and dest should be equal
@@ -74,6 +489,8 @@ unsigned CODEC::GetWidth () const
 
 unsigned CODEC::GetHeight () const
 {
+    if (pimpl->transposed)
+        return pimpl->src_pyramid.images[0].width;
     assert (pimpl->src_pyramid.images.size () > 0);
     assert (pimpl->dest_pyramid.images.size () > 0);
     // src and dest should be equal
@@ -82,16 +499,29 @@ unsigned CODEC::GetHeight () const
     return pimpl->src_pyramid.images[0].height;
 }
 
-void CODEC::SetSrcImage (unsigned char *p)
+// Make sure that a pitch leaves room for a row of an image
+template<typename T>
+static void CheckPitch (const ImageT<T> &i, unsigned pitch)
+{
+    if (pitch && pitch < (i.width >> i.scale))
+        throw runtime_error ("The pitch is smaller than the image");
+}
+
+void CODEC::SetSrcImage (unsigned char *p, unsigned pitch)
 {
     assert (pimpl->src_pyramid.images.size () > 0);
+    CheckPitch (pimpl->src_pyramid.images[0], pitch);
+    pimpl->Changed ();
     pimpl->src_pyramid.images[0].pixels = p;
+    pimpl->src_pyramid.images[0].pitch = pitch;
 }
 
-void CODEC::SetDestImage (unsigned char *p)
+void CODEC::SetDestImage (unsigned char *p, unsigned pitch)
 {
     assert (pimpl->dest_pyramid.images.size () > 0);
+    CheckPitch (pimpl->dest_pyramid.images[0], pitch);
     pimpl->dest_pyramid.images[0].pixels = p;
+    pimpl->dest_pyramid.images[0].pitch = pitch;
 }
 
 void CODEC::SetResmap (unsigned width,
@@ -101,17 +531,43 @@ void CODEC::SetResmap (unsigned width,
     if (pixels.size () != width * height)
         throw runtime_error ("Incorrect pixel vector size");
 
-    // Copy the resolution map
-    pimpl->resmap.width = width;
-    pimpl->resmap.height = height;
-    pimpl->resmap.pixels = pixels;
-    pimpl->resmap.scale = 0;
+    // Creating the masks is expensive
+    if (HasResmap (width, height, pixels))
+        return;
 
-    // Create the masks from the resmap
-    //
-    // The top level of the pyramid is not blended, so for N levels,
-    // you need N-1 masks.
-    pimpl->masks.Create (pimpl->resmap, pyramid_levels - 1);
+    // Speculations and cached encodings were made with the old masks
+    pimpl->Changed ();
+    pimpl->cache.Clear ();
+    pimpl->encoded = false;
+
+    pimpl->Transpose (width, height);
+
+    // Copy the resolution map.  Other codecs may be sharing the old
+    // one, so always make a new one.
+    pimpl->resmap = NewResmap (width, height, pixels, pyramid_levels);
+}
+
+bool CODEC::HasResmap (unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels) const
+{
+    pimpl->Transpose (width, height);
+    return SameResmap (pimpl->resmap, width, height, pixels);
+}
+
+void CODEC::ShareResmap (const CODEC &c) const
+{
+    if (!c.pimpl->resmap)
+        throw runtime_error ("The resolution map has not been set");
+    if (c.pyramid_levels != pyramid_levels)
+        throw runtime_error ("The codecs have different pyramid levels");
+    if (c.pimpl->transposed != pimpl->transposed)
+        throw runtime_error ("The codecs have different memory orders");
+
+    pimpl->Changed ();
+    pimpl->cache.Clear ();
+    pimpl->encoded = false;
+    pimpl->resmap = c.pimpl->resmap;
 }
 
 void CODEC::GetMask (unsigned level,
@@ -119,18 +575,31 @@ void CODEC::GetMask (unsigned level,
     unsigned &height,
     vector<unsigned char> &pixels) const
 {
-    if (level >= pimpl->masks.levels)
+    if (!pimpl->resmap || level >= pimpl->resmap->masks.levels)
+        throw runtime_error ("Incorrect level parameter");
+    const Image &m = pimpl->resmap->masks.masks[level];
+    width = m.width;
+    height = m.height;
+    // The mask scale is always 0
+    assert (m.scale == 0);
+    pixels.resize (width * height);
+    Image packed = { m.width, m.height, m.scale, pixels.empty () ? 0 : &pixels[0] };
+    if (!pixels.empty ())
+        Copy (&m, &packed);
+    pimpl->Transpose (width, height);
+}
+
+ImageView CODEC::GetMaskView (unsigned level) const
+{
+    if (!pimpl->resmap || level >= pimpl->resmap->masks.levels)
         throw runtime_error ("Incorrect level parameter");
-    width = pimpl->masks.masks[level].width;
-    height = pimpl->masks.masks[level].height;
-    pixels = pimpl->masks.masks[level].pixels;
+    return pimpl->View (pimpl->resmap->masks.masks[level]);
 }
 
 void CODEC::Reduce ()
 {
-    assert (pimpl->src_pyramid.images.size () > 0);
-    if (!pimpl->src_pyramid.images[0].pixels)
-        throw runtime_error ("The source image has not been set");
+    pimpl->CheckSrc ();
+    pimpl->Changed ();
     pimpl->src_pyramid.Reduce ();
 }
 
@@ -141,24 +610,80 @@ void CODEC::GetReducedImage (unsigned level,
 {
     if (level >= pimpl->src_pyramid.levels)
         throw runtime_error ("Incorrect level parameter");
+    pimpl->CheckSrc ();
     // Scale the images down accordingly
-    width = (pimpl->src_pyramid.images[level].width
-        >> pimpl->src_pyramid.images[level].scale);
-    height = (pimpl->src_pyramid.images[level].height
-        >> pimpl->src_pyramid.images[level].scale);
+    const Image &i = pimpl->src_pyramid.images[level];
+    width = (i.width >> i.scale);
+    height = (i.height >> i.scale);
     // Now copy the pixels
     pixels.resize (width * height);
-    pixels.assign (&pimpl->src_pyramid.images[level].pixels[0],
-        &pimpl->src_pyramid.images[level].pixels[width * height]);
+    Image packed = { i.width, i.height, i.scale, &pixels[0] };
+    Copy (&i, &packed);
+    pimpl->Transpose (width, height);
+}
+
+ImageView CODEC::GetReducedView (unsigned level) const
+{
+    if (level >= pimpl->src_pyramid.levels)
+        throw runtime_error ("Incorrect level parameter");
+    return pimpl->View (pimpl->src_pyramid.images[level]);
 }
 
 void CODEC::Encode (int x, int y)
 {
-    if (pimpl->resmap.pixels.empty ())
+    if (!pimpl->resmap)
         throw runtime_error ("A resolution map has not been set");
-    FoveationEncode (pimpl->src_pyramid,
-        pimpl->masks,
-        x, y);
+    pimpl->CheckSrc ();
+
+    pimpl->Transpose (x, y);
+    if (pimpl->cache.Enabled ())
+    {
+        x = pimpl->cache.Quantize (x);
+        y = pimpl->cache.Quantize (y);
+    }
+
+    // The regions only depend on the masks and the fixation point
+    FoveationPyramid &p = pimpl->src_pyramid;
+    if (pimpl->skip_unchanged && pimpl->encoded && p.fixation_x == x && p.fixation_y == y)
+        return;
+    pimpl->encoded = false;
+
+    if (!pimpl->cache.Enabled ())
+    {
+        FoveationEncode (p, pimpl->resmap->masks, x, y);
+        pimpl->encoded = true;
+        return;
+    }
+
+    const EncodeCacheEntry *e = pimpl->cache.Find (x, y);
+    if (e)
+    {
+        p.regions = e->regions;
+        p.spans = e->spans;
+        p.fixation_x = x;
+        p.fixation_y = y;
+    }
+    else
+    {
+        FoveationEncode (p, pimpl->resmap->masks, x, y);
+        pimpl->cache.Insert (x, y, p.regions, p.spans);
+    }
+    pimpl->encoded = true;
+}
+
+void CODEC::SetEncodeCache (unsigned entries, unsigned quantum)
+{
+    pimpl->cache.Resize (entries, quantum);
+}
+
+unsigned CODEC::GetEncodeCacheHits () const
+{
+    return pimpl->cache.Hits ();
+}
+
+unsigned CODEC::GetEncodeCacheMisses () const
+{
+    return pimpl->cache.Misses ();
 }
 
 void CODEC::GetEncodedImageBlocks (unsigned level,
@@ -168,31 +693,162 @@ void CODEC::GetEncodedImageBlocks (unsigned level,
     vector<unsigned> &height,
     vector<vector<unsigned char> > &pixels) const
 {
-    assert (pimpl->src_pyramid.regions.size () == pimpl->src_pyramid.levels);
-    if (level >= pimpl->src_pyramid.levels)
-        throw runtime_error ("Incorrect level parameter");
+    BlockIterator i = GetEncodedBlocks (level);
     // Start out empty
     x.clear ();
     y.clear ();
     width.clear ();
     height.clear ();
     pixels.clear ();
+    ImageBlock b;
+    while (i.Next (b))
+    {
+        // Get the block's dimensions in the buffer
+        unsigned bw = b.view.width;
+        unsigned bh = b.view.height;
+        pimpl->Transpose (bw, bh);
+        // Copy the pixels row by row
+        pixels.push_back (vector<unsigned char> (bw * bh));
+        vector<unsigned char> &tp = pixels.back ();
+        for (unsigned j = 0; j < bh; ++j)
+            copy (&b.view.pixels[j * b.view.pitch],
+                &b.view.pixels[j * b.view.pitch + bw],
+                &tp[j * bw]);
+        // Save all the params in the given vectors
+        x.push_back (b.x);
+        y.push_back (b.y);
+        width.push_back (b.view.width);
+        height.push_back (b.view.height);
+    }
+}
+
+// Create a pyramid with its own base image, with the same dimensions
+// as 'like', the first time it is needed
+static void CreatePyramid (const FoveationPyramid &like, AutoImage &base, FoveationPyramid &p)
+{
+    if (!base.pixels.empty ())
+        return;
+    const Image &src = like.images[0];
+    base.width = src.width;
+    base.height = src.height;
+    base.scale = src.scale;
+    base.pixels.resize ((src.width >> src.scale) * (src.height >> src.scale));
+    Image i = { base.width, base.height, base.scale, &base.pixels[0] };
+    p.Create (i, like.levels);
+}
+
+void CODEC::GetBitstream (vector<unsigned char> &stream, bool compress)
+{
+    pimpl->CheckSrc ();
+    stream.clear ();
+    BitstreamCoding coding = compress ? BITSTREAM_RANS : BITSTREAM_RAW;
+    if (pimpl->progressive)
+    {
+        if (pimpl->inter || pimpl->residual)
+            throw runtime_error ("Progressive bitstreams cannot be inter frames or residuals");
+        WriteProgressiveBitstream (pimpl->src_pyramid, pimpl->transposed, stream, coding);
+        return;
+    }
+    const FoveationPyramid *p = &pimpl->src_pyramid;
+    if (pimpl->residual)
+    {
+        if (!pimpl->resmap)
+            throw runtime_error ("A resolution map has not been set");
+        CreatePyramid (pimpl->src_pyramid, pimpl->residual_base, pimpl->residual_pyramid);
+        FoveationResidual (pimpl->src_pyramid, pimpl->resmap->masks,
+            pimpl->dest_pyramid, pimpl->residual_pyramid);
+        pimpl->SetDecoded ();
+        p = &pimpl->residual_pyramid;
+    }
+    if (!pimpl->inter)
+    {
+        WriteBitstream (*p, pimpl->transposed, stream, coding);
+        return;
+    }
+    CreatePyramid (pimpl->src_pyramid, pimpl->reference_base, pimpl->reference);
+    WriteBitstream (*p, pimpl->transposed, stream, coding,
+        pimpl->reference, pimpl->keyframe, pimpl->inter_threshold);
+    pimpl->keyframe = false;
+}
+
+void CODEC::DecodeBitstream (const unsigned char *stream, size_t size)
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    BitstreamHeader h;
+    ReadBitstreamHeader (stream, size, h);
+    if (h.column_major != pimpl->transposed)
+        throw runtime_error ("The bitstream memory order does not match the codec");
+    if (h.inter && !pimpl->received_valid)
+        throw runtime_error ("An inter frame bitstream must follow a keyframe");
+
+    // Recover the regions and spans from the masks, then decode
+    CreatePyramid (pimpl->src_pyramid, pimpl->received_base, pimpl->received);
+    FoveationPyramid &p = pimpl->received;
+    pimpl->received_valid = false;
+    ReadBitstream (stream, size, p);
+    if (h.progressive)
+    {
+        // Only the blocks that arrived are blended.  The stream may
+        // not be whole, so inter frames cannot follow it.
+        FoveationCompile (p, pimpl->resmap->masks);
+    }
+    else
+    {
+        pimpl->received_valid = true;
+        FoveationEncode (p, pimpl->resmap->masks, p.fixation_x, p.fixation_y);
+    }
+    FoveationDecode (p, pimpl->resmap->masks, pimpl->dest_pyramid);
+    // The destination no longer holds the decoded source image
+    pimpl->decoded = false;
+}
+
+void CODEC::SetInterFrame (bool enabled, unsigned threshold)
+{
+    pimpl->inter = enabled;
+    pimpl->inter_threshold = threshold;
+    pimpl->keyframe = true;
+}
+
+void CODEC::SetResidualCoding (bool enabled)
+{
+    pimpl->residual = enabled;
+    // The reference holds the other kind of values
+    pimpl->keyframe = true;
+}
+
+void CODEC::SetProgressiveCoding (bool enabled)
+{
+    pimpl->progressive = enabled;
+}
+
+CODEC::BlockIterator CODEC::GetEncodedBlocks (unsigned level) const
+{
+    assert (pimpl->src_pyramid.regions.size () == pimpl->src_pyramid.levels);
+    if (level >= pimpl->src_pyramid.levels)
+        throw runtime_error ("Incorrect level parameter");
+    pimpl->CheckSrc ();
+    return BlockIterator (this, level);
+}
+
+CODEC::BlockIterator::BlockIterator (const CODEC *codec, unsigned level) :
+    codec (codec),
+    level (level),
+    index (0)
+{
+}
+
+bool CODEC::BlockIterator::Next (ImageBlock &b)
+{
+    const CODECImpl *pimpl = codec->pimpl.get ();
     // Get params for this pyramid image
-    unsigned iwidth = pimpl->src_pyramid.images[level].width >> level;
-#ifndef NDEBUG
-    unsigned iheight = pimpl->src_pyramid.images[level].height >> level;
-    unsigned iscale = pimpl->src_pyramid.images[level].scale;
-#endif
-    unsigned char *ipixels = pimpl->src_pyramid.images[level].pixels;
-    vector<Region> &iregions = pimpl->src_pyramid.regions[level];
+    const Image &i = pimpl->src_pyramid.images[level];
+    const vector<Region> &iregions = pimpl->src_pyramid.regions[level];
     // The scale should be redundant
-    assert (iscale == level);
-    // Create a temp vector for holding pixels
-    vector<unsigned char> tp;
-    // Copy the regions
-    for (unsigned i = 0; i < iregions.size (); ++i)
+    assert (i.scale == level);
+    while (index < iregions.size ())
     {
-        Region r = iregions[i];
+        Region r = iregions[index++];
         assert (r.x1 <= r.x2);
         assert (r.y1 <= r.y2);
         // Convert to pyramid level's scale
@@ -204,41 +860,84 @@ void CODEC::GetEncodedImageBlocks (unsigned level,
             continue;
         unsigned tx = (r.x1 >> level);
         unsigned ty = (r.y1 >> level);
-        // Size the pixels
-        tp.resize (tw * th);
-        // Copy the pixels row by row
-        for (unsigned j = 0; j < th; ++j)
-        {
-            unsigned src_begin = (ty + j) * iwidth + tx;
-            unsigned src_end = (ty + j) * iwidth + tx + tw;
-            unsigned dest_begin = j * tw;
-            // Make sure end() is in bounds
-            assert (src_end <= iwidth * iheight);
-            assert (dest_begin + tw <= tp.size ());
-            // Do the copy
-            copy (&ipixels[src_begin],
-                &ipixels[src_end],
-                &tp[dest_begin]);
-        }
-        // Save all the params in the given vectors
-        x.push_back (tx);
-        y.push_back (ty);
-        width.push_back (tw);
-        height.push_back (th);
-        pixels.push_back (tp);
+        assert (tx + tw <= (i.width >> level));
+        assert (ty + th <= (i.height >> level));
+        b.view.pixels = i.pixels + ty * Pitch (i) + tx;
+        b.view.pitch = Pitch (i);
+        pimpl->Transpose (tx, ty);
+        pimpl->Transpose (tw, th);
+        b.x = tx;
+        b.y = ty;
+        b.view.width = tw;
+        b.view.height = th;
+        return true;
     }
+    return false;
 }
 
 void CODEC::Decode ()
 {
-    if (pimpl->resmap.pixels.empty ())
+    if (!pimpl->resmap)
         throw runtime_error ("A resolution map has not been set");
     assert (pimpl->dest_pyramid.images.size () > 0);
     if (!pimpl->dest_pyramid.images[0].pixels)
         throw runtime_error ("The destination image has not been set");
+    pimpl->CheckSrc ();
+    if (pimpl->skip_unchanged && pimpl->Decoded ())
+        return;
+    pimpl->decoded = false;
     FoveationDecode (pimpl->src_pyramid,
-        pimpl->masks,
+        pimpl->resmap->masks,
         pimpl->dest_pyramid);
+    pimpl->SetDecoded ();
+}
+
+void CODEC::Decode (double budget, vector<unsigned> &skipped)
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    assert (pimpl->dest_pyramid.images.size () > 0);
+    if (!pimpl->dest_pyramid.images[0].pixels)
+        throw runtime_error ("The destination image has not been set");
+    pimpl->CheckSrc ();
+    if (pimpl->skip_unchanged && pimpl->Decoded ())
+    {
+        skipped.clear ();
+        return;
+    }
+    pimpl->decoded = false;
+    FoveationDecode (pimpl->src_pyramid,
+        pimpl->resmap->masks,
+        pimpl->dest_pyramid,
+        budget,
+        skipped);
+    // A degraded decode is not remembered
+    if (skipped.empty ())
+        pimpl->SetDecoded ();
+}
+
+unsigned long CODEC::GetGeneration () const
+{
+    return pimpl->generation;
+}
+
+void CODEC::SetSkipUnchanged (bool skip)
+{
+    pimpl->skip_unchanged = skip;
+}
+
+bool CODEC::IsDecoded (int x, int y) const
+{
+    pimpl->Transpose (x, y);
+    if (pimpl->cache.Enabled ())
+    {
+        x = pimpl->cache.Quantize (x);
+        y = pimpl->cache.Quantize (y);
+    }
+    return pimpl->encoded &&
+        pimpl->src_pyramid.fixation_x == x &&
+        pimpl->src_pyramid.fixation_y == y &&
+        pimpl->Decoded ();
 }
 
 void CODEC::GetDecodedImage (unsigned level,
@@ -249,14 +948,514 @@ void CODEC::GetDecodedImage (unsigned level,
     if (level >= pimpl->dest_pyramid.levels)
         throw runtime_error ("Incorrect level parameter");
     // Scale the images down accordingly
-    width = (pimpl->dest_pyramid.images[level].width
-        >> pimpl->dest_pyramid.images[level].scale);
-    height = (pimpl->dest_pyramid.images[level].height
-        >> pimpl->dest_pyramid.images[level].scale);
+    const Image &i = pimpl->dest_pyramid.images[level];
+    width = (i.width >> i.scale);
+    height = (i.height >> i.scale);
     // Now copy the pixels
     pixels.resize (width * height);
-    pixels.assign (&pimpl->dest_pyramid.images[level].pixels[0],
-        &pimpl->dest_pyramid.images[level].pixels[width * height]);
+    Image packed = { i.width, i.height, i.scale, &pixels[0] };
+    Copy (&i, &packed);
+    pimpl->Transpose (width, height);
+}
+
+ImageView CODEC::GetDecodedView (unsigned level) const
+{
+    if (level >= pimpl->dest_pyramid.levels)
+        throw runtime_error ("Incorrect level parameter");
+    return pimpl->View (pimpl->dest_pyramid.images[level]);
+}
+
+void CODEC::Speculate (const vector<int> &x, const vector<int> &y)
+{
+    if (x.size () != y.size ())
+        throw runtime_error ("The candidate vectors must be the same size");
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    pimpl->CheckSrc ();
+
+    // Finish any speculations that are still running
+    pimpl->Join ();
+
+    // Allocate a destination pyramid for each candidate
+    const Image &src = pimpl->src_pyramid.images[0];
+    while (pimpl->speculations.size () < x.size ())
+    {
+        Speculation *s = new Speculation;
+        pimpl->speculations.push_back (s);
+        s->base.width = src.width;
+        s->base.height = src.height;
+        s->base.scale = src.scale;
+        s->base.pixels.resize ((src.width >> src.scale) * (src.height >> src.scale));
+        Image base = { src.width, src.height, src.scale, &s->base.pixels[0] };
+        s->dest.Create (base, pyramid_levels);
+    }
+
+    // Start decoding
+    pimpl->total_speculations = x.size ();
+    for (unsigned i = 0; i < x.size (); ++i)
+    {
+        Speculation *s = pimpl->speculations[i];
+        s->x = x[i];
+        s->y = y[i];
+        pimpl->Transpose (s->x, s->y);
+        s->valid = false;
+    }
+    pimpl->threads.Start (&pimpl->src_pyramid,
+        &pimpl->resmap->masks,
+        pimpl->speculations,
+        x.size ());
+}
+
+bool CODEC::DecodeSpeculative (int x, int y, unsigned tolerance)
+{
+    pimpl->Join ();
+
+    // The candidates are in buffer coordinates
+    int bx = x;
+    int by = y;
+    pimpl->Transpose (bx, by);
+
+    // Find the nearest candidate
+    Speculation *nearest = 0;
+    double nearest_distance = 0.0;
+    for (unsigned i = 0; i < pimpl->total_speculations; ++i)
+    {
+        Speculation *s = pimpl->speculations[i];
+        if (!s->valid)
+            continue;
+        double dx = s->x - bx;
+        double dy = s->y - by;
+        double d = sqrt (dx * dx + dy * dy);
+        if (d <= tolerance && (!nearest || d < nearest_distance))
+        {
+            nearest = s;
+            nearest_distance = d;
+        }
+    }
+
+    // The speculations are only good for one fixation
+    pimpl->total_speculations = 0;
+
+    // If none are close enough, do a normal decode
+    if (!nearest)
+    {
+        Encode (x, y);
+        Decode ();
+        return false;
+    }
+
+    assert (pimpl->dest_pyramid.images.size () > 0);
+    if (!pimpl->dest_pyramid.images[0].pixels)
+        throw runtime_error ("The destination image has not been set");
+
+    // The src pyramid is now encoded at the candidate's fixation point
+    pimpl->encoded = true;
+    pimpl->src_pyramid.regions.swap (nearest->regions);
+    pimpl->src_pyramid.spans.swap (nearest->spans);
+    pimpl->src_pyramid.fixation_x = nearest->x;
+    pimpl->src_pyramid.fixation_y = nearest->y;
+
+    // Copy the decoded candidate to the destination pyramid
+    for (unsigned n = 0; n < pimpl->dest_pyramid.levels; ++n)
+        Copy (&nearest->dest.images[n], &pimpl->dest_pyramid.images[n]);
+    pimpl->dest_pyramid.fixation_x = nearest->x;
+    pimpl->dest_pyramid.fixation_y = nearest->y;
+    pimpl->SetDecoded ();
+
+    return true;
+}
+
+// The CODEC16 implementation
+struct CODEC16::CODEC16Impl
+{
+    shared_ptr<const Resmap> resmap;
+    FoveationPyramid16 src_pyramid;
+    FoveationPyramid16 dest_pyramid;
+    // A column major image is processed as its transpose, as it is by
+    // a CODEC
+    bool transposed;
+    CODEC16Impl () :
+        transposed (false)
+    {
+    }
+    template<typename T>
+    void Transpose (T &x, T &y) const
+    {
+        if (transposed)
+            swap (x, y);
+    }
+    // Check that the masks of another codec can be shared
+    void Share (const shared_ptr<const Resmap> &r, unsigned levels, bool t, unsigned pyramid_levels)
+    {
+        if (!r)
+            throw runtime_error ("The resolution map has not been set");
+        if (levels != pyramid_levels)
+            throw runtime_error ("The codecs have different pyramid levels");
+        if (t != transposed)
+            throw runtime_error ("The codecs have different memory orders");
+        resmap = r;
+    }
+    // Copy a pyramid level into a packed buffer
+    void GetImage (const Image16 &i,
+        unsigned &width,
+        unsigned &height,
+        vector<unsigned short> &pixels) const
+    {
+        width = (i.width >> i.scale);
+        height = (i.height >> i.scale);
+        pixels.resize (width * height);
+        Image16 packed = { i.width, i.height, i.scale, pixels.empty () ? 0 : &pixels[0] };
+        if (!pixels.empty ())
+            Copy (&i, &packed);
+        Transpose (width, height);
+    }
+};
+
+CODEC16::CODEC16 (unsigned width,
+    unsigned height,
+    unsigned short *src,
+    unsigned short *dest,
+    unsigned pyramid_levels,
+    MemoryOrder order) :
+    pyramid_levels (pyramid_levels),
+    pimpl (new CODEC16Impl)
+{
+    if (!src)
+        throw runtime_error ("The src image pointer is not valid");
+    if (!dest)
+        throw runtime_error ("The dest image pointer is not valid");
+
+    pimpl->transposed = (order == COLUMN_MAJOR);
+    pimpl->Transpose (width, height);
+
+    Image16 src_image = { width, height, 0, src };
+    Image16 dest_image = { width, height, 0, dest };
+    pimpl->src_pyramid.Create (src_image, pyramid_levels);
+    pimpl->dest_pyramid.Create (dest_image, pyramid_levels);
+}
+
+CODEC16::~CODEC16 ()
+{
+}
+
+unsigned CODEC16::GetImageSize () const
+{
+    return GetWidth () * GetHeight ();
+}
+
+unsigned CODEC16::GetWidth () const
+{
+    const Image16 &i = pimpl->src_pyramid.images[0];
+    return pimpl->transposed ? i.height : i.width;
+}
+
+unsigned CODEC16::GetHeight () const
+{
+    const Image16 &i = pimpl->src_pyramid.images[0];
+    return pimpl->transposed ? i.width : i.height;
+}
+
+void CODEC16::SetSrcImage (unsigned short *p, unsigned pitch)
+{
+    CheckPitch (pimpl->src_pyramid.images[0], pitch);
+    pimpl->src_pyramid.images[0].pixels = p;
+    pimpl->src_pyramid.images[0].pitch = pitch;
+}
+
+void CODEC16::SetDestImage (unsigned short *p, unsigned pitch)
+{
+    CheckPitch (pimpl->dest_pyramid.images[0], pitch);
+    pimpl->dest_pyramid.images[0].pixels = p;
+    pimpl->dest_pyramid.images[0].pitch = pitch;
+}
+
+MemoryOrder CODEC16::GetMemoryOrder () const
+{
+    return pimpl->transposed ? COLUMN_MAJOR : ROW_MAJOR;
+}
+
+void CODEC16::SetResmap (unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels) const
+{
+    if (pixels.size () != width * height)
+        throw runtime_error ("Incorrect pixel vector size");
+    pimpl->Transpose (width, height);
+    if (SameResmap (pimpl->resmap, width, height, pixels))
+        return;
+    pimpl->resmap = NewResmap (width, height, pixels, pyramid_levels);
+}
+
+void CODEC16::ShareResmap (const CODEC &c) const
+{
+    pimpl->Share (c.pimpl->resmap, c.pyramid_levels, c.pimpl->transposed, pyramid_levels);
+}
+
+void CODEC16::ShareResmap (const CODEC16 &c) const
+{
+    pimpl->Share (c.pimpl->resmap, c.pyramid_levels, c.pimpl->transposed, pyramid_levels);
+}
+
+void CODEC16::Reduce ()
+{
+    if (!pimpl->src_pyramid.images[0].pixels)
+        throw runtime_error ("The source image has not been set");
+    pimpl->src_pyramid.Reduce ();
+}
+
+void CODEC16::GetReducedImage (unsigned level,
+    unsigned &width,
+    unsigned &height,
+    vector<unsigned short> &pixels) const
+{
+    if (level >= pimpl->src_pyramid.levels)
+        throw runtime_error ("Incorrect level parameter");
+    pimpl->GetImage (pimpl->src_pyramid.images[level], width, height, pixels);
+}
+
+void CODEC16::Encode (int x, int y)
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    pimpl->Transpose (x, y);
+    FoveationEncode (pimpl->src_pyramid, pimpl->resmap->masks, x, y);
+}
+
+void CODEC16::Decode ()
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    if (!pimpl->dest_pyramid.images[0].pixels)
+        throw runtime_error ("The destination image has not been set");
+    FoveationDecode (pimpl->src_pyramid, pimpl->resmap->masks, pimpl->dest_pyramid);
+}
+
+void CODEC16::Decode (double budget, vector<unsigned> &skipped)
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    if (!pimpl->dest_pyramid.images[0].pixels)
+        throw runtime_error ("The destination image has not been set");
+    FoveationDecode (pimpl->src_pyramid, pimpl->resmap->masks, pimpl->dest_pyramid, budget, skipped);
+}
+
+void CODEC16::GetDecodedImage (unsigned level,
+    unsigned &width,
+    unsigned &height,
+    vector<unsigned short> &pixels) const
+{
+    if (level >= pimpl->dest_pyramid.levels)
+        throw runtime_error ("Incorrect level parameter");
+    pimpl->GetImage (pimpl->dest_pyramid.images[level], width, height, pixels);
+}
+
+// The YUVCODEC implementation
+struct YUVCODEC::YUVCODECImpl
+{
+    shared_ptr<const Resmap> resmap;
+    YUVFormat format;
+    unsigned width;
+    unsigned height;
+    // The Y, U and V pyramids.  The chroma pyramids are in Y plane
+    // coordinates, so their bases are at scale 1.
+    FoveationPyramid src_pyramids[3];
+    FoveationPyramid dest_pyramids[3];
+    // NV12 chroma samples are taken apart into U and V planes here,
+    // and put back together after they are decoded
+    vector<unsigned char> src_chroma;
+    vector<unsigned char> dest_chroma;
+    unsigned char *src_image;
+    unsigned char *dest_image;
+    YUVCODECImpl () :
+        format (I420),
+        width (0),
+        height (0),
+        src_image (0),
+        dest_image (0)
+    {
+    }
+    size_t LumaSize () const
+    {
+        return static_cast<size_t> (width) * height;
+    }
+    unsigned ChromaWidth () const { return (width + 1) / 2; }
+    unsigned ChromaHeight () const { return (height + 1) / 2; }
+    size_t ChromaSize () const
+    {
+        return static_cast<size_t> (ChromaWidth ()) * ChromaHeight ();
+    }
+    // Point the bases of the pyramids at the planes of a frame
+    void SetPlanes (FoveationPyramid *p, unsigned char *image, vector<unsigned char> &chroma)
+    {
+        p[0].images[0].pixels = image;
+        unsigned char *u = format == I420 ? image + LumaSize () : &chroma[0];
+        p[1].images[0].pixels = u;
+        p[2].images[0].pixels = u + ChromaSize ();
+    }
+    // Check that the masks of another codec can be shared
+    void Share (const shared_ptr<const Resmap> &r, unsigned levels, unsigned pyramid_levels)
+    {
+        if (!r)
+            throw runtime_error ("The resolution map has not been set");
+        if (levels != pyramid_levels)
+            throw runtime_error ("The codecs have different pyramid levels");
+        resmap = r;
+    }
+};
+
+YUVCODEC::YUVCODEC (unsigned width,
+    unsigned height,
+    YUVFormat format,
+    unsigned char *src,
+    unsigned char *dest,
+    unsigned pyramid_levels) :
+    pyramid_levels (pyramid_levels),
+    pimpl (new YUVCODECImpl)
+{
+    if (!src)
+        throw runtime_error ("The src image pointer is not valid");
+    if (!dest)
+        throw runtime_error ("The dest image pointer is not valid");
+    if (format != I420 && format != NV12)
+        throw runtime_error ("Unknown YUV format");
+    if (pyramid_levels < 2)
+        throw runtime_error ("Invalid 'pyramid_levels' parameter");
+
+    pimpl->format = format;
+    pimpl->width = width;
+    pimpl->height = height;
+    if (format == NV12)
+    {
+        pimpl->src_chroma.resize (pimpl->ChromaSize () * 2);
+        pimpl->dest_chroma.resize (pimpl->ChromaSize () * 2);
+    }
+
+    // An odd sized plane has chroma for its last row or column, so the
+    // chroma bases are rounded up to even Y plane dimensions
+    const unsigned cw = (width + 1) & ~1u;
+    const unsigned ch = (height + 1) & ~1u;
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        Image s = { i ? cw : width, i ? ch : height, i ? 1u : 0u, src };
+        Image d = { i ? cw : width, i ? ch : height, i ? 1u : 0u, dest };
+        unsigned levels = i ? pyramid_levels - 1 : pyramid_levels;
+        pimpl->src_pyramids[i].Create (s, levels);
+        pimpl->dest_pyramids[i].Create (d, levels);
+    }
+    SetSrcImage (src);
+    SetDestImage (dest);
+}
+
+YUVCODEC::~YUVCODEC ()
+{
+}
+
+unsigned YUVCODEC::GetImageSize () const
+{
+    return static_cast<unsigned> (pimpl->LumaSize () + pimpl->ChromaSize () * 2);
+}
+
+unsigned YUVCODEC::GetWidth () const
+{
+    return pimpl->width;
+}
+
+unsigned YUVCODEC::GetHeight () const
+{
+    return pimpl->height;
+}
+
+YUVFormat YUVCODEC::GetFormat () const
+{
+    return pimpl->format;
+}
+
+void YUVCODEC::SetSrcImage (unsigned char *p)
+{
+    pimpl->src_image = p;
+    if (p)
+        pimpl->SetPlanes (pimpl->src_pyramids, p, pimpl->src_chroma);
+}
+
+void YUVCODEC::SetDestImage (unsigned char *p)
+{
+    pimpl->dest_image = p;
+    if (p)
+        pimpl->SetPlanes (pimpl->dest_pyramids, p, pimpl->dest_chroma);
+}
+
+void YUVCODEC::SetResmap (unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels) const
+{
+    if (pixels.size () != width * height)
+        throw runtime_error ("Incorrect pixel vector size");
+    if (SameResmap (pimpl->resmap, width, height, pixels))
+        return;
+    pimpl->resmap = NewResmap (width, height, pixels, pyramid_levels);
+}
+
+void YUVCODEC::ShareResmap (const CODEC &c) const
+{
+    if (c.pimpl->transposed)
+        throw runtime_error ("The codecs have different memory orders");
+    pimpl->Share (c.pimpl->resmap, c.pyramid_levels, pyramid_levels);
+}
+
+void YUVCODEC::ShareResmap (const YUVCODEC &c) const
+{
+    pimpl->Share (c.pimpl->resmap, c.pyramid_levels, pyramid_levels);
+}
+
+void YUVCODEC::Reduce ()
+{
+    if (!pimpl->src_image)
+        throw runtime_error ("The source image has not been set");
+    if (pimpl->format == NV12)
+    {
+        const unsigned char *uv = pimpl->src_image + pimpl->LumaSize ();
+        unsigned char *const planes[2] = {
+            &pimpl->src_chroma[0],
+            &pimpl->src_chroma[0] + pimpl->ChromaSize () };
+        Deinterleave (uv, 0, pimpl->ChromaWidth (), pimpl->ChromaHeight (), 2, planes);
+    }
+    for (unsigned i = 0; i < 3; ++i)
+        pimpl->src_pyramids[i].Reduce ();
+}
+
+void YUVCODEC::Encode (int x, int y)
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    FoveationEncode (pimpl->src_pyramids[0], pimpl->resmap->masks, x, y);
+    // V has the same regions as U, so it is decoded with the spans of
+    // U
+    FoveationEncode (pimpl->src_pyramids[1], pimpl->resmap->chroma, x, y);
+}
+
+void YUVCODEC::Decode ()
+{
+    if (!pimpl->resmap)
+        throw runtime_error ("A resolution map has not been set");
+    if (!pimpl->dest_image)
+        throw runtime_error ("The destination image has not been set");
+    const FoveationPyramid &u = pimpl->src_pyramids[1];
+    FoveationDecode (pimpl->src_pyramids[0], pimpl->resmap->masks, pimpl->dest_pyramids[0]);
+    FoveationDecode (u, pimpl->resmap->chroma, pimpl->dest_pyramids[1]);
+    FoveationDecode (pimpl->src_pyramids[2],
+        u.spans,
+        u.fixation_x,
+        u.fixation_y,
+        pimpl->resmap->chroma,
+        pimpl->dest_pyramids[2]);
+    if (pimpl->format == NV12)
+    {
+        unsigned char *uv = pimpl->dest_image + pimpl->LumaSize ();
+        const unsigned char *const planes[2] = {
+            &pimpl->dest_chroma[0],
+            &pimpl->dest_chroma[0] + pimpl->ChromaSize () };
+        Interleave (planes, 0, pimpl->ChromaWidth (), pimpl->ChromaHeight (), 2, uv);
+    }
 }
 
 } // namespace SVIS
@@ -9,6 +9,7 @@
 #ifndef SVIS_H
 #define SVIS_H
 
+#include <cstddef>
 #include <memory>
 #include <vector>
 
@@ -22,37 +23,98 @@ void CreateResmap (unsigned width,
     double halfres,
     double resmap_fov_deg);
 
+// The order of pixels in an image buffer.  In a ROW_MAJOR buffer,
+// pixel x, y is at y * width + x.  In a COLUMN_MAJOR buffer, such as
+// a MATLAB array, it is at x * height + y.
+enum MemoryOrder { ROW_MAJOR, COLUMN_MAJOR };
+
+// The layouts of a YUV 4:2:0 image.  Both have a full resolution Y
+// plane followed by chroma samples at half the resolution in each
+// direction.  I420 has a U plane followed by a V plane.  NV12 has one
+// plane of interleaved U and V samples.
+enum YUVFormat { I420, NV12 };
+
+// A view of an image owned by a codec.  Pixel x, y is at
+// pixels[y * pitch + x], or at pixels[x * pitch + y] in a COLUMN_MAJOR
+// codec.  A view is only valid until the image it refers to changes.
+struct ImageView
+{
+    const unsigned char *pixels;
+    unsigned width;
+    unsigned height;
+    unsigned pitch;
+};
+
+// A rectangle of an encoded image, and a view of its pixels
+struct ImageBlock
+{
+    unsigned x;
+    unsigned y;
+    ImageView view;
+};
+
 // A Codec encodes and decodes grayscale images.
 class CODEC
 {
     public:
     // Create a grayscale codec for encoding 'src_image' to
     // 'dest_image'.
+    //
+    // All of the image buffers given to and returned by the codec,
+    // including the resolution map, are in 'order'.  Buffers are
+    // always processed in place, scanning along the contiguous
+    // dimension.  Widths, heights and x, y coordinates are always
+    // those of the image, whatever the order.
+    //
+    // A codec that only decodes bitstreams may have a null
+    // 'src_image'.  Until one is set, anything that reads the source,
+    // such as Reduce, Encode and GetBitstream, throws.
     CODEC (unsigned width,
         unsigned height,
         unsigned char *src_image,
         unsigned char *dest_image,
-        unsigned pyramid_levels = 5);
+        unsigned pyramid_levels = 5,
+        MemoryOrder order = ROW_MAJOR);
     ~CODEC ();
+    // Forget the resolution map, the encode cache, speculations, coding
+    // options and whatever has been encoded, decoded or received, as
+    // if the codec were new, but keep its storage.  The images are set
+    // back to 'src_image' and 'dest_image'.
+    void Reset (unsigned char *src_image, unsigned char *dest_image);
     // Return dimensions specified in ctor
     unsigned GetImageSize () const;
     unsigned GetWidth () const;
     unsigned GetHeight () const;
     // The image buffer in 'p' must match the size specified in the
-    // constructor, i.e. 'width' * 'height'.
-    void SetSrcImage (unsigned char *p);
-    void SetDestImage (unsigned char *p);
+    // constructor, i.e. 'width' * 'height'.  If 'pitch' is not zero,
+    // it is the number of pixels from the start of one row to the
+    // start of the next, or of one column to the next in a
+    // COLUMN_MAJOR codec.  This allows a window of a larger frame to
+    // be encoded, or decoded into a padded surface, without copying.
+    void SetSrcImage (unsigned char *p, unsigned pitch = 0);
+    void SetDestImage (unsigned char *p, unsigned pitch = 0);
     unsigned PyramidLevels () { return pyramid_levels; }
+    MemoryOrder GetMemoryOrder () const;
 
 
-    // Set the resolution map used to encode the image
+    // Set the resolution map used to encode the image.  Setting the
+    // same resolution map again does nothing.
     void SetResmap (unsigned width,
         unsigned height,
         const std::vector<unsigned char> &pixels) const;
+    // Return true if the resolution map is already set to 'pixels'
+    bool HasResmap (unsigned width,
+        unsigned height,
+        const std::vector<unsigned char> &pixels) const;
+    // Use the resolution map and masks of another codec with the same
+    // number of pyramid levels, e.g. one codec per color plane.  The
+    // masks are shared, not copied.
+    void ShareResmap (const CODEC &c) const;
     void GetMask (unsigned level,
         unsigned &width,
         unsigned &height,
         std::vector<unsigned char> &pixels) const;
+    ImageView GetMaskView (unsigned level) const;
 
     // Encode/decode routines
     void Reduce ();
@@ -60,23 +122,230 @@ class CODEC
         unsigned &width,
         unsigned &height,
         std::vector<unsigned char> &pixels) const;
+    ImageView GetReducedView (unsigned level) const;
     void Encode (int x, int y);
+    // Cache encoded fixations so that repeat fixations skip all of
+    // the region and blend span setup.  'entries' is the number of
+    // fixations kept, least recently used first out.  Zero disables
+    // the cache.  Fixations are rounded to a multiple of 'quantum'
+    // pixels before they are encoded, so a larger quantum gives more
+    // cache hits at the cost of moving the fixation point.  A quantum
+    // of 1 << (PyramidLevels () - 1) matches the alignment of the
+    // coarsest level.
+    void SetEncodeCache (unsigned entries, unsigned quantum = 1);
+    unsigned GetEncodeCacheHits () const;
+    unsigned GetEncodeCacheMisses () const;
     void GetEncodedImageBlocks (unsigned level,
         std::vector<unsigned> &x,
         std::vector<unsigned> &y,
         std::vector<unsigned> &width,
         std::vector<unsigned> &height,
         std::vector<std::vector<unsigned char> > &pixels) const;
+    // Iterate over the encoded blocks of one level.  The blocks are
+    // views into the reduced source image, so nothing is allocated
+    // or copied.  The iterator is only valid until the next call to
+    // Reduce, Encode, SetSrcImage or SetResmap.
+    class BlockIterator
+    {
+        public:
+        // Get the next block.  Return false if there are no more.
+        bool Next (ImageBlock &b);
+        private:
+        friend class CODEC;
+        BlockIterator (const CODEC *codec, unsigned level);
+        const CODEC *codec;
+        unsigned level;
+        unsigned index;
+    };
+    BlockIterator GetEncodedBlocks (unsigned level) const;
+    // Write the encoded blocks to 'stream' in the format described in
+    // bitstream.h.  The stream may be decoded by a codec with the same
+    // dimensions, pyramid levels, memory order and resolution map.
+    // If 'compress' is true, the pixels are losslessly compressed.
+    void GetBitstream (std::vector<unsigned char> &stream,
+        bool compress = false);
+    // Decode a stream written by GetBitstream into the destination
+    // image.  The source image is not used, so a receiving codec
+    // needs only its resolution map, and may be created without one.
+    // A progressive stream may be cut short anywhere after its
+    // header.
+    void DecodeBitstream (const unsigned char *stream, size_t size);
+    // Write inter frame bitstreams, which skip the blocks that have
+    // not changed since they were last sent.  A block is skipped if
+    // none of its pixels has changed by more than 'threshold', so a
+    // threshold of zero is lossless.  The receiving codec must decode
+    // every stream, in order.  The first stream after this is called
+    // is a keyframe, which does not depend on the streams before it.
+    void SetInterFrame (bool enabled, unsigned threshold = 0);
+    // Write bitstreams of Laplacian residuals, which are smaller when
+    // compressed.  Writing them decodes the image into the
+    // destination image, so Decode need not be called.
+    void SetResidualCoding (bool enabled);
+    // Write progressive bitstreams, which send the coarsest level
+    // first and then the blocks nearest the fixation point, so that
+    // the receiver can decode whatever part of a stream has arrived.
+    // They cannot be inter frames or residuals.
+    void SetProgressiveCoding (bool enabled);
     void Decode ();
+    // Decode, but stop blending pyramid levels once 'budget' seconds
+    // have elapsed.  The finer levels are then upsampled from the
+    // finest level that was blended, giving a coarser periphery
+    // instead of a late frame.  The levels that were not blended are
+    // returned in 'skipped'.
+    void Decode (double budget, std::vector<unsigned> &skipped);
     void GetDecodedImage (unsigned level,
         unsigned &width,
         unsigned &height,
         std::vector<unsigned char> &pixels) const;
+    ImageView GetDecodedView (unsigned level) const;
+
+    // The source generation is incremented by SetSrcImage, Reduce and
+    // SetResmap.
+    unsigned long GetGeneration () const;
+    // If 'skip' is true, Encode and Decode return immediately when
+    // neither the generation, the fixation point nor the destination
+    // image has changed since the last call.  Reduce must then be
+    // called after writing a new image into the source buffer, and
+    // the destination must not be drawn into between calls.  It is
+    // false by default.
+    void SetSkipUnchanged (bool skip);
+    // Return true if the destination image already holds the current
+    // source decoded at fixation point x, y.
+    bool IsDecoded (int x, int y) const;
+
+    // Speculative decoding
+    //
+    // During a saccade, the next fixation point may be predicted.
+    // Speculate() starts decoding the reduced source image at each of
+    // the candidate fixation points on background threads and returns
+    // immediately.  The codec keeps one thread per processor for this,
+    // started by the first call.  The source image must not change until
+    // DecodeSpeculative() is called.
+    void Speculate (const std::vector<int> &x, const std::vector<int> &y);
+    // Encode and decode the image at fixation point x, y.  If one of
+    // the candidates lies within 'tolerance' pixels of x, y, the
+    // nearest one is copied to the destination image instead of
+    // decoding again.  Return true if a candidate was used.
+    bool DecodeSpeculative (int x, int y, unsigned tolerance);
 
     private:
+    friend class CODEC16;
+    friend class YUVCODEC;
     unsigned pyramid_levels;
     struct CODECImpl;
-    std::auto_ptr<CODECImpl> pimpl;
+    std::unique_ptr<CODECImpl> pimpl;
+};
+
+// A CODEC16 encodes and decodes grayscale images with 16 bit pixels,
+// such as the 12 and 16 bit frames of scientific cameras, without
+// converting them to 8 bits first.  It foveates exactly as a CODEC
+// does, with the same masks, but does not write bitstreams.
+class CODEC16
+{
+    public:
+    // The parameters are the same as those of a CODEC
+    CODEC16 (unsigned width,
+        unsigned height,
+        unsigned short *src_image,
+        unsigned short *dest_image,
+        unsigned pyramid_levels = 5,
+        MemoryOrder order = ROW_MAJOR);
+    ~CODEC16 ();
+    unsigned GetImageSize () const;
+    unsigned GetWidth () const;
+    unsigned GetHeight () const;
+    // 'pitch' is in pixels, as it is for a CODEC
+    void SetSrcImage (unsigned short *p, unsigned pitch = 0);
+    void SetDestImage (unsigned short *p, unsigned pitch = 0);
+    unsigned PyramidLevels () { return pyramid_levels; }
+    MemoryOrder GetMemoryOrder () const;
+
+    // The resolution map is 8 bits, as it is for a CODEC
+    void SetResmap (unsigned width,
+        unsigned height,
+        const std::vector<unsigned char> &pixels) const;
+    // Use the resolution map and masks of another codec with the same
+    // number of pyramid levels and memory order.  The masks do not
+    // depend on the pixel type, so an 8 bit codec and a 16 bit codec
+    // may share them.
+    void ShareResmap (const CODEC &c) const;
+    void ShareResmap (const CODEC16 &c) const;
+
+    // Encode/decode routines
+    void Reduce ();
+    void GetReducedImage (unsigned level,
+        unsigned &width,
+        unsigned &height,
+        std::vector<unsigned short> &pixels) const;
+    void Encode (int x, int y);
+    void Decode ();
+    // Decode within a time budget, as CODEC::Decode does
+    void Decode (double budget, std::vector<unsigned> &skipped);
+    void GetDecodedImage (unsigned level,
+        unsigned &width,
+        unsigned &height,
+        std::vector<unsigned short> &pixels) const;
+
+    private:
+    unsigned pyramid_levels;
+    struct CODEC16Impl;
+    std::unique_ptr<CODEC16Impl> pimpl;
+    // Disable copying
+    CODEC16 (const CODEC16 &);
+    CODEC16 &operator= (const CODEC16 &);
+};
+
+// A YUVCODEC foveates YUV 4:2:0 color images, such as the frames that
+// video decoders deliver, without converting them to RGB.  The Y plane
+// is foveated at full resolution.  The U and V planes are foveated
+// with one pyramid level less, and each of their levels is blended
+// with the mask of the Y level at the same scale, so the planes share
+// one resolution map and fixation point, and each costs a quarter of
+// the Y plane.
+class YUVCODEC
+{
+    public:
+    // The images hold a whole frame, of GetImageSize bytes, in row
+    // major order.  The chroma planes are (width + 1) / 2 by
+    // (height + 1) / 2 samples.  'pyramid_levels' is the number of
+    // levels of the Y plane, and must be at least 2.
+    YUVCODEC (unsigned width,
+        unsigned height,
+        YUVFormat format,
+        unsigned char *src_image,
+        unsigned char *dest_image,
+        unsigned pyramid_levels = 5);
+    ~YUVCODEC ();
+    unsigned GetImageSize () const;
+    unsigned GetWidth () const;
+    unsigned GetHeight () const;
+    YUVFormat GetFormat () const;
+    void SetSrcImage (unsigned char *p);
+    void SetDestImage (unsigned char *p);
+    unsigned PyramidLevels () { return pyramid_levels; }
+
+    // The resolution map is that of the Y plane
+    void SetResmap (unsigned width,
+        unsigned height,
+        const std::vector<unsigned char> &pixels) const;
+    // Use the resolution map and masks of another codec with the same
+    // number of pyramid levels.  A CODEC must be ROW_MAJOR.
+    void ShareResmap (const CODEC &c) const;
+    void ShareResmap (const YUVCODEC &c) const;
+
+    // Encode/decode routines.  The fixation point is in Y plane
+    // coordinates.
+    void Reduce ();
+    void Encode (int x, int y);
+    void Decode ();
+
+    private:
+    unsigned pyramid_levels;
+    struct YUVCODECImpl;
+    std::unique_ptr<YUVCODECImpl> pimpl;
+    // Disable copying
+    YUVCODEC (const YUVCODEC &);
+    YUVCODEC &operator= (const YUVCODEC &);
 };
 
 } // namespace SVIS
@@ -0,0 +1,503 @@
+// Foveate a batch of images
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// Read a manifest with one image per line, followed by the fixation
+// points to foveate it at:
+//
+//     images/lu.pgm 320,240 100,100 500,50
+//
+// and write each foveated image to the output directory as
+// <name>_<x>_<y>.pgm, or .ppm for color images.  Blank lines and
+// lines starting with '#' are skipped.  A manifest in which two
+// fixations have the same output name is rejected.
+//
+// The images are spread over a pool of worker threads, which take
+// work from each other when they run out.  Each worker keeps its
+// codecs from image to image, and all of the codecs for images of
+// the same size share one set of masks.  Images are read through a
+// memory map, and output files are written by a thread of their own.
+
+#include <atomic>
+#include <chrono>
+#include "channel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include "interleave.h"
+#include <iostream>
+#include <map>
+#include <mutex>
+#include "pnm_mmap.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "svis.h"
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+// An image and its fixation points
+struct Job
+{
+    string path;
+    vector<int> x;
+    vector<int> y;
+};
+
+// Return the name of a file without its directory or extension
+static string Stem (const string &path)
+{
+    size_t slash = path.find_last_of ("/\\");
+    string name = slash == string::npos ? path : path.substr (slash + 1);
+    size_t dot = name.rfind ('.');
+    return dot == string::npos || dot == 0 ? name : name.substr (0, dot);
+}
+
+// Read the jobs in a manifest.  Two fixations that would write the
+// same output file, such as images with the same name in different
+// directories, are an error rather than one silently replacing the
+// other.
+static void LoadManifest (const string &filename, vector<Job> &jobs)
+{
+    ifstream s (filename.c_str ());
+    if (!s)
+        throw runtime_error ("The manifest could not be opened");
+    map<string, unsigned> outputs;
+    string line;
+    for (unsigned number = 1; getline (s, line); ++number)
+    {
+        istringstream l (line);
+        Job job;
+        if (!(l >> job.path) || job.path[0] == '#')
+            continue;
+        string fixation;
+        while (l >> fixation)
+        {
+            int x;
+            int y;
+            char comma;
+            istringstream f (fixation);
+            if (!(f >> x >> comma >> y) || comma != ',')
+            {
+                ostringstream e;
+                e << "Line " << number << " of the manifest has an invalid fixation";
+                throw runtime_error (e.str ());
+            }
+            ostringstream name;
+            name << Stem (job.path) << '_' << x << '_' << y;
+            map<string, unsigned>::const_iterator i = outputs.find (name.str ());
+            if (i != outputs.end ())
+            {
+                ostringstream e;
+                e << "Lines " << i->second << " and " << number
+                    << " of the manifest have the same output " << name.str ();
+                throw runtime_error (e.str ());
+            }
+            outputs[name.str ()] = number;
+            job.x.push_back (x);
+            job.y.push_back (y);
+        }
+        jobs.push_back (job);
+    }
+}
+
+// Hand out jobs to workers.  Each worker has its own queue, and when
+// it is empty, it steals from the other end of another worker's queue.
+class WorkQueue
+{
+    public:
+    WorkQueue (unsigned workers, size_t jobs) :
+        queues (workers)
+    {
+        for (size_t i = 0; i < jobs; ++i)
+            queues[i % workers].jobs.push_back (i);
+    }
+    // Get the next job for a worker.  Return false if there are none
+    // left anywhere.
+    bool Next (unsigned worker, size_t &job)
+    {
+        {
+            Queue &q = queues[worker];
+            lock_guard<mutex> l (q.lock);
+            if (!q.jobs.empty ())
+            {
+                job = q.jobs.back ();
+                q.jobs.pop_back ();
+                return true;
+            }
+        }
+        for (unsigned k = 1; k < queues.size (); ++k)
+        {
+            Queue &q = queues[(worker + k) % queues.size ()];
+            lock_guard<mutex> l (q.lock);
+            if (!q.jobs.empty ())
+            {
+                job = q.jobs.front ();
+                q.jobs.pop_front ();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    private:
+    struct Queue
+    {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<Queue> queues;
+};
+
+// One set of masks for each image size.  The masks are made by a
+// codec that is never used for anything else, and the workers' codecs
+// share them.
+class Resmaps
+{
+    public:
+    Resmaps (double halfres, double fov, unsigned levels) :
+        halfres (halfres),
+        fov (fov),
+        levels (levels)
+    {
+    }
+    ~Resmaps ()
+    {
+        for (map<pair<unsigned, unsigned>, Owner *>::iterator i = owners.begin (); i != owners.end (); ++i)
+            delete i->second;
+    }
+    const CODEC &Get (unsigned width, unsigned height)
+    {
+        Owner *o;
+        {
+            lock_guard<mutex> l (lock);
+            Owner *&p = owners[make_pair (width, height)];
+            if (!p)
+                p = new Owner;
+            o = p;
+        }
+        // Only the first worker to need a size makes its masks
+        lock_guard<mutex> l (o->lock);
+        if (!o->codec)
+        {
+            o->pixels.resize (static_cast<size_t> (width) * height);
+            o->codec = new CODEC (width, height, &o->pixels[0], &o->pixels[0], levels);
+            vector<unsigned char> resmap;
+            CreateResmap (width * 2, height * 2, resmap, halfres, fov);
+            o->codec->SetResmap (width * 2, height * 2, resmap);
+        }
+        return *o->codec;
+    }
+
+    private:
+    struct Owner
+    {
+        mutex lock;
+        vector<unsigned char> pixels;
+        CODEC *codec;
+        Owner () : codec (0) { }
+        ~Owner () { delete codec; }
+    };
+    double halfres;
+    double fov;
+    unsigned levels;
+    mutex lock;
+    map<pair<unsigned, unsigned>, Owner *> owners;
+};
+
+// A file to write
+struct Output
+{
+    string path;
+    vector<unsigned char> data;
+    void swap (Output &o)
+    {
+        path.swap (o.path);
+        data.swap (o.data);
+    }
+};
+
+// Write files until there are no more
+static void WriteOutputs (Channel<Output> &in, atomic<size_t> &bytes, atomic<unsigned> &errors)
+{
+    Output o;
+    while (in.Pop (o))
+    {
+        FILE *f = fopen (o.path.c_str (), "wb");
+        bool failed = !f || fwrite (&o.data[0], 1, o.data.size (), f) != o.data.size ();
+        if (f && fclose (f) != 0)
+            failed = true;
+        if (failed)
+        {
+            cerr << o.path << ": could not be written" << endl;
+            ++errors;
+            continue;
+        }
+        bytes += o.data.size ();
+    }
+}
+
+// The state shared by the workers
+struct Batch
+{
+    const vector<Job> *jobs;
+    WorkQueue *queue;
+    Resmaps *resmaps;
+    Channel<Output> *outputs;
+    string directory;
+    unsigned levels;
+    atomic<unsigned> images;
+    atomic<unsigned> written;
+    atomic<unsigned> errors;
+};
+
+// A worker's codecs for one image size, one per color plane
+struct Planes
+{
+    vector<CODEC *> codecs;
+    vector<unsigned char> src;
+    vector<unsigned char> dest;
+    ~Planes ()
+    {
+        for (unsigned i = 0; i < codecs.size (); ++i)
+            delete codecs[i];
+    }
+};
+
+static void Foveate (Batch &batch, map<pair<unsigned, unsigned>, Planes *> &sizes, const Job &job)
+{
+    PNM::MappedImage image (job.path);
+    const unsigned w = image.GetWidth ();
+    const unsigned h = image.GetHeight ();
+    const unsigned depth = image.GetPixelDepth ();
+    const size_t n = static_cast<size_t> (w) * h;
+
+    Planes *&p = sizes[make_pair (w, h)];
+    if (!p)
+    {
+        p = new Planes;
+        // Room for every plane of a color image
+        p->dest.resize (n * 3);
+    }
+    while (p->codecs.size () < depth)
+    {
+        const CODEC &owner = batch.resmaps->Get (w, h);
+        CODEC *c = new CODEC (w, h, &p->dest[0], &p->dest[0], batch.levels);
+        c->ShareResmap (owner);
+        p->codecs.push_back (c);
+    }
+
+    // Each plane is reduced once and encoded at every fixation.  A
+    // grey image is reduced straight from the mapped file.
+    unsigned char *pixels = image.GetPixelsAddress ();
+    if (depth == 1)
+    {
+        p->codecs[0]->SetSrcImage (pixels);
+        p->codecs[0]->Reduce ();
+    }
+    else
+    {
+        p->src.resize (n * depth);
+        unsigned char *planes[3] = { &p->src[0], &p->src[n], &p->src[n * 2] };
+        Deinterleave (pixels, 0, w, h, depth, planes);
+        for (unsigned c = 0; c < depth; ++c)
+        {
+            p->codecs[c]->SetSrcImage (&p->src[c * n]);
+            p->codecs[c]->Reduce ();
+        }
+    }
+
+    ostringstream s;
+    s << (depth == 1 ? "P5" : "P6") << '\n' << w << ' ' << h << '\n' << image.GetMaxval () << '\n';
+    const string header = s.str ();
+    const string stem = batch.directory + "/" + Stem (job.path);
+    for (unsigned f = 0; f < job.x.size (); ++f)
+    {
+        Output o;
+        ostringstream name;
+        name << stem << '_' << job.x[f] << '_' << job.y[f] << (depth == 1 ? ".pgm" : ".ppm");
+        o.path = name.str ();
+        o.data.assign (header.begin (), header.end ());
+        size_t offset = o.data.size ();
+        o.data.resize (offset + n * depth);
+        for (unsigned c = 0; c < depth; ++c)
+        {
+            CODEC *codec = p->codecs[c];
+            codec->SetDestImage (&p->dest[c * n]);
+            codec->Encode (job.x[f], job.y[f]);
+            codec->Decode ();
+        }
+        const unsigned char *planes[3] = { &p->dest[0], &p->dest[n], &p->dest[n * 2] };
+        Interleave (planes, 0, w, h, depth, &o.data[offset]);
+        if (!batch.outputs->Push (o))
+            return;
+        ++batch.written;
+    }
+}
+
+static void Work (Batch *batch, unsigned worker)
+{
+    map<pair<unsigned, unsigned>, Planes *> sizes;
+    size_t j;
+    while (batch->queue->Next (worker, j))
+    {
+        const Job &job = (*batch->jobs)[j];
+        try
+        {
+            Foveate (*batch, sizes, job);
+        }
+        catch (const exception &e)
+        {
+            cerr << job.path << ": " << e.what () << endl;
+            ++batch->errors;
+        }
+        ++batch->images;
+    }
+    for (map<pair<unsigned, unsigned>, Planes *>::iterator i = sizes.begin (); i != sizes.end (); ++i)
+        delete i->second;
+}
+
+static void Usage ()
+{
+    cerr << "usage: svisbatch [options] manifest" << endl
+        << endl
+        << "Foveate the PGM and PPM images in a manifest of lines of" << endl
+        << "'path x,y x,y ...'." << endl
+        << endl
+        << "  -o dir     output directory (default: .)" << endl
+        << "  -j n       worker threads (default: one per core)" << endl
+        << "  -r deg     resolution map half resolution (default: 2.3)" << endl
+        << "  -f deg     resolution map field of view, which is twice the" << endl
+        << "             image width (default: 45)" << endl
+        << "  -l n       pyramid levels (default: 5)" << endl
+        << "  -q         do not report progress" << endl;
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        string directory = ".";
+        unsigned threads = thread::hardware_concurrency ();
+        double halfres = 2.3;
+        double fov = 45.0;
+        unsigned levels = 5;
+        bool quiet = false;
+        string manifest;
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            if (arg == "-q")
+            {
+                quiet = true;
+                continue;
+            }
+            if (arg[0] != '-')
+            {
+                manifest = arg;
+                continue;
+            }
+            if (i + 1 >= argc)
+            {
+                Usage ();
+                return -1;
+            }
+            const char *value = argv[++i];
+            if (arg == "-o")
+                directory = value;
+            else if (arg == "-j")
+                threads = atoi (value);
+            else if (arg == "-r")
+                halfres = atof (value);
+            else if (arg == "-f")
+                fov = atof (value);
+            else if (arg == "-l")
+                levels = atoi (value);
+            else
+            {
+                Usage ();
+                return -1;
+            }
+        }
+        if (manifest.empty ())
+        {
+            Usage ();
+            return -1;
+        }
+        if (threads == 0)
+            threads = 1;
+
+        vector<Job> jobs;
+        LoadManifest (manifest, jobs);
+        unsigned total = 0;
+        for (unsigned i = 0; i < jobs.size (); ++i)
+            total += jobs[i].x.size ();
+
+        WorkQueue queue (threads, jobs.size ());
+        Resmaps resmaps (halfres, fov, levels);
+        // Enough outputs to keep the writer busy, but not so many
+        // that a slow disk fills memory
+        Channel<Output> outputs (threads * 4);
+        atomic<size_t> bytes (0);
+        atomic<unsigned> write_errors (0);
+        Batch batch;
+        batch.jobs = &jobs;
+        batch.queue = &queue;
+        batch.resmaps = &resmaps;
+        batch.outputs = &outputs;
+        batch.directory = directory;
+        batch.levels = levels;
+        batch.images = 0;
+        batch.written = 0;
+        batch.errors = 0;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now ();
+        thread writer (WriteOutputs, ref (outputs), ref (bytes), ref (write_errors));
+        vector<thread> workers;
+        for (unsigned i = 0; i < threads; ++i)
+            workers.push_back (thread (Work, &batch, i));
+
+        // Report progress while the workers run
+        while (batch.images < jobs.size ())
+        {
+            this_thread::sleep_for (chrono::milliseconds (100));
+            double elapsed = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+            if (!quiet && elapsed > 0.0)
+                cerr << "\r" << batch.images << "/" << jobs.size () << " images, "
+                    << batch.written << "/" << total << " outputs, "
+                    << fixed << setprecision (1) << batch.written / elapsed << " outputs/s   " << flush;
+        }
+        for (unsigned i = 0; i < workers.size (); ++i)
+            workers[i].join ();
+        outputs.Close ();
+        writer.join ();
+
+        double elapsed = chrono::duration<double> (chrono::steady_clock::now () - start).count ();
+        if (!quiet)
+            cerr << "\r" << batch.images << " images, " << batch.written << " outputs in "
+                << fixed << setprecision (2) << elapsed << " s, "
+                << setprecision (1) << batch.written / elapsed << " outputs/s, "
+                << bytes / elapsed / 1e6 << " MB/s written" << endl;
+        unsigned errors = batch.errors + write_errors;
+        if (errors)
+        {
+            cerr << errors << " errors" << endl;
+            return -1;
+        }
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,18 @@
+function [lhs1] = sviscodecrgb_mexgen (rhs1)
+% SVISCODECRGB  Create a space variant imaging system color codec
+%
+% C=SVISCODECRGB(SRC) creates a codec that will encode the RxCx3 color
+% source image SRC.
+%
+% SRC must be of type uint8.
+%
+% The three color planes are encoded concurrently, and they share the
+% resolution map specified by SVISSETRESMAP.  Use SVISSETSRCRGB and
+% SVISENCODERGB with the returned handle.
+%
+% SEE ALSO: SVISCODEC, SVISSETRESMAP, SVISSETSRCRGB, SVISENCODERGB
+
+% Mexgen generated this file on Wed Jun  8 12:23:58 2011
+% DO NOT EDIT!
+
+[lhs1] = svismex (6, rhs1);
@@ -1,4 +1,4 @@
-function [lhs1] = svisencode_mexgen (rhs1, rhs2, rhs3)
+function [lhs1] = svisencode_mexgen (rhs1, rhs2, rhs3, varargin)
 % SVISENCODE    Encode the source image
 %
 % I=SVISENCODE(C,ROW,COL) encodes the image specified either by
@@ -6,9 +6,15 @@ function [lhs1] = svisencode_mexgen (rhs1, rhs2, rhs3)
 % returns the encoded image in I, using the resolution map specified
 % by SVISSETRESMAP.
 %
+% I=SVISENCODE(C,ROW,COL,SRC) sets the source image to SRC and encodes
+% it in a single call.  SRC is not copied, so this is the fastest way
+% to encode an image sequence.  Because SRC is not kept, the next call
+% to SVISENCODE must also specify a source image unless SVISSETSRC is
+% called first.
+%
 % SEE ALSO: SVISCODEC, SVISSETRESMAP, SVISSETSRC
 
 % Mexgen generated this file on Wed Jun  8 12:23:58 2011
 % DO NOT EDIT!
 
-[lhs1] = svismex (5, rhs1, rhs2, rhs3);
+[lhs1] = svismex (5, rhs1, rhs2, rhs3, varargin{:});
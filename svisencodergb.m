@@ -0,0 +1,24 @@
+function [lhs1] = svisencodergb_mexgen (rhs1, rhs2, rhs3, varargin)
+% SVISENCODERGB Encode the color source image
+%
+% I=SVISENCODERGB(C,ROW,COL) encodes the RxCx3 image specified either
+% by SVISCODECRGB or by SVISSETSRCRGB at the fixation point in ROW,
+% COL and returns the RxCx3 encoded image in I.
+%
+% I=SVISENCODERGB(C,ROW,COL,SRC) sets the source image to SRC and
+% encodes it in a single call, like SVISENCODE(C,ROW,COL,SRC).
+%
+% This replaces encoding each plane with SVISENCODE and concatenating
+% the results:
+%
+%     c=sviscodecrgb(img);
+%     svissetresmap(c,resmap);
+%     ...
+%     d=svisencodergb(c,row,col);
+%
+% SEE ALSO: SVISCODECRGB, SVISSETRESMAP, SVISSETSRCRGB, SVISENCODE
+
+% Mexgen generated this file on Wed Jun  8 12:23:58 2011
+% DO NOT EDIT!
+
+[lhs1] = svismex (8, rhs1, rhs2, rhs3, varargin{:});
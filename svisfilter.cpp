@@ -0,0 +1,519 @@
+// Foveate a video stream
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// Read a YUV4MPEG2 stream, or a stream of concatenated PGM or PPM
+// images, from stdin, foveate each frame, and write it to stdout in
+// the same format, so that the filter can sit in a raw video pipeline:
+//
+//     ffmpeg -i in.mp4 -f yuv4mpegpipe - | svisfilter -g gaze.csv |
+//         ffmpeg -f yuv4mpegpipe -i - out.mp4
+//
+// Frames are read, foveated and written on three threads, so that
+// I/O overlaps the foveation of the frame in between.
+
+#include "channel.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "interleave.h"
+#include <iostream>
+#include <map>
+#include "pnm.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "svis.h"
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+using namespace std;
+using namespace SVIS;
+
+// How the planes of a frame are laid out
+struct Format
+{
+    // True for YUV4MPEG2, false for PNM
+    bool y4m;
+    unsigned width;
+    unsigned height;
+    // PNM samples per pixel, 1 or 3, which are interleaved
+    unsigned depth;
+    // The PNM maxval, which is written back unchanged
+    unsigned maxval;
+    // YUV4MPEG2 chroma subsampling: 1 for 4:4:4, 2 for 4:2:0, or 0 for
+    // luma only
+    unsigned chroma;
+    // The YUV4MPEG2 stream header, which is written back unchanged
+    string header;
+};
+
+// A frame and the header that came before it
+struct Frame
+{
+    unsigned number;
+    Format format;
+    // The FRAME line of a YUV4MPEG2 frame, or the comments of a PNM
+    // frame
+    string header;
+    vector<unsigned char> pixels;
+    void swap (Frame &f)
+    {
+        std::swap (number, f.number);
+        std::swap (format, f.format);
+        header.swap (f.header);
+        pixels.swap (f.pixels);
+    }
+};
+
+// Return the size in bytes of a frame
+static size_t FrameSize (const Format &f)
+{
+    size_t luma = static_cast<size_t> (f.width) * f.height;
+    if (!f.y4m)
+        return luma * f.depth;
+    if (f.chroma == 0)
+        return luma;
+    size_t cw = (f.width + f.chroma - 1) / f.chroma;
+    size_t ch = (f.height + f.chroma - 1) / f.chroma;
+    return luma + 2 * cw * ch;
+}
+
+// Parse the parameters of a YUV4MPEG2 stream header
+static void ParseY4M (const string &line, Format &f)
+{
+    f.y4m = true;
+    f.width = 0;
+    f.height = 0;
+    f.depth = 1;
+    f.chroma = 2;
+    istringstream s (line);
+    string tag;
+    s >> tag;
+    while (s >> tag)
+    {
+        if (tag[0] == 'W')
+            f.width = atoi (tag.c_str () + 1);
+        else if (tag[0] == 'H')
+            f.height = atoi (tag.c_str () + 1);
+        else if (tag[0] == 'C')
+        {
+            string c = tag.substr (1);
+            // The 4:2:0 variants only differ in where the chroma
+            // samples are sited.  Deeper samples, such as 420p10, are
+            // not supported.
+            if (c == "444")
+                f.chroma = 1;
+            else if (c == "420" || c == "420jpeg" || c == "420paldv" || c == "420mpeg2")
+                f.chroma = 2;
+            else if (c == "mono")
+                f.chroma = 0;
+            else
+                throw runtime_error ("Only 8 bit 4:2:0, 4:4:4 and mono YUV4MPEG2 streams are supported");
+        }
+    }
+    if (f.width == 0 || f.height == 0)
+        throw runtime_error ("The YUV4MPEG2 stream has no frame size");
+    f.header = line;
+}
+
+// Read frames from stdin until it ends
+static void ReadFrames (Channel<Frame> &out)
+{
+    try
+    {
+        istream &s = cin;
+        Format format;
+        format.y4m = false;
+        format.maxval = 255;
+        s >> ws;
+        if (s.peek () == 'Y')
+        {
+            string line;
+            getline (s, line);
+            if (line.compare (0, 10, "YUV4MPEG2 ") != 0)
+                throw runtime_error ("The input is not a YUV4MPEG2 stream");
+            ParseY4M (line, format);
+        }
+        for (unsigned number = 0; ; ++number)
+        {
+            Frame f;
+            f.number = number;
+            if (format.y4m)
+            {
+                if (!getline (s, f.header))
+                    break;
+                if (f.header.compare (0, 5, "FRAME") != 0)
+                    throw runtime_error ("A YUV4MPEG2 frame header is missing");
+                f.format = format;
+                f.pixels.resize (FrameSize (format));
+                s.read (reinterpret_cast<char *> (&f.pixels[0]), f.pixels.size ());
+                if (!s)
+                    throw runtime_error ("The last frame is truncated");
+            }
+            else
+            {
+                s >> ws;
+                if (s.peek () == char_traits<char>::eof ())
+                    break;
+                PNM::Image i;
+                s >> i;
+                f.format.y4m = false;
+                f.format.width = i.GetWidth ();
+                f.format.height = i.GetHeight ();
+                f.format.depth = i.GetPixelDepth ();
+                f.format.maxval = i.GetMaxval ();
+                f.format.chroma = 0;
+                f.header = i.GetComments ();
+                f.pixels.resize (i.GetSize ());
+                if (!f.pixels.empty ())
+                    memcpy (&f.pixels[0], i.GetPixelsAddress (), f.pixels.size ());
+            }
+            if (!out.Push (f))
+                return;
+        }
+        out.Close ();
+    }
+    catch (const exception &e)
+    {
+        out.Close (e.what ());
+    }
+}
+
+// Write frames to stdout until there are no more
+static void WriteFrames (Channel<Frame> &in, Channel<Frame> &failed)
+{
+    try
+    {
+        ostream &s = cout;
+        bool first = true;
+        Frame f;
+        while (in.Pop (f))
+        {
+            if (f.format.y4m)
+            {
+                if (first)
+                    s << f.format.header << '\n';
+                s << f.header << '\n';
+                s.write (reinterpret_cast<const char *> (&f.pixels[0]), f.pixels.size ());
+            }
+            else
+            {
+                s << (f.format.depth == 1 ? "P5" : "P6") << '\n'
+                    << f.header
+                    << f.format.width << ' ' << f.format.height << '\n'
+                    << f.format.maxval << '\n';
+                s.write (reinterpret_cast<const char *> (&f.pixels[0]), f.pixels.size ());
+            }
+            first = false;
+            if (!s)
+                throw runtime_error ("The output could not be written");
+        }
+        s.flush ();
+    }
+    catch (const exception &e)
+    {
+        // Stop the frames coming
+        failed.Close (e.what ());
+        in.Close (e.what ());
+    }
+}
+
+// Fixation points by frame number
+class Gaze
+{
+    public:
+    Gaze () : fixed (false), x (0), y (0) { }
+    // Use one fixation point for every frame
+    void SetFixed (int x, int y)
+    {
+        fixed = true;
+        this->x = x;
+        this->y = y;
+    }
+    // Read lines of frame,x,y.  Lines that do not start with a number,
+    // such as a heading, are skipped.
+    void Load (const string &filename)
+    {
+        ifstream s (filename.c_str ());
+        if (!s)
+            throw runtime_error ("The gaze file could not be opened");
+        string line;
+        while (getline (s, line))
+        {
+            unsigned frame;
+            int gx;
+            int gy;
+            char c1;
+            char c2;
+            istringstream l (line);
+            if (l >> frame >> c1 >> gx >> c2 >> gy && c1 == ',' && c2 == ',')
+                points[frame] = make_pair (gx, gy);
+        }
+        if (points.empty ())
+            throw runtime_error ("The gaze file has no fixations");
+    }
+    // Get the fixation point for a frame.  A frame that is not in the
+    // gaze file keeps the fixation of the frame before it, and frames
+    // before the first fixation are foveated at the center.
+    void Get (unsigned frame, unsigned width, unsigned height, int &fx, int &fy) const
+    {
+        fx = fixed ? x : width / 2;
+        fy = fixed ? y : height / 2;
+        map<unsigned, pair<int, int> >::const_iterator i = points.upper_bound (frame);
+        if (i == points.begin ())
+            return;
+        --i;
+        fx = i->second.first;
+        fy = i->second.second;
+    }
+
+    private:
+    bool fixed;
+    int x;
+    int y;
+    map<unsigned, pair<int, int> > points;
+};
+
+// The codecs for the planes of a frame format
+class Foveator
+{
+    public:
+    Foveator (double halfres, double fov, unsigned levels) :
+        halfres (halfres),
+        fov (fov),
+        levels (levels),
+        width (0),
+        height (0),
+        yuv (0)
+    {
+    }
+    ~Foveator ()
+    {
+        Clear ();
+    }
+    void Foveate (Frame &f, int x, int y)
+    {
+        const Format &format = f.format;
+        if (format.width != width || format.height != height || (codecs.empty () && !yuv))
+            Create (format);
+        unsigned char *p = &f.pixels[0];
+        if (yuv)
+        {
+            // 4:2:0 frames are foveated as a whole, with chroma masks
+            // derived from the luma resolution map
+            frame.resize (f.pixels.size ());
+            yuv->SetSrcImage (p);
+            yuv->SetDestImage (&frame[0]);
+            yuv->Reduce ();
+            yuv->Encode (x, y);
+            yuv->Decode ();
+            f.pixels.swap (frame);
+            return;
+        }
+        if (!format.y4m && format.depth == 3)
+        {
+            // Take the interleaved samples apart, and put them back
+            // together afterwards
+            const size_t n = static_cast<size_t> (width) * height;
+            planes.resize (n * 3);
+            unsigned char *q[3] = { &planes[0], &planes[n], &planes[n * 2] };
+            Deinterleave (p, 0, width, height, 3, q);
+            for (unsigned c = 0; c < 3; ++c)
+                Foveate (codecs[0], q[c], x, y);
+            const unsigned char *r[3] = { q[0], q[1], q[2] };
+            Interleave (r, 0, width, height, 3, p);
+            return;
+        }
+        Foveate (codecs[0], p, x, y);
+        if (format.y4m && format.chroma != 0)
+        {
+            // 4:4:4 chroma planes are the size of the luma plane
+            size_t size = static_cast<size_t> (width) * height;
+            Foveate (codecs[0], p + size, x, y);
+            Foveate (codecs[0], p + size * 2, x, y);
+        }
+    }
+
+    private:
+    double halfres;
+    double fov;
+    unsigned levels;
+    unsigned width;
+    unsigned height;
+    vector<CODEC *> codecs;
+    YUVCODEC *yuv;
+    vector<unsigned char> planes;
+    vector<unsigned char> dest;
+    vector<unsigned char> frame;
+    void Clear ()
+    {
+        for (unsigned i = 0; i < codecs.size (); ++i)
+            delete codecs[i];
+        codecs.clear ();
+        delete yuv;
+        yuv = 0;
+    }
+    CODEC *Add (unsigned w, unsigned h)
+    {
+        dest.resize (static_cast<size_t> (width) * height);
+        CODEC *c = new CODEC (w, h, &dest[0], &dest[0], levels);
+        codecs.push_back (c);
+        vector<unsigned char> resmap;
+        CreateResmap (w * 2, h * 2, resmap, halfres, fov);
+        c->SetResmap (w * 2, h * 2, resmap);
+        return c;
+    }
+    void Create (const Format &format)
+    {
+        Clear ();
+        width = format.width;
+        height = format.height;
+        if (format.y4m && format.chroma == 2)
+        {
+            dest.resize (FrameSize (format));
+            yuv = new YUVCODEC (width, height, I420, &dest[0], &dest[0], levels);
+            vector<unsigned char> resmap;
+            CreateResmap (width * 2, height * 2, resmap, halfres, fov);
+            yuv->SetResmap (width * 2, height * 2, resmap);
+        }
+        else
+            Add (width, height);
+    }
+    // Foveate a plane in place
+    void Foveate (CODEC *c, unsigned char *p, int x, int y)
+    {
+        const size_t size = c->GetImageSize ();
+        c->SetSrcImage (p);
+        c->SetDestImage (&dest[0]);
+        c->Reduce ();
+        c->Encode (x, y);
+        c->Decode ();
+        memcpy (p, &dest[0], size);
+    }
+};
+
+static void Usage ()
+{
+    cerr << "usage: svisfilter [options] < input > output" << endl
+        << endl
+        << "Foveate a YUV4MPEG2 stream or a stream of PGM or PPM images." << endl
+        << endl
+        << "  -g file    read the fixation of each frame from lines of frame,x,y" << endl
+        << "  -x x -y y  fixate x, y in every frame, or in the frames before" << endl
+        << "             the first in the gaze file (default: the center)" << endl
+        << "  -r deg     resolution map half resolution (default: 2.3)" << endl
+        << "  -f deg     resolution map field of view, which is twice the" << endl
+        << "             frame width (default: 45)" << endl
+        << "  -l n       pyramid levels (default: 5)" << endl;
+}
+
+int main (int argc, char *argv[])
+{
+    try
+    {
+        Gaze gaze;
+        double halfres = 2.3;
+        double fov = 45.0;
+        unsigned levels = 5;
+        bool has_x = false;
+        bool has_y = false;
+        int x = 0;
+        int y = 0;
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            if (i + 1 >= argc)
+            {
+                Usage ();
+                return -1;
+            }
+            const char *value = argv[++i];
+            if (arg == "-g")
+                gaze.Load (value);
+            else if (arg == "-x")
+            {
+                x = atoi (value);
+                has_x = true;
+            }
+            else if (arg == "-y")
+            {
+                y = atoi (value);
+                has_y = true;
+            }
+            else if (arg == "-r")
+                halfres = atof (value);
+            else if (arg == "-f")
+                fov = atof (value);
+            else if (arg == "-l")
+                levels = atoi (value);
+            else
+            {
+                Usage ();
+                return -1;
+            }
+        }
+        if (has_x != has_y)
+        {
+            Usage ();
+            return -1;
+        }
+        if (has_x)
+            gaze.SetFixed (x, y);
+
+#ifdef _WIN32
+        _setmode (_fileno (stdin), _O_BINARY);
+        _setmode (_fileno (stdout), _O_BINARY);
+#endif
+        ios::sync_with_stdio (false);
+
+        // Read, foveate and write on their own threads
+        Channel<Frame> input (4);
+        Channel<Frame> output (4);
+        thread reader (ReadFrames, ref (input));
+        thread writer (WriteFrames, ref (output), ref (input));
+        Foveator foveator (halfres, fov, levels);
+        string error;
+        try
+        {
+            Frame f;
+            while (input.Pop (f))
+            {
+                int fx;
+                int fy;
+                gaze.Get (f.number, f.format.width, f.format.height, fx, fy);
+                foveator.Foveate (f, fx, fy);
+                if (!output.Push (f))
+                    break;
+            }
+        }
+        catch (const exception &e)
+        {
+            error = e.what ();
+            input.Close (error);
+        }
+        output.Close ();
+        reader.join ();
+        writer.join ();
+        if (error.empty ())
+            error = input.Error ();
+        if (error.empty ())
+            error = output.Error ();
+        if (!error.empty ())
+            throw runtime_error (error);
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -8,12 +8,18 @@
 
 #include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
 #include "mex.h"
+#include <mutex>
 #include "svis.h"
 #include <vector>
 #include "version.h"
 #include <stdexcept>
+#include <string>
+#include <thread>
 
 using namespace std;
 using namespace SVIS;
@@ -24,31 +30,79 @@ class MatlabCODEC
     public:
     MatlabCODEC (unsigned width,
         unsigned height,
-        unsigned pyramid_levels)
+        unsigned pyramid_levels) :
+        reduced (false),
+        retained (true),
+        polled (false)
     {
         // Allocate space for the src/dest images
         original.resize (width * height);
         decoded.resize (width * height);
-        // Allocate the codec
-        codec = new CODEC (width, height, &original[0], &decoded[0], pyramid_levels);
+        // Allocate the codec.  MATLAB arrays are column major.
+        codec = new CODEC (width, height, &original[0], &decoded[0], pyramid_levels, COLUMN_MAJOR);
+        // Polling the same frame only copies it
+        codec->SetSkipUnchanged (true);
     }
     ~MatlabCODEC ()
     {
         // Deallocate codec
         delete codec;
     }
+    // Forget everything but the buffers, for a codec that is reused
+    void Reset ()
+    {
+        codec->Reset (&original[0], &decoded[0]);
+        codec->SetSkipUnchanged (true);
+        reduced = false;
+        retained = true;
+        polled = false;
+    }
+    // Copy the source image so that it may be encoded in later calls
     void SetSrcImage (unsigned char *src, size_t sz)
     {
         assert (src);
         assert (sz == original.size ());
+        if (!retained)
+        {
+            codec->SetSrcImage (&original[0]);
+            retained = true;
+            reduced = false;
+        }
+        // Display loops often set the same frame over and over.  Leave
+        // the source generation alone so that the codec can skip
+        // decoding it again.
+        if (reduced && equal (src, src + sz, original.begin ()))
+            return;
         copy (src, src + sz, &original[0]);
         codec->Reduce ();
+        reduced = true;
     }
-    void GetDestImage (unsigned char *dest, size_t sz)
+    // Reduce the source image without copying it.  It is only safe to
+    // do this when the image is encoded before the MEX call returns,
+    // because MATLAB owns the buffer.
+    void UseSrcImage (unsigned char *src, size_t sz)
     {
-        assert (dest);
-        assert (sz == decoded.size ());
-        copy (decoded.begin (), decoded.end (), dest);
+        assert (src);
+        assert (sz == original.size ());
+        codec->SetSrcImage (src);
+        codec->Reduce ();
+        retained = false;
+        reduced = false;
+    }
+    // Encode and decode the source image into 'dest'
+    void Encode (int x, int y, unsigned char *dest, size_t sz)
+    {
+        if (!retained)
+            throw runtime_error ("The source image must be set again");
+        Decode (x, y, dest, sz);
+    }
+    // Encode a source image that has not been copied
+    void Encode (int x, int y, unsigned char *src, unsigned char *dest, size_t sz)
+    {
+        UseSrcImage (src, sz);
+        Decode (x, y, dest, sz);
+        // The source is gone after this call, so it cannot be polled
+        polled = false;
     }
     CODEC *SVISCODEC ()
     {
@@ -56,17 +110,317 @@ class MatlabCODEC
         return codec;
     }
     private:
+    void Decode (int x, int y, unsigned char *dest, size_t sz)
+    {
+        assert (dest);
+        assert (sz == decoded.size ());
+        const unsigned long generation = codec->GetGeneration ();
+        const bool repeat = polled &&
+            x == polled_x &&
+            y == polled_y &&
+            generation == polled_generation;
+        polled = true;
+        polled_x = x;
+        polled_y = y;
+        polled_generation = generation;
+        if (repeat)
+        {
+            // The same frame is being polled.  Keep it in the private
+            // buffer, so that the next poll is only a copy.
+            codec->SetDestImage (&decoded[0]);
+            codec->Encode (x, y);
+            codec->Decode ();
+            copy (decoded.begin (), decoded.end (), dest);
+        }
+        else
+        {
+            // Decode straight into the output array
+            codec->SetDestImage (dest);
+            codec->Encode (x, y);
+            codec->Decode ();
+            // MATLAB owns the output array
+            codec->SetDestImage (&decoded[0]);
+        }
+    }
     CODEC *codec;
+    // Has 'original' been reduced?
+    bool reduced;
+    // Is the codec's source image in 'original'?
+    bool retained;
+    // The last fixation that was encoded
+    bool polled;
+    int polled_x;
+    int polled_y;
+    unsigned long polled_generation;
     vector<unsigned char> original;
     vector<unsigned char> decoded;
 };
 
-// MatlabCODEC pointers will be stored in a global container
-static vector<MatlabCODEC *> codecs;
+// Worker threads that call a function for planes 1 through n-1 while
+// the calling thread does plane 0.  The threads are started on first
+// use and live as long as the codec, so a pooled codec keeps them.
+class PlaneThreads
+{
+    public:
+    PlaneThreads (unsigned planes) :
+        planes (planes),
+        generation (0),
+        pending (0),
+        stop (false)
+    {
+    }
+    ~PlaneThreads ()
+    {
+        {
+            lock_guard<mutex> l (lock);
+            stop = true;
+        }
+        changed.notify_all ();
+        for (unsigned i = 0; i < threads.size (); ++i)
+            threads[i].join ();
+    }
+    // Call f(i) for each plane and return the error messages, which
+    // are empty for planes that succeeded
+    vector<string> Run (const function<void (unsigned)> &f)
+    {
+        vector<string> errors (planes);
+        if (threads.empty ())
+            for (unsigned i = 1; i < planes; ++i)
+                threads.push_back (thread (&PlaneThreads::Work, this, i));
+        {
+            lock_guard<mutex> l (lock);
+            job = &f;
+            this->errors = &errors;
+            pending = planes - 1;
+            ++generation;
+        }
+        changed.notify_all ();
+        try { f (0); }
+        catch (const exception &e) { errors[0] = e.what (); }
+        unique_lock<mutex> l (lock);
+        while (pending)
+            done.wait (l);
+        return errors;
+    }
+
+    private:
+    void Work (unsigned i)
+    {
+        unsigned long seen = 0;
+        unique_lock<mutex> l (lock);
+        for (;;)
+        {
+            while (generation == seen && !stop)
+                changed.wait (l);
+            if (stop)
+                return;
+            seen = generation;
+            const function<void (unsigned)> &f = *job;
+            string &error = (*errors)[i];
+            l.unlock ();
+            try { f (i); }
+            catch (const exception &e) { error = e.what (); }
+            l.lock ();
+            if (--pending == 0)
+                done.notify_one ();
+        }
+    }
+    unsigned planes;
+    const function<void (unsigned)> *job;
+    vector<string> *errors;
+    // Bumped for each call to Run, and the planes left to finish
+    unsigned long generation;
+    unsigned pending;
+    bool stop;
+    vector<thread> threads;
+    mutex lock;
+    condition_variable changed;
+    condition_variable done;
+    // Disable copying
+    PlaneThreads (const PlaneThreads &);
+    PlaneThreads &operator= (const PlaneThreads &);
+};
+
+// One MatlabCODEC per color plane.  MATLAB stores the planes of an
+// RxCxN array one after the other, so plane k starts at k*R*C.  The
+// planes share one set of masks and are encoded on their own threads.
+class MatlabPlanes
+{
+    public:
+    MatlabPlanes (unsigned width,
+        unsigned height,
+        unsigned pyramid_levels,
+        unsigned channels) :
+        plane_size (width * height),
+        workers (channels)
+    {
+        assert (channels > 0);
+        for (unsigned i = 0; i < channels; ++i)
+            planes.push_back (new MatlabCODEC (width, height, pyramid_levels));
+    }
+    ~MatlabPlanes ()
+    {
+        for (unsigned i = 0; i < planes.size (); ++i)
+            delete planes[i];
+    }
+    void Reset ()
+    {
+        for (unsigned i = 0; i < planes.size (); ++i)
+            planes[i]->Reset ();
+    }
+    unsigned Channels () const { return planes.size (); }
+    // The size of the whole array, in pixels
+    size_t Size () const { return plane_size * planes.size (); }
+    CODEC *SVISCODEC ()
+    {
+        return planes[0]->SVISCODEC ();
+    }
+    // Set the resolution map, sharing the masks of 'other' if it is
+    // not null
+    void SetResmap (unsigned width,
+        unsigned height,
+        const vector<unsigned char> &pixels,
+        const CODEC *other)
+    {
+        CODEC *first = planes[0]->SVISCODEC ();
+        if (first->HasResmap (width, height, pixels))
+            return;
+        if (other)
+            first->ShareResmap (*other);
+        else
+            first->SetResmap (width, height, pixels);
+        for (unsigned i = 1; i < planes.size (); ++i)
+            planes[i]->SVISCODEC ()->ShareResmap (*first);
+    }
+    void SetSrcImage (unsigned char *src)
+    {
+        assert (src);
+        ForEachPlane ([&] (unsigned i)
+        {
+            planes[i]->SetSrcImage (src + i * plane_size, plane_size);
+        });
+    }
+    void Encode (int x, int y, unsigned char *dest)
+    {
+        assert (dest);
+        ForEachPlane ([&] (unsigned i)
+        {
+            planes[i]->Encode (x, y, dest + i * plane_size, plane_size);
+        });
+    }
+    void Encode (int x, int y, unsigned char *src, unsigned char *dest)
+    {
+        assert (src);
+        assert (dest);
+        ForEachPlane ([&] (unsigned i)
+        {
+            planes[i]->Encode (x, y,
+                src + i * plane_size,
+                dest + i * plane_size,
+                plane_size);
+        });
+    }
+    private:
+    // Call f(i) for each plane.  Plane 0 runs on the calling thread.
+    // Errors must be reported on the calling thread, because MATLAB
+    // may not be called from any other.
+    void ForEachPlane (const function<void (unsigned)> &f)
+    {
+        const vector<string> errors = workers.Run (f);
+        for (unsigned i = 0; i < errors.size (); ++i)
+            if (!errors[i].empty ())
+                throw runtime_error (errors[i]);
+    }
+    size_t plane_size;
+    vector<MatlabCODEC *> planes;
+    PlaneThreads workers;
+};
+
+// MatlabPlanes pointers will be stored in a global container.  The
+// handle of codecs[i] is i+1.  Released handles are null and are
+// reused.
+static vector<MatlabPlanes *> codecs;
+// Released codecs are kept for reuse by new codecs of the same size,
+// most recently released last
+static vector<MatlabPlanes *> pool;
+static const size_t POOL_SIZE = 8; // codecs kept in the pool
 static const size_t LEVELS = 8; // pyramid levels in CODEC
 static bool g_init = false;
 static bool g_debug = false;
 
+// Take a codec of the given size from the pool, or allocate one
+static MatlabPlanes *Allocate (unsigned width, unsigned height, unsigned channels)
+{
+    for (size_t i = pool.size (); i-- > 0; )
+    {
+        CODEC *c = pool[i]->SVISCODEC ();
+        if (c->GetWidth () == width &&
+            c->GetHeight () == height &&
+            pool[i]->Channels () == channels)
+        {
+            MatlabPlanes *p = pool[i];
+            pool.erase (pool.begin () + i);
+            // A new handle starts out like a new codec
+            p->Reset ();
+            return p;
+        }
+    }
+    return new MatlabPlanes (width, height, LEVELS, channels);
+}
+
+// Put a codec in the first free slot and return its handle
+static size_t Insert (MatlabPlanes *p)
+{
+    size_t i = find (codecs.begin (), codecs.end (),
+        static_cast<MatlabPlanes *> (0)) - codecs.begin ();
+    if (i == codecs.size ())
+        codecs.push_back (p);
+    else
+        codecs[i] = p;
+    return i + 1;
+}
+
+// Move a codec into the pool
+static void Release (size_t c)
+{
+    assert (codecs[c]);
+    pool.push_back (codecs[c]);
+    codecs[c] = 0;
+    if (pool.size () > POOL_SIZE)
+    {
+        delete pool.front ();
+        pool.erase (pool.begin ());
+    }
+    while (!codecs.empty () && !codecs.back ())
+        codecs.pop_back ();
+}
+
+// Find a codec, in use or pooled, whose masks were made from a
+// resolution map
+static const CODEC *FindResmap (unsigned width,
+    unsigned height,
+    const vector<unsigned char> &pixels)
+{
+    for (size_t i = 0; i < codecs.size (); ++i)
+        if (codecs[i] && codecs[i]->SVISCODEC ()->HasResmap (width, height, pixels))
+            return codecs[i]->SVISCODEC ();
+    for (size_t i = 0; i < pool.size (); ++i)
+        if (pool[i]->SVISCODEC ()->HasResmap (width, height, pixels))
+            return pool[i]->SVISCODEC ();
+    return 0;
+}
+
+// Return the zero based index of codec handle 'C'
+static size_t GetHandle (const mxArray *a)
+{
+    size_t c = static_cast<size_t> (*mxGetPr (a));
+
+    if (c < 1 || c > codecs.size () || !codecs[c - 1])
+        mexErrMsgTxt ("Invalid value for 'C'");
+
+    return c - 1; // Make it zero based
+}
+
 void svisinit (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
     if (nrhs > 0)
@@ -93,11 +447,29 @@ void svisinit (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
     // Clear it
     codecs.clear ();
+    for (size_t i = 0; i < pool.size (); ++i)
+        delete pool[i];
+    pool.clear ();
     g_init = true;
 }
 
 void svisrelease (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
+    // Release a single codec
+    if (nrhs > 0)
+    {
+        if (!g_init)
+            mexErrMsgTxt ("You must call svisinit");
+
+        size_t c = GetHandle (prhs[0]);
+
+        if (g_debug)
+            mexPrintf ("-svisrelease: c=%d\n", c+1);
+
+        Release (c);
+        return;
+    }
+
     if (g_debug)
         mexPrintf ("-svisrelease\n");
 
@@ -105,16 +477,31 @@ void svisrelease (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     g_init = false;
 }
 
-void sviscodec (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+// Check that an image is RxC for grayscale codecs, or RxCx3 for color
+// codecs, and return its number of pixels
+static size_t GetImageSize (const mxArray *a, unsigned channels, const char *msg)
+{
+    int ndims = mxGetNumberOfDimensions (a);
+    const int *dims = mxGetDimensions (a);
+
+    if (channels == 1 && ndims != 2)
+        mexErrMsgTxt (msg);
+    if (channels > 1 && (ndims != 3 || dims[2] != static_cast<int> (channels)))
+        mexErrMsgTxt (msg);
+
+    return static_cast<size_t> (dims[0]) * dims[1] * channels;
+}
+
+// Create a codec for an RxC or RxCx3 image
+static void CreateCODEC (mxArray *plhs[], const mxArray *prhs[], unsigned channels)
 {
     if (!g_init)
         mexErrMsgTxt ("You must call svisinit");
 
     // Src image
-    int ndims = mxGetNumberOfDimensions (prhs[0]);
-
-    if (ndims != 2)
-        mexErrMsgTxt ("Input 1 must be a 2D image");
+    GetImageSize (prhs[0], channels, channels == 1 ?
+        "Input 1 must be a 2D image" :
+        "Input 1 must be an RxCx3 image");
 
     const int *dims = mxGetDimensions (prhs[0]);
 
@@ -124,13 +511,16 @@ void sviscodec (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     unsigned char *src = static_cast <unsigned char *> (mxGetData (prhs[0]));
 
     if (g_debug)
-        mexPrintf ("-sviscodec, rows=%d,cols=%d,src=%p\n", rows, cols, src);
+        mexPrintf ("-sviscodec, rows=%d,cols=%d,channels=%d,src=%p\n", rows, cols, channels, src);
 
+    size_t handle = 0;
     try
     {
-        MatlabCODEC *c = new MatlabCODEC (rows, cols, LEVELS);
-        codecs.push_back (c);
-        codecs.back ()->SetSrcImage (src, rows * cols);
+        // Only a codec that was set up is given a handle
+        unique_ptr<MatlabPlanes> c (Allocate (cols, rows, channels));
+        c->SetSrcImage (src);
+        handle = Insert (c.get ());
+        c.release ();
     }
     catch (const exception &e)
     {
@@ -140,41 +530,36 @@ void sviscodec (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     // Create a scalar and put a handle into it
     const int d[2] = { 1, 1 };
     plhs[0] = mxCreateNumericArray (2, d, mxDOUBLE_CLASS, mxREAL);
-    *mxGetPr (plhs[0]) = static_cast<double> (codecs.size ());
+    *mxGetPr (plhs[0]) = static_cast<double> (handle);
 }
 
-void svissetresmap (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+// Set the source image of a codec
+static void SetSrc (const mxArray *prhs[], unsigned channels)
 {
     if (!g_init)
         mexErrMsgTxt ("You must call svisinit");
 
-    size_t c = static_cast<size_t> (*mxGetPr (prhs[0]));
-
-    if (c < 1 || c > codecs.size ())
-        mexErrMsgTxt ("Invalid value for 'C'");
-
-    --c; // Make it zero based
-
-    int ndims = mxGetNumberOfDimensions (prhs[1]);
-
-    if (ndims != 2)
-        mexErrMsgTxt ("Input 2 must be a 2D resmap");
+    size_t c = GetHandle (prhs[0]);
 
-    const int *dims = mxGetDimensions (prhs[1]);
+    if (codecs[c]->Channels () != channels)
+        mexErrMsgTxt (channels == 1 ?
+            "Use svissetsrcrgb with color codecs" :
+            "Use svissetsrc with grayscale codecs");
 
-    size_t rows = dims[0];
-    size_t cols = dims[1];
-    unsigned char *resmap = static_cast <unsigned char *> (mxGetData (prhs[1]));
+    size_t sz = GetImageSize (prhs[1], channels, channels == 1 ?
+        "Input 2 must be a 2D image" :
+        "Input 2 must be an RxCx3 image");
+    unsigned char *src = static_cast <unsigned char *> (mxGetData (prhs[1]));
 
     if (g_debug)
-        mexPrintf ("-svissetresmap: c=%d,rows=%d,cols=%d,resmap=%p\n", c+1, rows, cols, resmap);
+        mexPrintf ("-svissetsrc: c=%d,channels=%d,src=%p\n", c+1, channels, src);
+
+    if (codecs[c]->Size () != sz)
+        mexErrMsgTxt ("The input image is not the correct size");
 
     try
     {
-        // This copy is inefficient, but you will also have to create
-        // some large masks from the resmap...
-        vector<unsigned char> v (&resmap[0], &resmap[rows * cols]);
-        codecs[c]->SVISCODEC ()->SetResmap (rows, cols, v);
+        codecs[c]->SetSrcImage (src);
     }
     catch (const exception &e)
     {
@@ -182,38 +567,48 @@ void svissetresmap (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
 }
 
-void svissetsrc (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+// Encode a codec's source image, or an optional 4th source argument
+static void Encode (mxArray *plhs[], int nrhs, const mxArray *prhs[], unsigned channels)
 {
     if (!g_init)
         mexErrMsgTxt ("You must call svisinit");
 
-    size_t c = static_cast<size_t> (*mxGetPr (prhs[0]));
-
-    if (c < 1 || c > codecs.size ())
-        mexErrMsgTxt ("Invalid value for 'C'");
-
-    --c; // Make it zero based
-
-    int ndims = mxGetNumberOfDimensions (prhs[1]);
-
-    if (ndims != 2)
-        mexErrMsgTxt ("Input 2 must be a 2D image");
+    size_t c = GetHandle (prhs[0]);
+    int row = static_cast<int> (*mxGetPr (prhs[1]));
+    int col = static_cast<int> (*mxGetPr (prhs[2]));
 
-    const int *dims = mxGetDimensions (prhs[1]);
+    if (codecs[c]->Channels () != channels)
+        mexErrMsgTxt (channels == 1 ?
+            "Use svisencodergb with color codecs" :
+            "Use svisencode with grayscale codecs");
 
-    size_t rows = dims[0];
-    size_t cols = dims[1];
-    unsigned char *src = static_cast <unsigned char *> (mxGetData (prhs[1]));
+    // An optional source image
+    unsigned char *src = 0;
+    if (nrhs > 3)
+    {
+        size_t sz = GetImageSize (prhs[3], channels, channels == 1 ?
+            "Input 4 must be a 2D image" :
+            "Input 4 must be an RxCx3 image");
+        if (codecs[c]->Size () != sz)
+            mexErrMsgTxt ("The input image is not the correct size");
+        src = static_cast <unsigned char *> (mxGetData (prhs[3]));
+    }
 
     if (g_debug)
-        mexPrintf ("-svissetsrc: c=%d,rows=%d,cols=%d,src=%p\n", c+1, rows, cols, src);
-
-    if (codecs[c]->SVISCODEC ()->GetImageSize () != rows * cols)
-        mexErrMsgTxt ("The input image is not the correct size");
+        mexPrintf ("-svisencode: c=%d,row=%d,col=%d,channels=%d,src=%p\n", c+1, row, col, channels, src);
 
     try
     {
-        codecs[c]->SetSrcImage (src, rows * cols);
+        // Create the output matrix and decode straight into it
+        const int dims[3] = { static_cast<int> (codecs[c]->SVISCODEC ()->GetHeight ()),
+            static_cast<int> (codecs[c]->SVISCODEC ()->GetWidth ()),
+            static_cast<int> (channels) };
+        plhs[0] = mxCreateNumericArray (channels == 1 ? 2 : 3, dims, mxUINT8_CLASS, mxREAL);
+        unsigned char *dest = static_cast<unsigned char *> (mxGetData (plhs[0]));
+        if (src)
+            codecs[c]->Encode (col, row, src, dest);
+        else
+            codecs[c]->Encode (col, row, dest);
     }
     catch (const exception &e)
     {
@@ -221,38 +616,66 @@ void svissetsrc (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
 }
 
-void svisencode (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+void sviscodec (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    CreateCODEC (plhs, prhs, 1);
+}
+
+void sviscodecrgb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    CreateCODEC (plhs, prhs, 3);
+}
+
+void svissetresmap (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
     if (!g_init)
         mexErrMsgTxt ("You must call svisinit");
 
-    size_t c = static_cast<size_t> (*mxGetPr (prhs[0]));
-    int row = static_cast<int> (*mxGetPr (prhs[1]));
-    int col = static_cast<int> (*mxGetPr (prhs[2]));
+    size_t c = GetHandle (prhs[0]);
 
-    if (c < 1 || c > codecs.size ())
-        mexErrMsgTxt ("Invalid value for 'C'");
+    int ndims = mxGetNumberOfDimensions (prhs[1]);
+
+    if (ndims != 2)
+        mexErrMsgTxt ("Input 2 must be a 2D resmap");
 
-    --c; // Make it zero based
+    const int *dims = mxGetDimensions (prhs[1]);
+
+    size_t rows = dims[0];
+    size_t cols = dims[1];
+    unsigned char *resmap = static_cast <unsigned char *> (mxGetData (prhs[1]));
 
     if (g_debug)
-        mexPrintf ("-svisencode: c=%d,row=%d,col=%d\n", c+1, row, col);
+        mexPrintf ("-svissetresmap: c=%d,rows=%d,cols=%d,resmap=%p\n", c+1, rows, cols, resmap);
 
     try
     {
-        codecs[c]->SVISCODEC ()->Encode (row, col);
-        codecs[c]->SVISCODEC ()->Decode ();
-
-        // Create a matrix and copy the decoded image to it
-        const int dims[2] = { codecs[c]->SVISCODEC ()->GetWidth (),
-            codecs[c]->SVISCODEC ()->GetHeight () };
-        plhs[0] = mxCreateNumericArray (2, dims, mxUINT8_CLASS, mxREAL);
-        codecs[c]->GetDestImage (
-            static_cast<unsigned char *> (mxGetData (plhs[0])),
-            static_cast<size_t> (dims[0] * dims[1]));
+        // This copy is inefficient, but you will also have to create
+        // some large masks from the resmap...
+        vector<unsigned char> v (&resmap[0], &resmap[rows * cols]);
+        codecs[c]->SetResmap (cols, rows, v, FindResmap (cols, rows, v));
     }
     catch (const exception &e)
     {
         mexErrMsgTxt (e.what ());
     }
 }
+
+void svissetsrc (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    SetSrc (prhs, 1);
+}
+
+void svissetsrcrgb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    SetSrc (prhs, 3);
+}
+
+void svisencode (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    Encode (plhs, nrhs, prhs, 1);
+}
+
+void svisencodergb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    Encode (plhs, nrhs, prhs, 3);
+}
@@ -27,14 +27,19 @@ void svisrelease (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
 void svisrelease_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
     // Check inputs
-    if (nrhs != 0)
-        mexErrMsgTxt ("This function requires 0 arguments.");
+    if (nrhs > 1)
+        mexErrMsgTxt ("This function requires 0 or 1 arguments.");
 
     // Check outputs
     if (nlhs > 1)
         mexErrMsgTxt ("Too many return values were specified.");
 
     // Check input types
+    if (nrhs > 0 && !mxIsDouble (prhs[0]))
+        mexErrMsgTxt ("Input 1 must be double.");
+    if (nrhs > 0 && mxIsComplex (prhs[0]))
+        mexErrMsgTxt ("Input 1 may not be complex.");
+
     svisrelease (nlhs, plhs, nrhs, prhs);
 
     // Check output types
@@ -125,8 +130,8 @@ void svisencode (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
 void svisencode_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
     // Check inputs
-    if (nrhs != 3)
-        mexErrMsgTxt ("This function requires 3 arguments.");
+    if (nrhs < 3 || nrhs > 4)
+        mexErrMsgTxt ("This function requires 3 or 4 arguments.");
 
     // Check outputs
     if (nlhs > 1)
@@ -148,6 +153,9 @@ void svisencode_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs
     if (mxIsComplex (prhs[2]))
         mexErrMsgTxt ("Input 3 may not be complex.");
 
+    if (nrhs > 3 && !mxIsUint8 (prhs[3]))
+        mexErrMsgTxt ("Input 4 must be uint8.");
+
     svisencode (nlhs, plhs, nrhs, prhs);
 
     // Check output types
@@ -158,6 +166,101 @@ void svisencode_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs
 
 }
 
+void sviscodecrgb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+void sviscodecrgb_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    // Check inputs
+    if (nrhs != 1)
+        mexErrMsgTxt ("This function requires 1 arguments.");
+
+    // Check outputs
+    if (nlhs > 1)
+        mexErrMsgTxt ("Too many return values were specified.");
+
+    // Check input types
+    if (!mxIsUint8 (prhs[0]))
+        mexErrMsgTxt ("Input 1 must be uint8.");
+
+    sviscodecrgb (nlhs, plhs, nrhs, prhs);
+
+    // Check output types
+    if (!plhs[0])
+        mexErrMsgTxt ("Output 1 was not allocated.");
+    if (!mxIsDouble (plhs[0]))
+        mexErrMsgTxt ("Output 1 must be double.");
+    if (mxIsComplex (plhs[0]))
+        mexErrMsgTxt ("Output 1 may not be complex.");
+
+}
+
+void svissetsrcrgb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+void svissetsrcrgb_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    // Check inputs
+    if (nrhs != 2)
+        mexErrMsgTxt ("This function requires 2 arguments.");
+
+    // Check outputs
+    if (nlhs > 1)
+        mexErrMsgTxt ("Too many return values were specified.");
+
+    // Check input types
+    if (!mxIsDouble (prhs[0]))
+        mexErrMsgTxt ("Input 1 must be double.");
+    if (mxIsComplex (prhs[0]))
+        mexErrMsgTxt ("Input 1 may not be complex.");
+
+    if (!mxIsUint8 (prhs[1]))
+        mexErrMsgTxt ("Input 2 must be uint8.");
+
+    svissetsrcrgb (nlhs, plhs, nrhs, prhs);
+
+    // Check output types
+}
+
+void svisencodergb (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
+
+void svisencodergb_mexgen (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+    // Check inputs
+    if (nrhs < 3 || nrhs > 4)
+        mexErrMsgTxt ("This function requires 3 or 4 arguments.");
+
+    // Check outputs
+    if (nlhs > 1)
+        mexErrMsgTxt ("Too many return values were specified.");
+
+    // Check input types
+    if (!mxIsDouble (prhs[0]))
+        mexErrMsgTxt ("Input 1 must be double.");
+    if (mxIsComplex (prhs[0]))
+        mexErrMsgTxt ("Input 1 may not be complex.");
+
+    if (!mxIsDouble (prhs[1]))
+        mexErrMsgTxt ("Input 2 must be double.");
+    if (mxIsComplex (prhs[1]))
+        mexErrMsgTxt ("Input 2 may not be complex.");
+
+    if (!mxIsDouble (prhs[2]))
+        mexErrMsgTxt ("Input 3 must be double.");
+    if (mxIsComplex (prhs[2]))
+        mexErrMsgTxt ("Input 3 may not be complex.");
+
+    if (nrhs > 3 && !mxIsUint8 (prhs[3]))
+        mexErrMsgTxt ("Input 4 must be uint8.");
+
+    svisencodergb (nlhs, plhs, nrhs, prhs);
+
+    // Check output types
+    if (!plhs[0])
+        mexErrMsgTxt ("Output 1 was not allocated.");
+    if (!mxIsUint8 (plhs[0]))
+        mexErrMsgTxt ("Output 1 must be uint8.");
+
+}
+
 typedef void (*MEXFUNCTION) (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[]);
 
 MEXFUNCTION functions[] =
@@ -168,6 +271,9 @@ MEXFUNCTION functions[] =
     svissetresmap_mexgen,
     svissetsrc_mexgen,
     svisencode_mexgen,
+    sviscodecrgb_mexgen,
+    svissetsrcrgb_mexgen,
+    svisencodergb_mexgen,
 };
 
 static const int MAX_FUNCTIONS = sizeof (functions) / sizeof (void (*) ());
@@ -1,12 +1,26 @@
-function svisrelease_mexgen ()
+function svisrelease_mexgen (varargin)
 % SVISRELEASE   Release the SVIS toolbox
 %
 % Call SVISRELEASE in order to release resources previously allocated
 % by the SVIS toolbox.
 %
-% SEE ALSO: SVISINIT
+% SVISRELEASE(C) releases only codec C.  Its handle may be returned by
+% a later call to SVISCODEC or SVISCODECRGB.  Released codecs are kept
+% for reuse, so creating a codec of the same size, with the same
+% resolution map, is much faster than creating the first one:
+%
+%     svisinit
+%     for trial=1:trials
+%         c=sviscodec(images(:,:,trial));
+%         svissetresmap(c,resmap);
+%         ...
+%         svisrelease(c);
+%     end
+%     svisrelease
+%
+% SEE ALSO: SVISINIT, SVISCODEC
 
 % Mexgen generated this file on Wed Jun  8 12:23:58 2011
 % DO NOT EDIT!
 
-svismex (1);
+svismex (1, varargin{:});
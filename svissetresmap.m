@@ -8,7 +8,10 @@ function svissetresmap_mexgen (rhs1, rhs2)
 % Pixels in R represent image resolution values where 255 is
 % the highest resolution and 0 is the lowest resolution.
 %
-% SEE ALSO: SVISCODEC, SVISRESMAP
+% The resolution map of a color codec from SVISCODECRGB is shared by
+% all three color planes.
+%
+% SEE ALSO: SVISCODEC, SVISCODECRGB, SVISRESMAP
 
 % Mexgen generated this file on Wed Jun  8 12:23:58 2011
 % DO NOT EDIT!
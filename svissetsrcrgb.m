@@ -0,0 +1,15 @@
+function svissetsrcrgb_mexgen (rhs1, rhs2)
+% SVISSETSRCRGB Set a color codec's source image
+%
+% SVISSETSRCRGB(C,SRC) sets color codec C's source image to the RxCx3
+% image SRC.
+%
+% The image SRC must be of type UINT8, and its dimensions must match
+% those of the image specified in SVISCODECRGB.
+%
+% SEE ALSO: SVISCODECRGB, SVISENCODERGB, SVISSETSRC
+
+% Mexgen generated this file on Wed Jun  8 12:23:58 2011
+% DO NOT EDIT!
+
+svismex (7, rhs1, rhs2);
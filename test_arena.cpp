@@ -0,0 +1,91 @@
+// Test aligned image storage
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include <iostream>
+#include "verify.h"
+#include "arena.h"
+#include "foveate.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace SVIS;
+
+static bool Aligned (const void *p, size_t alignment)
+{
+    return reinterpret_cast<size_t> (p) % alignment == 0;
+}
+
+void test1 ()
+{
+    VERIFY (Arena::Pitch (1) == Arena::VECTOR_WIDTH);
+    VERIFY (Arena::Pitch (Arena::VECTOR_WIDTH) == Arena::VECTOR_WIDTH);
+    VERIFY (Arena::Pitch (Arena::VECTOR_WIDTH + 1) == 2 * Arena::VECTOR_WIDTH);
+    VERIFY (Arena::Size (1, 1) == Arena::CACHE_LINE);
+
+    Arena a (false);
+    a.Reset (1000);
+    VERIFY (a.Capacity () >= 1000);
+    unsigned char *p1 = a.Allocate (100);
+    unsigned char *p2 = a.Allocate (1);
+    VERIFY (Aligned (p1, Arena::CACHE_LINE));
+    VERIFY (Aligned (p2, Arena::CACHE_LINE));
+    VERIFY (p2 >= p1 + 100);
+    for (unsigned i = 0; i < 100; ++i)
+        VERIFY (p1[i] == 0);
+
+    // Allocations are zeroed when the memory is reused
+    p1[0] = 1;
+    a.Reset (500);
+    VERIFY (a.Used () == 0);
+    VERIFY (a.Allocate (100) == p1);
+    VERIFY (p1[0] == 0);
+
+    // Running out is an error
+    bool failed = false;
+    try { a.Allocate (a.Capacity ()); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // Huge blocks are aligned to huge pages
+    Arena b;
+    b.Reset (Arena::HUGE_PAGE);
+    VERIFY (Aligned (b.Allocate (1), Arena::HUGE_PAGE));
+}
+
+void test2 ()
+{
+    // Every pyramid level but the base is aligned and padded
+    const unsigned W = 333;
+    const unsigned H = 111;
+    vector<unsigned char> pixels (W * H);
+    Image base = { W, H, 0, &pixels[0] };
+    FoveationPyramid p;
+    p.Create (base, 6);
+    VERIFY (p.images[0].pixels == &pixels[0]);
+    VERIFY (Pitch (p.images[0]) == W);
+    for (unsigned n = 1; n < p.levels; ++n)
+    {
+        VERIFY (Aligned (p.images[n].pixels, Arena::CACHE_LINE));
+        VERIFY (Pitch (p.images[n]) % Arena::VECTOR_WIDTH == 0);
+        VERIFY (Pitch (p.images[n]) >= (W >> n));
+    }
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,470 @@
+// Test bitstream routines
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include <algorithm>
+#include "bitstream.h"
+#include <cstdlib>
+#include <iostream>
+#include "verify.h"
+#include "pnm_util.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace SVIS;
+
+void test1 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    VERIFY (src_image.GetPixelDepth () == 1);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> received (W * H, 0);
+
+    Image src = { W, H, 0, src_image.GetPixelsAddress () };
+    Image d1 = { W, H, 0, &dest1[0] };
+    Image d2 = { W, H, 0, &dest2[0] };
+    Image r = { W, H, 0, &received[0] };
+
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    const unsigned LEVELS = 5;
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+
+    FoveationPyramid src_p;
+    FoveationPyramid dest1_p;
+    FoveationPyramid dest2_p;
+    FoveationPyramid received_p;
+    src_p.Create (src, LEVELS);
+    dest1_p.Create (d1, LEVELS);
+    dest2_p.Create (d2, LEVELS);
+    received_p.Create (r, LEVELS);
+    src_p.Reduce ();
+
+    const int x[] = { int (W / 3), 0, int (W), -100 };
+    const int y[] = { int (H / 2), 0, int (H), int (3 * H / 4) };
+    for (unsigned f = 0; f < sizeof (x) / sizeof (x[0]); ++f)
+    {
+        FoveationEncode (src_p, masks, x[f], y[f]);
+        FoveationDecode (src_p, masks, dest1_p);
+
+        for (int coding = BITSTREAM_RAW; coding <= BITSTREAM_RANS; ++coding)
+        {
+            vector<unsigned char> stream;
+            WriteBitstream (src_p, false, stream, BitstreamCoding (coding));
+            // The stream is smaller than the image
+            VERIFY (stream.size () < W * H);
+
+            BitstreamHeader h;
+            ReadBitstreamHeader (&stream[0], stream.size (), h);
+            VERIFY (h.version == 2);
+            VERIFY (!h.column_major);
+            VERIFY (h.coding == coding);
+            VERIFY (h.levels == LEVELS);
+            VERIFY (h.width == W);
+            VERIFY (h.height == H);
+            VERIFY (h.fixation_x == x[f]);
+            VERIFY (h.fixation_y == y[f]);
+
+            // Decode from the stream and the masks alone
+            ReadBitstream (&stream[0], stream.size (), received_p);
+            VERIFY (received_p.fixation_x == x[f]);
+            VERIFY (received_p.fixation_y == y[f]);
+            FoveationEncode (received_p, masks, received_p.fixation_x, received_p.fixation_y);
+            FoveationDecode (received_p, masks, dest2_p);
+            VERIFY (dest1 == dest2);
+            fill (dest2.begin (), dest2.end (), 0);
+        }
+    }
+
+    // Compression makes the stream smaller
+    vector<unsigned char> raw;
+    vector<unsigned char> compressed;
+    WriteBitstream (src_p, false, raw, BITSTREAM_RAW);
+    WriteBitstream (src_p, false, compressed, BITSTREAM_RANS);
+    VERIFY (compressed.size () < raw.size ());
+}
+
+void test2 ()
+{
+    vector<unsigned char> pixels (64 * 48);
+    Image base = { 64, 48, 0, &pixels[0] };
+    FoveationPyramid p;
+    p.Create (base, 3);
+    SVIS::AutoImage resmap = { 128, 96, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    FoveationMasks masks;
+    masks.Create (resmap, 2);
+    FoveationEncode (p, masks, 32, 24);
+    vector<unsigned char> stream;
+    WriteBitstream (p, true, stream);
+    BitstreamHeader h;
+    ReadBitstreamHeader (&stream[0], stream.size (), h);
+    VERIFY (h.column_major);
+
+    // Truncated streams are errors
+    vector<unsigned char> compressed;
+    WriteBitstream (p, true, compressed, BITSTREAM_RANS);
+    for (size_t size = 0; size < stream.size (); size += 7)
+    {
+        bool failed = false;
+        try { ReadBitstream (&stream[0], size, p); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+    for (size_t size = 0; size < compressed.size (); ++size)
+    {
+        bool failed = false;
+        try { ReadBitstream (&compressed[0], size, p); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+
+    // So are streams that are not bitstreams
+    vector<unsigned char> bad (stream);
+    bad[0] = 'X';
+    bool failed = false;
+    try { ReadBitstreamHeader (&bad[0], bad.size (), h); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // Or have an unknown version
+    bad = stream;
+    bad[4] = 3;
+    failed = false;
+    try { ReadBitstreamHeader (&bad[0], bad.size (), h); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // A version 1 stream is raw
+    bad = stream;
+    bad[4] = 1;
+    ReadBitstreamHeader (&bad[0], bad.size (), h);
+    VERIFY (h.version == 1);
+    VERIFY (h.coding == BITSTREAM_RAW);
+    ReadBitstream (&bad[0], bad.size (), p);
+    bad = compressed;
+    bad[4] = 1;
+    failed = false;
+    try { ReadBitstreamHeader (&bad[0], bad.size (), h); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // And streams that do not fit the pyramid
+    vector<unsigned char> small (32 * 24);
+    Image small_base = { 32, 24, 0, &small[0] };
+    FoveationPyramid q;
+    q.Create (small_base, 3);
+    failed = false;
+    try { ReadBitstream (&stream[0], stream.size (), q); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test3 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    vector<unsigned char> frame (src_image.GetPixelsAddress (), src_image.GetPixelsAddress () + W * H);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> received (W * H);
+    vector<unsigned char> reference (W * H);
+    Image src = { W, H, 0, &frame[0] };
+    Image d1 = { W, H, 0, &dest1[0] };
+    Image d2 = { W, H, 0, &dest2[0] };
+    Image r = { W, H, 0, &received[0] };
+    Image ref = { W, H, 0, &reference[0] };
+
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    const unsigned LEVELS = 5;
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+    FoveationPyramid src_p;
+    FoveationPyramid dest1_p;
+    FoveationPyramid dest2_p;
+    FoveationPyramid received_p;
+    FoveationPyramid reference_p;
+    src_p.Create (src, LEVELS);
+    dest1_p.Create (d1, LEVELS);
+    dest2_p.Create (d2, LEVELS);
+    received_p.Create (r, LEVELS);
+    reference_p.Create (ref, LEVELS);
+
+    for (int coding = BITSTREAM_RAW; coding <= BITSTREAM_RANS; ++coding)
+    {
+        // Send a keyframe, then the same frame, then a frame with a
+        // small change, then a frame at another fixation
+        size_t sizes[4];
+        for (unsigned f = 0; f < 4; ++f)
+        {
+            if (f == 2)
+                for (unsigned y = H / 2; y < H / 2 + 8; ++y)
+                    for (unsigned x = W / 3; x < W / 3 + 8; ++x)
+                        frame[y * W + x] ^= 0x55;
+            src_p.Reduce ();
+            FoveationEncode (src_p, masks, f == 3 ? W / 4 : W / 3, H / 2);
+            FoveationDecode (src_p, masks, dest1_p);
+            vector<unsigned char> stream;
+            WriteBitstream (src_p, false, stream, BitstreamCoding (coding), reference_p, f == 0);
+            BitstreamHeader h;
+            ReadBitstreamHeader (&stream[0], stream.size (), h);
+            VERIFY (h.inter == (f != 0));
+            sizes[f] = stream.size ();
+            ReadBitstream (&stream[0], stream.size (), received_p);
+            FoveationEncode (received_p, masks, received_p.fixation_x, received_p.fixation_y);
+            FoveationDecode (received_p, masks, dest2_p);
+            VERIFY (dest1 == dest2);
+        }
+        // Unchanged blocks are skipped
+        VERIFY (sizes[1] < sizes[0] / 10);
+        VERIFY (sizes[1] < sizes[2]);
+        VERIFY (sizes[2] < sizes[0] / 2);
+    }
+
+    // Small changes are skipped with a threshold
+    vector<unsigned char> stream;
+    WriteBitstream (src_p, false, stream, BITSTREAM_RAW, reference_p, true);
+    ReadBitstream (&stream[0], stream.size (), received_p);
+    size_t keyframe_size = stream.size ();
+    for (unsigned i = 0; i < frame.size (); i += 3)
+        frame[i] = frame[i] < 255 ? frame[i] + 1 : 254;
+    src_p.Reduce ();
+    stream.clear ();
+    WriteBitstream (src_p, false, stream, BITSTREAM_RAW, reference_p, false, 1);
+    VERIFY (stream.size () < keyframe_size / 10);
+    ReadBitstream (&stream[0], stream.size (), received_p);
+    stream.clear ();
+    WriteBitstream (src_p, false, stream, BITSTREAM_RAW, reference_p, false, 0);
+    VERIFY (stream.size () > keyframe_size / 2);
+    ReadBitstream (&stream[0], stream.size (), received_p);
+    FoveationEncode (received_p, masks, received_p.fixation_x, received_p.fixation_y);
+    FoveationDecode (received_p, masks, dest2_p);
+    FoveationDecode (src_p, masks, dest1_p);
+    VERIFY (dest1 == dest2);
+}
+
+void test4 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> residuals (W * H);
+    vector<unsigned char> received (W * H);
+    vector<unsigned char> reference (W * H);
+    Image src = { W, H, 0, src_image.GetPixelsAddress () };
+    Image d1 = { W, H, 0, &dest1[0] };
+    Image d2 = { W, H, 0, &dest2[0] };
+    Image res = { W, H, 0, &residuals[0] };
+    Image r = { W, H, 0, &received[0] };
+    Image ref = { W, H, 0, &reference[0] };
+
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    const unsigned LEVELS = 5;
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+    FoveationPyramid src_p;
+    FoveationPyramid dest1_p;
+    FoveationPyramid dest2_p;
+    FoveationPyramid residual_p;
+    FoveationPyramid received_p;
+    FoveationPyramid reference_p;
+    src_p.Create (src, LEVELS);
+    dest1_p.Create (d1, LEVELS);
+    dest2_p.Create (d2, LEVELS);
+    residual_p.Create (res, LEVELS);
+    received_p.Create (r, LEVELS);
+    reference_p.Create (ref, LEVELS);
+    src_p.Reduce ();
+    FoveationEncode (src_p, masks, W / 3, H / 2);
+    FoveationResidual (src_p, masks, dest1_p, residual_p);
+
+    for (int coding = BITSTREAM_RAW; coding <= BITSTREAM_RANS; ++coding)
+    {
+        vector<unsigned char> stream;
+        WriteBitstream (residual_p, false, stream, BitstreamCoding (coding));
+        BitstreamHeader h;
+        ReadBitstreamHeader (&stream[0], stream.size (), h);
+        VERIFY (h.residual);
+        VERIFY (h.coding == coding);
+        ReadBitstream (&stream[0], stream.size (), received_p);
+        VERIFY (received_p.residual);
+        FoveationEncode (received_p, masks, received_p.fixation_x, received_p.fixation_y);
+        FoveationDecode (received_p, masks, dest2_p);
+        VERIFY (dest1 == dest2);
+        fill (dest2.begin (), dest2.end (), 0);
+    }
+
+    // Residuals compress better than pixels
+    vector<unsigned char> pixels;
+    vector<unsigned char> laplacian;
+    WriteBitstream (src_p, false, pixels, BITSTREAM_RANS);
+    WriteBitstream (residual_p, false, laplacian, BITSTREAM_RANS);
+    VERIFY (laplacian.size () < pixels.size ());
+
+    // Inter frames of residuals follow a keyframe of residuals
+    vector<unsigned char> stream;
+    WriteBitstream (residual_p, false, stream, BITSTREAM_RANS, reference_p, true);
+    ReadBitstream (&stream[0], stream.size (), received_p);
+    stream.clear ();
+    WriteBitstream (residual_p, false, stream, BITSTREAM_RANS, reference_p, false);
+    ReadBitstream (&stream[0], stream.size (), received_p);
+    FoveationEncode (received_p, masks, received_p.fixation_x, received_p.fixation_y);
+    FoveationDecode (received_p, masks, dest2_p);
+    VERIFY (dest1 == dest2);
+    // but not a keyframe of pixels
+    vector<unsigned char> keyframe;
+    WriteBitstream (src_p, false, keyframe, BITSTREAM_RANS);
+    ReadBitstream (&keyframe[0], keyframe.size (), received_p);
+    VERIFY (!received_p.residual);
+    bool failed = false;
+    try { ReadBitstream (&stream[0], stream.size (), received_p); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+// Return the mean absolute difference between two images over a
+// window
+double Difference (const vector<unsigned char> &a,
+    const vector<unsigned char> &b,
+    unsigned width,
+    unsigned x1,
+    unsigned y1,
+    unsigned x2,
+    unsigned y2)
+{
+    double sum = 0.0;
+    for (unsigned y = y1; y < y2; ++y)
+        for (unsigned x = x1; x < x2; ++x)
+            sum += abs (a[y * width + x] - b[y * width + x]);
+    return sum / ((x2 - x1) * (y2 - y1));
+}
+
+void test5 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> received (W * H);
+    Image src = { W, H, 0, src_image.GetPixelsAddress () };
+    Image d1 = { W, H, 0, &dest1[0] };
+    Image d2 = { W, H, 0, &dest2[0] };
+    Image r = { W, H, 0, &received[0] };
+
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    const unsigned LEVELS = 5;
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+    FoveationPyramid src_p;
+    FoveationPyramid dest1_p;
+    FoveationPyramid dest2_p;
+    FoveationPyramid received_p;
+    src_p.Create (src, LEVELS);
+    dest1_p.Create (d1, LEVELS);
+    dest2_p.Create (d2, LEVELS);
+    received_p.Create (r, LEVELS);
+    src_p.Reduce ();
+    const unsigned X = W / 3;
+    const unsigned Y = H / 2;
+    FoveationEncode (src_p, masks, X, Y);
+    FoveationDecode (src_p, masks, dest1_p);
+
+    size_t sizes[2];
+    for (int coding = BITSTREAM_RAW; coding <= BITSTREAM_RANS; ++coding)
+    {
+        vector<unsigned char> stream;
+        WriteProgressiveBitstream (src_p, false, stream, BitstreamCoding (coding));
+        sizes[coding] = stream.size ();
+        BitstreamHeader h;
+        ReadBitstreamHeader (&stream[0], stream.size (), h);
+        VERIFY (h.progressive);
+        VERIFY (!h.inter);
+        VERIFY (h.coding == coding);
+        // The top level comes first
+        VERIFY (stream[BITSTREAM_HEADER_SIZE] == LEVELS - 1);
+
+        // The whole stream decodes to the same image
+        ReadBitstream (&stream[0], stream.size (), received_p);
+        FoveationCompile (received_p, masks);
+        FoveationDecode (received_p, masks, dest2_p);
+        VERIFY (dest1 == dest2);
+
+        // So does any prefix, more closely as more of it arrives
+        size_t blocks = 0;
+        double error = 255.0;
+        for (size_t size = BITSTREAM_HEADER_SIZE; size <= stream.size (); size += stream.size () / 8)
+        {
+            ReadBitstream (&stream[0], size, received_p);
+            size_t n = 0;
+            for (unsigned l = 0; l < LEVELS; ++l)
+                n += received_p.regions[l].size ();
+            VERIFY (n >= blocks);
+            blocks = n;
+            FoveationCompile (received_p, masks);
+            FoveationDecode (received_p, masks, dest2_p);
+            double e = Difference (dest1, dest2, W, 0, 0, W, H);
+            VERIFY (e <= error);
+            error = e;
+            // The blocks around the fixation point have arrived by
+            // the middle of the stream
+            if (size >= stream.size () / 2)
+                VERIFY (Difference (dest1, dest2, W, X - 16, Y - 16, X + 16, Y + 16) == 0.0);
+        }
+    }
+    // Each block is compressed
+    VERIFY (sizes[BITSTREAM_RANS] < sizes[BITSTREAM_RAW]);
+
+    // Streams with levels that are not in the pyramid are errors
+    vector<unsigned char> stream;
+    WriteProgressiveBitstream (src_p, false, stream);
+    stream[BITSTREAM_HEADER_SIZE] = LEVELS;
+    bool failed = false;
+    try { ReadBitstream (&stream[0], stream.size (), received_p); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // Residuals cannot be sent progressively
+    FoveationPyramid residual_p;
+    residual_p.Create (r, LEVELS);
+    FoveationResidual (src_p, masks, dest2_p, residual_p);
+    failed = false;
+    try { WriteProgressiveBitstream (residual_p, false, stream); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+        test4 ();
+        test5 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,142 @@
+// Test compression routines
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include <cstdlib>
+#include "entropy.h"
+#include <iostream>
+#include "verify.h"
+#include "pnm_util.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace SVIS;
+
+// Code and decode 'p' and return the size of the coded stream
+size_t RoundTrip (const vector<unsigned char> &p)
+{
+    vector<unsigned char> stream (3, 0xAA);
+    RansEncode (p.empty () ? 0 : &p[0], p.size (), stream);
+    // Anything after the stream is left alone
+    stream.push_back (0x55);
+    vector<unsigned char> q (p.size () + 1, 0x77);
+    size_t used = RansDecode (&stream[3], stream.size () - 3, &q[0], p.size ());
+    VERIFY (used == stream.size () - 4);
+    VERIFY (equal (p.begin (), p.end (), q.begin ()));
+    VERIFY (q.back () == 0x77);
+    return used;
+}
+
+void test1 ()
+{
+    // Empty
+    RoundTrip (vector<unsigned char> ());
+    // One symbol
+    vector<unsigned char> p (10000, 42);
+    VERIFY (RoundTrip (p) < 100);
+    // Every symbol
+    for (unsigned i = 0; i < p.size (); ++i)
+        p[i] = i;
+    RoundTrip (p);
+    // Random
+    for (unsigned i = 0; i < p.size (); ++i)
+        p[i] = rand ();
+    RoundTrip (p);
+    // Skewed, with rare symbols
+    for (unsigned i = 0; i < p.size (); ++i)
+        p[i] = (i % 1000) == 0 ? rand () : (rand () % 3) - 1;
+    VERIFY (RoundTrip (p) < p.size () / 2);
+    p.resize (1);
+    RoundTrip (p);
+}
+
+void test2 ()
+{
+    vector<unsigned char> p (5000);
+    for (unsigned i = 0; i < p.size (); ++i)
+        p[i] = rand () % 16;
+    vector<unsigned char> stream;
+    RansEncode (&p[0], p.size (), stream);
+    vector<unsigned char> q (p.size ());
+    // Truncated streams are errors
+    for (size_t size = 0; size < stream.size (); size += 3)
+    {
+        bool failed = false;
+        try { RansDecode (&stream[0], size, &q[0], q.size ()); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+    // So are tables that do not add up
+    stream[0] ^= 1;
+    bool failed = false;
+    try { RansDecode (&stream[0], stream.size (), &q[0], q.size ()); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test3 ()
+{
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+    const unsigned W = src.GetWidth ();
+    const unsigned H = src.GetHeight ();
+    const unsigned char *p = src.GetPixelsAddress ();
+
+    // Predict a window of the image
+    const unsigned X = 13;
+    const unsigned Y = 7;
+    const unsigned BW = W / 2;
+    const unsigned BH = H / 3;
+    vector<unsigned char> residuals (BW * BH);
+    Predict (p + Y * W + X, W, BW, BH, &residuals[0]);
+
+    // Undo it into a padded buffer
+    const unsigned PITCH = BW + 5;
+    vector<unsigned char> q (PITCH * BH, 9);
+    Unpredict (&residuals[0], BW, BH, &q[0], PITCH);
+    for (unsigned y = 0; y < BH; ++y)
+    {
+        VERIFY (equal (p + (Y + y) * W + X, p + (Y + y) * W + X + BW, &q[y * PITCH]));
+        for (unsigned x = BW; x < PITCH; ++x)
+            VERIFY (q[y * PITCH + x] == 9);
+    }
+
+    // The residuals of a natural image compress better than its pixels
+    vector<unsigned char> pixels (BW * BH);
+    for (unsigned y = 0; y < BH; ++y)
+        copy (p + (Y + y) * W + X, p + (Y + y) * W + X + BW, &pixels[y * BW]);
+    VERIFY (RoundTrip (residuals) < RoundTrip (pixels));
+    VERIFY (RoundTrip (residuals) < pixels.size () * 3 / 4);
+
+    // A single pixel, row and column
+    Predict (p, W, 1, 1, &residuals[0]);
+    Unpredict (&residuals[0], 1, 1, &q[0], 1);
+    VERIFY (q[0] == p[0]);
+    Predict (p, W, BW, 1, &residuals[0]);
+    Unpredict (&residuals[0], BW, 1, &q[0], BW);
+    VERIFY (equal (p, p + BW, q.begin ()));
+    Predict (p, W, 1, BH, &residuals[0]);
+    Unpredict (&residuals[0], 1, BH, &q[0], 1);
+    for (unsigned y = 0; y < BH; ++y)
+        VERIFY (q[y] == p[y * W]);
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -10,9 +10,11 @@
 #include "filter.h"
 #include "pnm_util.h"
 #include "verify.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 using namespace SVIS;
 using namespace std;
@@ -25,6 +27,7 @@ Image GetImage (const PNM::Image &p, unsigned w, unsigned h, unsigned scale)
     i.width = w;
     i.height = h;
     i.scale = scale;
+    i.pitch = 0;
     // An image may be empty, so avoid referencing pixels[0] when this
     // is true...
     if (p.GetSize ())
@@ -350,6 +353,341 @@ void DoBlendTest3 ()
     Save (dest_image, fn);
 }
 
+void DoBlendTest4 ()
+{
+    const int MASK_W = 150;
+    const int MASK_H = 101;
+
+    // Compiled spans must blend exactly the same pixels as Blend()
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    VERIFY (src_image.GetPixelDepth () == 1);
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+
+    AutoImage mask = { MASK_W, MASK_H, 0 };
+    mask.pixels.resize (MASK_W * MASK_H);
+    for (unsigned i = 0; i < mask.pixels.size (); ++i)
+        mask.pixels[i] = rand ();
+    Image mask_image = { mask.width, mask.height, mask.scale, &mask.pixels[0] };
+
+    for (unsigned scale = 0; scale < 4; ++scale)
+    {
+        const unsigned SW = W >> scale;
+        const unsigned SH = H >> scale;
+        vector<unsigned char> src_pixels (SW * SH);
+        vector<unsigned char> dest_pixels1 (SW * SH);
+        for (unsigned i = 0; i < src_pixels.size (); ++i)
+            src_pixels[i] = rand ();
+        Image src = { W, H, scale, &src_pixels[0] };
+        Image dest1 = { W, H, scale, &dest_pixels1[0] };
+
+        for (int pass = 0; pass < 200; pass++)
+        {
+            Rect r;
+            r.x1 = rand () % (W + 1);
+            r.y1 = rand () % (H + 1);
+            r.x2 = r.x1 + rand () % (W + 1 - r.x1);
+            r.y2 = r.y1 + rand () % (H + 1 - r.y1);
+            int mask_x = rand () % (2 * W) - W;
+            int mask_y = rand () % (2 * H) - H;
+            const Rect *rect = (pass % 10 == 0) ? 0 : &r;
+
+            for (unsigned i = 0; i < dest_pixels1.size (); ++i)
+                dest_pixels1[i] = rand ();
+            vector<unsigned char> dest_pixels2 (dest_pixels1);
+            Image dest2 = { W, H, scale, &dest_pixels2[0] };
+
+            Blend (&src, &dest1, &mask, rect, mask_x, mask_y);
+            vector<BlendSpan> spans;
+            CompileBlend (&src, &mask_image, rect, mask_x, mask_y, spans);
+            BlendSpans (&src, &dest2, &mask_image, spans.empty () ? 0 : &spans[0], spans.size ());
+            VERIFY (dest_pixels1 == dest_pixels2);
+        }
+    }
+}
+
+// Copy packed pixels into rows of 'pitch' pixels, padded with 'fill'
+vector<unsigned char> Pad (const vector<unsigned char> &p,
+    unsigned w, unsigned h, unsigned pitch, unsigned char fill)
+{
+    vector<unsigned char> q (pitch * h, fill);
+    for (unsigned y = 0; y < h; ++y)
+        copy (&p[y * w], &p[y * w] + w, &q[y * pitch]);
+    return q;
+}
+
+// Check that the padding is untouched and return the packed pixels
+vector<unsigned char> Unpad (const vector<unsigned char> &q,
+    unsigned w, unsigned h, unsigned pitch, unsigned char fill)
+{
+    vector<unsigned char> p (w * h);
+    for (unsigned y = 0; y < h; ++y)
+    {
+        copy (&q[y * pitch], &q[y * pitch] + w, &p[y * w]);
+        for (unsigned x = w; x < pitch; ++x)
+            VERIFY (q[y * pitch + x] == fill);
+    }
+    return p;
+}
+
+void DoPitchTest ()
+{
+    const unsigned W = 101;
+    const unsigned H = 67;
+    const unsigned PAD = 13;
+    const unsigned char FILL = 0xA5;
+
+    AutoImage mask = { W * 2, H * 2, 0 };
+    mask.pixels.resize (mask.width * mask.height);
+    for (unsigned i = 0; i < mask.pixels.size (); ++i)
+        mask.pixels[i] = rand ();
+
+    for (unsigned scale = 0; scale < 3; ++scale)
+    {
+        // A packed and a padded copy of the same pixels at 'scale' and
+        // 'scale' + 1
+        const unsigned w0 = W >> scale;
+        const unsigned h0 = H >> scale;
+        const unsigned w1 = W >> (scale + 1);
+        const unsigned h1 = H >> (scale + 1);
+        vector<unsigned char> a0 (w0 * h0);
+        vector<unsigned char> a1 (w1 * h1);
+        for (unsigned i = 0; i < a0.size (); ++i)
+            a0[i] = rand ();
+        for (unsigned i = 0; i < a1.size (); ++i)
+            a1[i] = rand ();
+        vector<unsigned char> b0 = Pad (a0, w0, h0, w0 + PAD, FILL);
+        vector<unsigned char> b1 = Pad (a1, w1, h1, w1 + PAD, FILL);
+        Image packed0 = { W, H, scale, &a0[0] };
+        Image packed1 = { W, H, scale + 1, &a1[0] };
+        Image padded0 = { W, H, scale, &b0[0], w0 + PAD };
+        Image padded1 = { W, H, scale + 1, &b1[0], w1 + PAD };
+
+        // Reduce
+        Reduce2x2 (&packed0, &packed1);
+        Reduce2x2 (&padded0, &padded1);
+        VERIFY (Unpad (b1, w1, h1, w1 + PAD, FILL) == a1);
+        Reduce3x3 (&packed0, &packed1);
+        Reduce3x3 (&padded0, &padded1);
+        VERIFY (Unpad (b1, w1, h1, w1 + PAD, FILL) == a1);
+
+        // Expand
+        ExpandEven (&packed1, &packed0);
+        ExpandEven (&padded1, &padded0);
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == a0);
+        ExpandOdd (&packed1, &packed0);
+        ExpandOdd (&padded1, &padded0);
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == a0);
+
+        // Blend from a packed src into a packed and a padded dest
+        vector<unsigned char> s0 (w0 * h0);
+        for (unsigned i = 0; i < s0.size (); ++i)
+            s0[i] = rand ();
+        vector<unsigned char> t0 = Pad (s0, w0, h0, w0 + PAD + 3, FILL);
+        Image src = { W, H, scale, &s0[0] };
+        Image padded_src = { W, H, scale, &t0[0], w0 + PAD + 3 };
+        Rect r = { 3, 5, static_cast<int> (W) - 7, static_cast<int> (H) - 2 };
+        Blend (&src, &packed0, &mask, &r, -30, -20);
+        Blend (&src, &padded0, &mask, &r, -30, -20);
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == a0);
+
+        // Spans apply to src and dest with different pitches
+        vector<BlendSpan> spans;
+        Image mask_image = { mask.width, mask.height, mask.scale, &mask.pixels[0] };
+        CompileBlend (&src, &mask_image, &r, -20, -30, spans);
+        VERIFY (!spans.empty ());
+        BlendSpans (&src, &packed0, &mask_image, &spans[0], spans.size ());
+        BlendSpans (&padded_src, &padded0, &mask_image, &spans[0], spans.size ());
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == a0);
+
+        // ... and so do spans compiled for a padded mask
+        vector<unsigned char> padded_mask = Pad (mask.pixels, mask.width, mask.height, mask.width + 40, FILL);
+        Image padded_mask_image = { mask.width, mask.height, mask.scale, &padded_mask[0], mask.width + 40 };
+        vector<BlendSpan> padded_spans;
+        CompileBlend (&src, &padded_mask_image, &r, -20, -30, padded_spans);
+        BlendSpans (&src, &packed0, &mask_image, &spans[0], spans.size ());
+        BlendSpans (&padded_src, &padded0, &padded_mask_image, &padded_spans[0], padded_spans.size ());
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == a0);
+
+        // Copy
+        Copy (&padded_src, &padded0);
+        VERIFY (Unpad (b0, w0, h0, w0 + PAD, FILL) == s0);
+        Copy (&padded0, &packed0);
+        VERIFY (a0 == s0);
+    }
+}
+
+// Widen 8 bit pixels to 16 bits, multiplied by 'scale'
+static vector<unsigned short> Widen (const vector<unsigned char> &p, unsigned scale = 1)
+{
+    vector<unsigned short> w (p.size ());
+    for (unsigned i = 0; i < p.size (); ++i)
+        w[i] = p[i] * scale;
+    return w;
+}
+
+void DoWideTest ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    vector<unsigned char> s8 (src_image.GetPixels ());
+    vector<unsigned short> s16 = Widen (s8);
+
+    // 16 bit pixels that fit in 8 bits filter exactly as 8 bit pixels
+    // do
+    vector<unsigned char> r8 ((W / 2) * (H / 2));
+    vector<unsigned short> r16 (r8.size ());
+    Image src8 = { W, H, 0, &s8[0] };
+    Image16 src16 = { W, H, 0, &s16[0] };
+    Image reduced8 = { W, H, 1, &r8[0] };
+    Image16 reduced16 = { W, H, 1, &r16[0] };
+    Reduce3x3 (&src8, &reduced8);
+    Reduce3x3 (&src16, &reduced16);
+    VERIFY (Widen (r8) == r16);
+
+    vector<unsigned char> e8 (W * H);
+    vector<unsigned short> e16 (e8.size ());
+    Image expanded8 = { W, H, 0, &e8[0] };
+    Image16 expanded16 = { W, H, 0, &e16[0] };
+    ExpandOdd (&reduced8, &expanded8);
+    ExpandOdd (&reduced16, &expanded16);
+    VERIFY (Widen (e8) == e16);
+
+    AutoImage mask;
+    mask.width = 100;
+    mask.height = 80;
+    mask.scale = 0;
+    mask.pixels.resize (mask.width * mask.height);
+    for (unsigned i = 0; i < mask.pixels.size (); ++i)
+        mask.pixels[i] = rand ();
+    Rect r = { 10, 20, static_cast<int> (W) - 30, static_cast<int> (H) - 5 };
+    Blend (&src8, &expanded8, &mask, &r, 50, 60);
+    Blend (&src16, &expanded16, &mask, &r, 50, 60);
+    VERIFY (Widen (e8) == e16);
+
+    Image mask_image = { mask.width, mask.height, mask.scale, &mask.pixels[0] };
+    vector<BlendSpan> spans8;
+    vector<BlendSpan> spans16;
+    CompileBlend (&src8, &mask_image, &r, -20, 30, spans8);
+    CompileBlend (&src16, &mask_image, &r, -20, 30, spans16);
+    VERIFY (spans8.size () == spans16.size ());
+    BlendSpans (&src8, &expanded8, &mask_image, &spans8[0], spans8.size ());
+    BlendSpans (&src16, &expanded16, &mask_image, &spans16[0], spans16.size ());
+    VERIFY (Widen (e8) == e16);
+
+    // The full 16 bit range does not overflow.  Scaling by 257 maps
+    // 255 to 65535.
+    vector<unsigned short> full = Widen (s8, 257);
+    Image16 full16 = { W, H, 0, &full[0] };
+    Reduce3x3 (&full16, &reduced16);
+    ExpandOdd (&reduced16, &expanded16);
+    for (unsigned i = 0; i < r16.size (); ++i)
+        VERIFY (abs (r16[i] - r8[i] * 257) <= 257);
+    vector<unsigned short> white (W * H, 65535);
+    Image16 white16 = { W, H, 0, &white[0] };
+    BlendSpans (&white16, &expanded16, &mask_image, &spans16[0], spans16.size ());
+    for (unsigned i = 0; i < spans16.size (); ++i)
+        for (unsigned x = 0; x < spans16[i].length; ++x)
+        {
+            const BlendSpan &b = spans16[i];
+            unsigned m = mask.pixels[b.mask_offset + x];
+            unsigned e = e16[b.y * W + b.x + x];
+            VERIFY (e + 1 >= m * 257);
+        }
+}
+
+// Return a random 16 bit pixel, often at the ends of the range
+static unsigned short RandomWide ()
+{
+    switch (rand () % 4)
+    {
+        case 0: return 0;
+        case 1: return 65535;
+        default: return rand () & 0xFFFF;
+    }
+}
+
+void DoWideKernelTest ()
+{
+    // The 16 bit routines work on vectors of pixels where the
+    // processor has them, so compare them with the scalar formulas
+    // over the full range, at widths around the vector widths
+    for (unsigned W = 4; W < 80; W += 3)
+    {
+        const unsigned H = 9;
+        vector<unsigned short> s (W * H);
+        for (unsigned i = 0; i < s.size (); ++i)
+            s[i] = RandomWide ();
+        const unsigned w = W / 2;
+        const unsigned h = H / 2;
+        vector<unsigned short> r (w * h);
+        Image16 src = { W, H, 0, &s[0] };
+        Image16 reduced = { W, H, 1, &r[0] };
+        Reduce3x3 (&src, &reduced);
+        for (unsigned y = 0; y < h; ++y)
+            for (unsigned x = 0; x < w; ++x)
+            {
+                unsigned sum = 0;
+                for (unsigned j = 0; j < 3; ++j)
+                    for (unsigned i = 0; i < 3; ++i)
+                    {
+                        // The edges are clamped
+                        unsigned sx = min (x * 2 + i, W - 1);
+                        unsigned sy = min (y * 2 + j, H - 1);
+                        sum += s[sy * W + sx] * (i == 1 ? 2 : 1) * (j == 1 ? 2 : 1);
+                    }
+                VERIFY (r[y * w + x] == (sum + 8) >> 4);
+            }
+
+        // The pixels between the edges of an expanded image
+        for (unsigned i = 0; i < r.size (); ++i)
+            r[i] = RandomWide ();
+        vector<unsigned short> e (W * H);
+        Image16 expanded = { W, H, 0, &e[0] };
+        ExpandOdd (&reduced, &expanded);
+        for (unsigned y = 1; y + 3 <= H; ++y)
+            for (unsigned x = 1; x + 3 <= W; ++x)
+            {
+                const unsigned short *s1 = &r[(y - 1) / 2 * w + (x - 1) / 2];
+                const unsigned short *s2 = s1 + w;
+                unsigned p;
+                if (y & 1)
+                    p = x & 1 ? s1[0] : (s1[0] + s1[1] + 1) / 2;
+                else
+                    p = x & 1 ? (s1[0] + s2[0] + 1) / 2 : (s1[0] + s1[1] + s2[0] + s2[1] + 2) / 4;
+                VERIFY (e[y * W + x] == p);
+            }
+
+        // Blending, with and without residuals, along spans with
+        // adjacent mask pixels
+        vector<unsigned char> m (W * H);
+        for (unsigned i = 0; i < m.size (); ++i)
+            m[i] = rand () % 3 ? rand () : (rand () % 2) * 255;
+        Image mask = { W, H, 0, &m[0] };
+        vector<BlendSpan> spans;
+        CompileBlend (&src, &mask, 0, 0, 0, spans);
+        for (unsigned residual = 0; residual < 2; ++residual)
+        {
+            for (unsigned i = 0; i < e.size (); ++i)
+                e[i] = RandomWide ();
+            vector<unsigned short> before (e);
+            if (residual)
+                BlendResidualSpans (&src, &expanded, &mask, &spans[0], spans.size ());
+            else
+                BlendSpans (&src, &expanded, &mask, &spans[0], spans.size ());
+            for (unsigned i = 0; i < e.size (); ++i)
+            {
+                unsigned d = before[i];
+                unsigned p = residual ? static_cast<unsigned short> (s[i] + d - ResidualBias<unsigned short> ()) : s[i];
+                VERIFY (e[i] == (p * m[i] + d * (255 - m[i])) / 255);
+            }
+        }
+    }
+}
+
 int main ()
 {
     try
@@ -365,6 +703,10 @@ int main ()
         DoBlendTest1 ();
         DoBlendTest2 ();
         DoBlendTest3 ();
+        DoBlendTest4 ();
+        DoPitchTest ();
+        DoWideTest ();
+        DoWideKernelTest ();
         return 0;
     }
     catch (const exception &e)
@@ -25,6 +25,7 @@ Image GetImage (const PNM::Image &p, unsigned w, unsigned h, unsigned scale)
     i.width = w;
     i.height = h;
     i.scale = scale;
+    i.pitch = 0;
     // An image may be empty, so avoid referencing pixels[0] when this
     // is true...
     if (p.GetSize ())
@@ -138,11 +139,68 @@ void test1 ()
     }
 }
 
+void test2 ()
+{
+    PNM::Image src_image;
+    Load (src_image, "src.pgm");
+    const unsigned W = src_image.GetWidth ();
+    const unsigned H = src_image.GetHeight ();
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> dest3 (W * H);
+    vector<unsigned char> residuals (W * H);
+    Image src = { W, H, 0, src_image.GetPixelsAddress () };
+    Image d1 = { W, H, 0, &dest1[0] };
+    Image d2 = { W, H, 0, &dest2[0] };
+    Image d3 = { W, H, 0, &dest3[0] };
+    Image r = { W, H, 0, &residuals[0] };
+
+    SVIS::AutoImage resmap = { W * 2, H * 2, 0 };
+    CreateResmap (resmap.width, resmap.height, resmap.pixels, 2.3, 45);
+    const unsigned LEVELS = 5;
+    FoveationMasks masks;
+    masks.Create (resmap, LEVELS - 1);
+    FoveationPyramid src_p;
+    FoveationPyramid dest1_p;
+    FoveationPyramid dest2_p;
+    FoveationPyramid dest3_p;
+    FoveationPyramid residual_p;
+    src_p.Create (src, LEVELS);
+    dest1_p.Create (d1, LEVELS);
+    dest2_p.Create (d2, LEVELS);
+    dest3_p.Create (d3, LEVELS);
+    residual_p.Create (r, LEVELS);
+    src_p.Reduce ();
+
+    const int x[] = { int (W / 2), 0, int (W) + 100, -int (W) };
+    const int y[] = { int (H / 2), int (H), -100, -int (H) };
+    for (unsigned f = 0; f < sizeof (x) / sizeof (x[0]); ++f)
+    {
+        FoveationEncode (src_p, masks, x[f], y[f]);
+        FoveationDecode (src_p, masks, dest1_p);
+        FoveationResidual (src_p, masks, dest2_p, residual_p);
+        VERIFY (residual_p.residual);
+        VERIFY (residual_p.fixation_x == x[f]);
+        VERIFY (residual_p.fixation_y == y[f]);
+        // The residuals decode to the same image
+        FoveationDecode (residual_p, masks, dest3_p);
+        VERIFY (dest1 == dest2);
+        VERIFY (dest1 == dest3);
+    }
+
+    // The residuals of a pyramid cannot be taken again
+    bool failed = false;
+    try { FoveationResidual (residual_p, masks, dest2_p, residual_p); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
 int main ()
 {
     try
     {
         test1 ();
+        test2 ();
 
         return 0;
     }
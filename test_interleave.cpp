@@ -0,0 +1,136 @@
+// Test splitting interleaved images into planes
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include <cstdlib>
+#include "interleave.h"
+#include <iostream>
+#include "pnm.h"
+#include <stdexcept>
+#include <vector>
+#include "verify.h"
+
+using namespace std;
+using namespace SVIS;
+
+void test1 ()
+{
+    // Every channel count, at widths around the vector width, with
+    // packed and padded rows
+    for (unsigned channels = 1; channels <= 4; ++channels)
+    for (unsigned width = 0; width < 50; ++width)
+    for (unsigned pad = 0; pad < 2; ++pad)
+    {
+        const unsigned height = 3;
+        const unsigned src_pitch = pad ? width * channels + 5 : 0;
+        const unsigned plane_pitch = pad ? width + 7 : 0;
+        const unsigned sp = src_pitch ? src_pitch : width * channels;
+        const unsigned pp = plane_pitch ? plane_pitch : width;
+        vector<unsigned char> src (sp * height + 1);
+        for (unsigned i = 0; i < src.size (); ++i)
+            src[i] = rand ();
+
+        // Padding is left alone
+        vector<unsigned char> planes (pp * height * channels + 1, 0xAA);
+        unsigned char *p[4];
+        for (unsigned c = 0; c < channels; ++c)
+            p[c] = &planes[c * pp * height];
+        Deinterleave (&src[0], src_pitch, width, height, channels, p, plane_pitch);
+        for (unsigned y = 0; y < height; ++y)
+            for (unsigned x = 0; x < pp; ++x)
+                for (unsigned c = 0; c < channels; ++c)
+                    if (x < width)
+                        VERIFY (p[c][y * pp + x] == src[y * sp + x * channels + c]);
+                    else
+                        VERIFY (p[c][y * pp + x] == 0xAA);
+        VERIFY (planes.back () == 0xAA);
+
+        vector<unsigned char> dest (src.size (), 0x55);
+        const unsigned char *q[4] = { p[0], p[1], p[2], p[3] };
+        Interleave (q, plane_pitch, width, height, channels, &dest[0], src_pitch);
+        for (unsigned y = 0; y < height; ++y)
+            for (unsigned x = 0; x < sp; ++x)
+                if (x < width * channels)
+                    VERIFY (dest[y * sp + x] == src[y * sp + x]);
+                else
+                    VERIFY (dest[y * sp + x] == 0x55);
+        VERIFY (dest.back () == 0x55);
+    }
+}
+
+void test2 ()
+{
+    // PNM images
+    PNM::Image rgb (17, 9, 3);
+    for (unsigned i = 0; i < rgb.GetSize (); ++i)
+        rgb.GetPixelsAddress ()[i] = i * 7;
+    vector<unsigned char> planes;
+    Deinterleave (rgb, planes);
+    VERIFY (planes.size () == rgb.GetSize ());
+    const unsigned n = 17 * 9;
+    for (unsigned i = 0; i < n; ++i)
+        for (unsigned c = 0; c < 3; ++c)
+            VERIFY (planes[c * n + i] == rgb.GetPixels ()[i * 3 + c]);
+    PNM::Image merged (17, 9, 3);
+    Interleave (planes, merged);
+    VERIFY (merged == rgb);
+
+    // The planes must fit the image
+    planes.pop_back ();
+    bool failed = false;
+    try { Interleave (planes, merged); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // A grey image is its own plane
+    PNM::Image grey (5, 4, 1);
+    grey.SetPixels (9);
+    Deinterleave (grey, planes);
+    VERIFY (planes == grey.GetPixels ());
+    PNM::Image empty;
+    Deinterleave (empty, planes);
+    VERIFY (planes.empty ());
+}
+
+void test3 ()
+{
+    // Bad parameters
+    unsigned char buffer[64] = { 0 };
+    unsigned char *p[5] = { buffer, buffer, buffer, buffer, buffer };
+    const unsigned char *q[5] = { buffer, buffer, buffer, buffer, buffer };
+    bool failed = false;
+    try { Deinterleave (buffer, 0, 2, 2, 5, p); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try { Interleave (q, 0, 2, 2, 0, buffer); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try { Deinterleave (buffer, 5, 2, 2, 3, p); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try { Interleave (q, 1, 2, 2, 3, buffer); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
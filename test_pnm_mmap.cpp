@@ -0,0 +1,228 @@
+// Test memory mapped PNM files
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "pnm_mmap.h"
+#include "pnm_util.h"
+#include "svis.h"
+#include <stdexcept>
+#include "verify.h"
+
+using namespace std;
+using namespace SVIS;
+
+static vector<unsigned char> ReadFile (const string &fn)
+{
+    ifstream s (fn.c_str (), ios::binary);
+    return vector<unsigned char> ((istreambuf_iterator<char> (s)), istreambuf_iterator<char> ());
+}
+
+void test1 ()
+{
+    // A mapped image has the same header and pixels as a loaded one
+    PNM::Image src;
+    Load (src, "src.pgm");
+    PNM::MappedImage m ("src.pgm");
+    VERIFY (m.GetWidth () == src.GetWidth ());
+    VERIFY (m.GetHeight () == src.GetHeight ());
+    VERIFY (m.GetPixelDepth () == 1);
+    VERIFY (m.GetSize () == src.GetSize ());
+    VERIFY (m.GetMaxval () == src.GetMaxval ());
+    VERIFY (m.GetComments () == src.GetComments ());
+    VERIFY (equal (src.GetPixels ().begin (), src.GetPixels ().end (), m.GetPixelsAddress ()));
+
+    // The mapped pixels go straight to the codec, and it can decode
+    // straight into a mapped file
+    const unsigned W = m.GetWidth ();
+    const unsigned H = m.GetHeight ();
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, H * 2, resmap, 2.3, 45.0);
+    vector<unsigned char> dest (W * H);
+    CODEC c1 (W, H, src.GetPixelsAddress (), &dest[0]);
+    c1.SetResmap (W * 2, H * 2, resmap);
+    c1.Reduce ();
+    c1.Encode (W / 3, H / 2);
+    c1.Decode ();
+    {
+        PNM::MappedImageWriter w ("tmp_pnm_mmap.pgm", W, H, 1, m.GetComments ());
+        VERIFY (w.GetSize () == W * H);
+        CODEC c2 (W, H, m.GetPixelsAddress (), w.GetPixelsAddress ());
+        c2.ShareResmap (c1);
+        c2.Reduce ();
+        c2.Encode (W / 3, H / 2);
+        c2.Decode ();
+        w.Close ();
+        // Closing twice does nothing, but the pixels are gone
+        w.Close ();
+        bool failed = false;
+        try { w.GetPixelsAddress (); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+
+    // The file is the same as one written with operator<<
+    PNM::Image out (W, H, 1);
+    out.SetComments (m.GetComments ());
+    out.SetPixels (dest);
+    {
+        ofstream s ("tmp_pnm_mmap_stream.pgm", ios::binary);
+        s << out;
+    }
+    VERIFY (ReadFile ("tmp_pnm_mmap.pgm") == ReadFile ("tmp_pnm_mmap_stream.pgm"));
+    PNM::Image in;
+    Load (in, "tmp_pnm_mmap.pgm");
+    VERIFY (in == out);
+
+    // Changing the mapped pixels does not change the file
+    m.GetPixelsAddress ()[0] ^= 0xFF;
+    PNM::MappedImage m2 ("src.pgm");
+    VERIFY (m2.GetPixelsAddress ()[0] == src.GetPixelsAddress ()[0]);
+    VERIFY (m.GetPixelsAddress ()[0] != src.GetPixelsAddress ()[0]);
+}
+
+void test2 ()
+{
+    // Color images, and comments in unusual places
+    const unsigned W = 17;
+    const unsigned H = 5;
+    {
+        PNM::MappedImageWriter w ("tmp_pnm_mmap.ppm", W, H, 3);
+        VERIFY (w.GetPixelDepth () == 3);
+        for (unsigned i = 0; i < W * H * 3; ++i)
+            w.GetPixelsAddress ()[i] = i;
+    }
+    PNM::MappedImage m ("tmp_pnm_mmap.ppm");
+    VERIFY (m.GetWidth () == W);
+    VERIFY (m.GetHeight () == H);
+    VERIFY (m.GetPixelDepth () == 3);
+    for (unsigned i = 0; i < W * H * 3; ++i)
+        VERIFY (m.GetPixelsAddress ()[i] == static_cast<unsigned char> (i));
+
+    {
+        ofstream s ("tmp_pnm_mmap_comments.pgm", ios::binary);
+        s << "P5\n# one\n3 # two\n2\n127\nabcdef";
+    }
+    PNM::MappedImage c ("tmp_pnm_mmap_comments.pgm");
+    VERIFY (c.GetWidth () == 3);
+    VERIFY (c.GetHeight () == 2);
+    VERIFY (c.GetMaxval () == 127);
+    VERIFY (c.GetComments () == "# one\n# two\n");
+    VERIFY (c.GetPixelsAddress ()[5] == 'f');
+}
+
+void test3 ()
+{
+    // Files that are not there, are cut short, or are not 8 bit PGM or
+    // PPM files cannot be mapped
+    const char *bad[] = {
+        "",
+        "P5\n3 2\n255\nabcde",
+        "P2\n3 2\n255\nabcdef",
+        "P5\n3 2\n65535\nabcdefabcdef",
+        "P5\n3 2\n0\nabcdef",
+        "P5\n3 x\n255\nabcdef",
+        "Q5\n3 2\n255\nabcdef",
+    };
+    for (unsigned i = 0; i < sizeof (bad) / sizeof (bad[0]); ++i)
+    {
+        {
+            ofstream s ("tmp_pnm_mmap_bad.pgm", ios::binary);
+            s << bad[i];
+        }
+        bool failed = false;
+        try { PNM::MappedImage m ("tmp_pnm_mmap_bad.pgm"); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+    remove ("tmp_pnm_mmap_bad.pgm");
+
+    bool failed = false;
+    try { PNM::MappedImage m ("tmp_pnm_mmap_missing.pgm"); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    failed = false;
+    try { PNM::MappedImageWriter w ("tmp_pnm_mmap_bad.pgm", 3, 2, 2); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    failed = false;
+    try { PNM::MappedImageWriter w ("tmp_pnm_mmap_bad.pgm", 3, 2, 1, "", 0); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    failed = false;
+    try { PNM::MappedImageWriter w ("tmp_pnm_mmap_bad.pgm", 3, 2, 1, "", 65536); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test4 ()
+{
+    // Other maxvals are written the same way as operator<< writes them
+    const unsigned W = 7;
+    const unsigned H = 3;
+    PNM::Image out8 (W, H, 1);
+    out8.SetMaxval (127);
+    for (unsigned i = 0; i < W * H; ++i)
+        out8.SetPixel (i % W, i / W, 0, i * 5);
+    {
+        PNM::MappedImageWriter w ("tmp_pnm_mmap.pgm", W, H, 1, "", 127);
+        VERIFY (w.GetMaxval () == 127);
+        copy (out8.GetPixels ().begin (), out8.GetPixels ().end (), w.GetPixelsAddress ());
+    }
+    {
+        ofstream s ("tmp_pnm_mmap_stream.pgm", ios::binary);
+        s << out8;
+    }
+    VERIFY (ReadFile ("tmp_pnm_mmap.pgm") == ReadFile ("tmp_pnm_mmap_stream.pgm"));
+
+    // 16 bit samples take two bytes, most significant first
+    PNM::Image16 out16 (W, H, 3);
+    out16.SetMaxval (1000);
+    for (unsigned i = 0; i < W * H * 3; ++i)
+        out16.SetPixel ((i / 3) % W, i / 3 / W, i % 3, i * 15);
+    {
+        PNM::MappedImageWriter w ("tmp_pnm_mmap.ppm", W, H, 3, "", 1000);
+        VERIFY (w.GetSize () == W * H * 3);
+        unsigned char *p = w.GetPixelsAddress ();
+        for (unsigned i = 0; i < W * H * 3; ++i)
+        {
+            p[i * 2] = out16.GetPixels ()[i] >> 8;
+            p[i * 2 + 1] = out16.GetPixels ()[i] & 0xFF;
+        }
+    }
+    {
+        ofstream s ("tmp_pnm_mmap_stream.ppm", ios::binary);
+        s << out16;
+    }
+    VERIFY (ReadFile ("tmp_pnm_mmap.ppm") == ReadFile ("tmp_pnm_mmap_stream.ppm"));
+    remove ("tmp_pnm_mmap.pgm");
+    remove ("tmp_pnm_mmap_stream.pgm");
+    remove ("tmp_pnm_mmap.ppm");
+    remove ("tmp_pnm_mmap_stream.ppm");
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+        test4 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
@@ -0,0 +1,194 @@
+// Test recording routines
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+
+#include "bitstream.h"
+#include <cstdio>
+#include <iostream>
+#include "recording.h"
+#include "verify.h"
+#include "pnm_util.h"
+#include "svis.h"
+#include <stdexcept>
+
+using namespace std;
+using namespace SVIS;
+
+void test1 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> frame (src.GetPixelsAddress (), src.GetPixelsAddress () + W * H);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    CODEC sender (W, H, &frame[0], &dest1[0]);
+    sender.SetResmap (W * 2, H * 2, pixels);
+
+    // Record a moving patch and a moving fixation, with a keyframe
+    // every fourth frame
+    const unsigned FRAMES = 10;
+    vector<vector<unsigned char> > decoded;
+    {
+        RecordingWriter writer ("tmp_recording.svq");
+        vector<unsigned char> stream;
+        for (unsigned f = 0; f < FRAMES; ++f)
+        {
+            for (int y = 0; y < 16; ++y)
+                for (int x = 0; x < 16; ++x)
+                    frame[(H / 2 + y) * W + f * 16 + x] = 255;
+            if (f % 4 == 0)
+                sender.SetInterFrame (true);
+            sender.Reduce ();
+            sender.Encode (W / 3 + f * 8, H / 2);
+            sender.Decode ();
+            decoded.push_back (dest1);
+            sender.GetBitstream (stream, f % 2 == 0);
+            writer.Write (stream);
+        }
+        VERIFY (writer.Frames () == FRAMES);
+        writer.Close ();
+        // Closing twice does nothing, but writing to a closed
+        // recording is an error
+        writer.Close ();
+        bool failed = false;
+        try { writer.Write (stream); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+
+    RecordingReader reader ("tmp_recording.svq");
+    VERIFY (reader.Frames () == FRAMES);
+    for (unsigned f = 0; f < FRAMES; ++f)
+    {
+        int x;
+        int y;
+        reader.GetFixation (f, x, y);
+        VERIFY (x == W / 3 + int (f) * 8);
+        VERIFY (y == H / 2);
+        VERIFY (reader.IsKeyframe (f) == (f % 4 == 0));
+        VERIFY (reader.GetKeyframe (f) == f / 4 * 4);
+        BitstreamHeader h;
+        ReadBitstreamHeader (reader.GetFrame (f), reader.GetFrameSize (f), h);
+        VERIFY (h.fixation_x == x);
+    }
+
+    // Seek to any frame by decoding from the keyframe before it
+    vector<unsigned char> unused (W * H);
+    const unsigned order[] = { 7, 2, 9, 0, 5 };
+    for (unsigned k = 0; k < sizeof (order) / sizeof (order[0]); ++k)
+    {
+        CODEC receiver (W, H, &unused[0], &dest2[0]);
+        receiver.SetResmap (W * 2, H * 2, pixels);
+        for (unsigned f = reader.GetKeyframe (order[k]); f <= order[k]; ++f)
+            receiver.DecodeBitstream (reader.GetFrame (f), reader.GetFrameSize (f));
+        VERIFY (dest2 == decoded[order[k]]);
+    }
+
+    bool failed = false;
+    try { reader.GetFrame (FRAMES); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test2 ()
+{
+    // Only bitstreams can be recorded
+    vector<unsigned char> stream (100, 0);
+    {
+        RecordingWriter writer ("tmp_recording_empty.svq");
+        bool failed = false;
+        try { writer.Write (stream); }
+        catch (const runtime_error &) { failed = true; }
+        VERIFY (failed);
+    }
+    // An empty recording
+    RecordingReader empty ("tmp_recording_empty.svq");
+    VERIFY (empty.Frames () == 0);
+
+    // A recording that was cut short cannot be read
+    FILE *f = fopen ("tmp_recording.svq", "rb");
+    VERIFY (f != 0);
+    vector<unsigned char> data (1 << 20);
+    data.resize (fread (&data[0], 1, data.size (), f));
+    fclose (f);
+    VERIFY (data.size () > 100);
+    f = fopen ("tmp_recording_cut.svq", "wb");
+    fwrite (&data[0], 1, data.size () - 10, f);
+    fclose (f);
+    bool failed = false;
+    try { RecordingReader reader ("tmp_recording_cut.svq"); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+
+    // Neither can files that are not there
+    failed = false;
+    try { RecordingReader reader ("tmp_recording_missing.svq"); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test3 ()
+{
+#ifdef __linux__
+    // Every write to /dev/full fails, so once the queue holds a frame
+    // that cannot be written, Write fails too instead of queueing
+    // more
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> dest (W * H);
+    CODEC codec (W, H, src.GetPixelsAddress (), &dest[0]);
+    codec.SetResmap (W * 2, H * 2, pixels);
+    codec.Reduce ();
+    codec.Encode (W / 2, H / 2);
+    vector<unsigned char> stream;
+    codec.GetBitstream (stream);
+    VERIFY (stream.size () > BUFSIZ);
+
+    RecordingWriter writer ("/dev/full");
+    bool failed = false;
+    for (unsigned f = 0; f < 1000 && !failed; ++f)
+    {
+        try { writer.Write (stream); }
+        catch (const runtime_error &) { failed = true; }
+    }
+    VERIFY (failed);
+    failed = false;
+    try { writer.Write (stream); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try { writer.Close (); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+#endif
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}
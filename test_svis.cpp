@@ -6,11 +6,15 @@
 //
 // jsp Tue Aug 22 12:00:49 CDT 2006
 
+#include "bitstream.h"
 #include "verify.h"
 #include "pnm_util.h"
 #include "svis.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -316,6 +320,1039 @@ void test4 ()
     delete codec;
 }
 
+void test5 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+
+    // Decode the same fixations speculatively and normally
+    PNM::Image dest1 (W, H, 1);
+    PNM::Image dest2 (W, H, 1);
+    CODEC codec1 (W, H, src.GetPixelsAddress (), dest1.GetPixelsAddress ());
+    CODEC codec2 (W, H, src.GetPixelsAddress (), dest2.GetPixelsAddress ());
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    codec1.SetResmap (W * 2, H * 2, pixels);
+    codec2.SetResmap (W * 2, H * 2, pixels);
+    codec1.Reduce ();
+    codec2.Reduce ();
+
+    // Candidate landing points
+    vector<int> x;
+    vector<int> y;
+    x.push_back (W / 4); y.push_back (H / 4);
+    x.push_back (W / 2); y.push_back (H / 2);
+    x.push_back (W); y.push_back (-H);
+
+    // A landing point near the second candidate
+    codec1.Speculate (x, y);
+    VERIFY (codec1.DecodeSpeculative (W / 2 + 3, H / 2 - 4, 5));
+    codec2.Encode (W / 2, H / 2);
+    codec2.Decode ();
+    VERIFY (dest1 == dest2);
+
+    // The fixation is the one that was actually decoded
+    vector<unsigned> bx1, by1, bw1, bh1;
+    vector<unsigned> bx2, by2, bw2, bh2;
+    vector<vector<unsigned char> > bp1, bp2;
+    codec1.GetEncodedImageBlocks (0, bx1, by1, bw1, bh1, bp1);
+    codec2.GetEncodedImageBlocks (0, bx2, by2, bw2, bh2, bp2);
+    VERIFY (bx1 == bx2 && by1 == by2 && bw1 == bw2 && bh1 == bh2 && bp1 == bp2);
+
+    // A landing point that is too far away from all candidates
+    codec1.Speculate (x, y);
+    VERIFY (!codec1.DecodeSpeculative (W, H, 5));
+    codec2.Encode (W, H);
+    codec2.Decode ();
+    VERIFY (dest1 == dest2);
+
+    // Speculations are discarded when the source changes
+    codec1.Speculate (x, y);
+    codec1.Reduce ();
+    VERIFY (!codec1.DecodeSpeculative (W / 4, H / 4, 5));
+
+    // The candidate vectors must match
+    bool caught = false;
+    try
+    {
+        x.push_back (0);
+        codec1.Speculate (x, y);
+    }
+    catch (...)
+    {
+        caught = true;
+    }
+    VERIFY (caught);
+}
+
+void test6 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+
+    PNM::Image dest1 (W, H, 1);
+    PNM::Image dest2 (W, H, 1);
+    CODEC codec (W, H, src.GetPixelsAddress (), dest1.GetPixelsAddress ());
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    codec.SetResmap (W * 2, H * 2, pixels);
+    codec.Reduce ();
+    codec.Encode (W / 3, H / 3);
+
+    // A generous budget decodes every level
+    vector<unsigned> skipped (1);
+    codec.Decode (10.0, skipped);
+    VERIFY (skipped.empty ());
+    codec.SetDestImage (dest2.GetPixelsAddress ());
+    codec.Decode ();
+    VERIFY (dest1 == dest2);
+
+    // No budget at all only upsamples the top level
+    codec.Decode (0.0, skipped);
+    VERIFY (skipped.size () == codec.PyramidLevels () - 1);
+    for (unsigned i = 0; i < skipped.size (); ++i)
+        VERIFY (skipped[i] == codec.PyramidLevels () - 2 - i);
+    VERIFY (!(dest1 == dest2));
+    Save (dest2, "tmp_svis_degraded.pgm");
+}
+
+void test7 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+
+    // A cached codec must decode exactly like an uncached one
+    PNM::Image dest1 (W, H, 1);
+    PNM::Image dest2 (W, H, 1);
+    CODEC codec1 (W, H, src.GetPixelsAddress (), dest1.GetPixelsAddress ());
+    CODEC codec2 (W, H, src.GetPixelsAddress (), dest2.GetPixelsAddress ());
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    codec1.SetResmap (W * 2, H * 2, pixels);
+    codec2.SetResmap (W * 2, H * 2, pixels);
+    codec1.Reduce ();
+    codec2.Reduce ();
+    codec1.SetEncodeCache (2);
+
+    // Revisit three fixations with room for two of them
+    const int x[] = { W / 2, 10, W / 2, W - 10, 10, 10 };
+    const int y[] = { H / 2, 20, H / 2, H + 10, 20, 20 };
+    for (unsigned i = 0; i < sizeof (x) / sizeof (x[0]); ++i)
+    {
+        codec1.Encode (x[i], y[i]);
+        codec1.Decode ();
+        codec2.Encode (x[i], y[i]);
+        codec2.Decode ();
+        VERIFY (dest1 == dest2);
+    }
+    // 10,20 was evicted by W-10,H+10 before it was revisited
+    VERIFY (codec1.GetEncodeCacheHits () == 2);
+    VERIFY (codec1.GetEncodeCacheMisses () == 4);
+
+    // Changing the resmap empties the cache
+    vector<unsigned char> pixels2;
+    CreateResmap (W * 2, H * 2, pixels2, 1.1, 45.0);
+    codec1.SetResmap (W * 2, H * 2, pixels2);
+    codec1.Encode (10, 20);
+    VERIFY (codec1.GetEncodeCacheMisses () == 5);
+    codec1.SetResmap (W * 2, H * 2, pixels);
+
+    // Quantized fixations are snapped to the nearest multiple
+    codec1.SetEncodeCache (4, 16);
+    VERIFY (codec1.GetEncodeCacheHits () == 0);
+    codec1.Encode (167, 104);
+    codec1.Decode ();
+    codec2.Encode (160, 112);
+    codec2.Decode ();
+    VERIFY (dest1 == dest2);
+    codec1.Encode (163, 115);
+    VERIFY (codec1.GetEncodeCacheHits () == 1);
+    codec1.Encode (-7, -9);
+    codec1.Encode (0, -16);
+    VERIFY (codec1.GetEncodeCacheHits () == 2);
+    VERIFY (codec1.GetEncodeCacheMisses () == 2);
+}
+
+void test8 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+
+    PNM::Image dest (W, H, 1);
+    CODEC codec (W, H, src.GetPixelsAddress (), dest.GetPixelsAddress ());
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+
+    // The generation changes with the source and the masks
+    unsigned long g = codec.GetGeneration ();
+    codec.SetResmap (W * 2, H * 2, pixels);
+    VERIFY (codec.GetGeneration () > g);
+    g = codec.GetGeneration ();
+    // ... but not when the resmap is the same
+    VERIFY (codec.HasResmap (W * 2, H * 2, pixels));
+    VERIFY (!codec.HasResmap (H * 2, W * 2, pixels));
+    codec.SetResmap (W * 2, H * 2, pixels);
+    VERIFY (codec.GetGeneration () == g);
+    codec.Reduce ();
+    VERIFY (codec.GetGeneration () > g);
+    g = codec.GetGeneration ();
+    codec.SetSrcImage (src.GetPixelsAddress ());
+    VERIFY (codec.GetGeneration () > g);
+    codec.Reduce ();
+
+    VERIFY (!codec.IsDecoded (W / 2, H / 2));
+    codec.Encode (W / 2, H / 2);
+    VERIFY (!codec.IsDecoded (W / 2, H / 2));
+    codec.Decode ();
+    VERIFY (codec.IsDecoded (W / 2, H / 2));
+    VERIFY (!codec.IsDecoded (W / 2 + 1, H / 2));
+    PNM::Image decoded (dest);
+
+    // By default, encoding and decoding again redraws the destination
+    dest.SetPixel (W / 2, H / 2, 0, dest.GetPixel (W / 2, H / 2, 0) + 1);
+    codec.Encode (W / 2, H / 2);
+    codec.Decode ();
+    VERIFY (dest == decoded);
+
+    // Skipping unchanged frames, it does not touch the destination
+    codec.SetSkipUnchanged (true);
+    dest.SetPixel (W / 2, H / 2, 0, dest.GetPixel (W / 2, H / 2, 0) + 1);
+    codec.Encode (W / 2, H / 2);
+    codec.Decode ();
+    VERIFY (!(dest == decoded));
+
+    // ... until the source changes
+    codec.Reduce ();
+    VERIFY (!codec.IsDecoded (W / 2, H / 2));
+    codec.Encode (W / 2, H / 2);
+    codec.Decode ();
+    VERIFY (dest == decoded);
+
+    // ... or the destination changes
+    PNM::Image dest2 (W, H, 1);
+    codec.SetDestImage (dest2.GetPixelsAddress ());
+    VERIFY (!codec.IsDecoded (W / 2, H / 2));
+    codec.Decode ();
+    VERIFY (dest2 == decoded);
+
+    // ... or the fixation changes
+    codec.Encode (0, 0);
+    VERIFY (!codec.IsDecoded (W / 2, H / 2));
+    codec.Decode ();
+    VERIFY (!(dest2 == decoded));
+}
+
+void test9 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+
+    PNM::Image dest1 (W, H, 1);
+    PNM::Image dest2 (W, H, 1);
+    CODEC codec1 (W, H, src.GetPixelsAddress (), dest1.GetPixelsAddress ());
+    CODEC codec2 (W, H, src.GetPixelsAddress (), dest2.GetPixelsAddress ());
+    CODEC codec3 (W, H, src.GetPixelsAddress (), dest2.GetPixelsAddress (), 4);
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+
+    // There is nothing to share yet
+    bool failed = false;
+    try { codec2.ShareResmap (codec1); }
+    catch (...) { failed = true; }
+    VERIFY (failed);
+
+    codec1.SetResmap (W * 2, H * 2, pixels);
+
+    // The number of levels must match
+    failed = false;
+    try { codec3.ShareResmap (codec1); }
+    catch (...) { failed = true; }
+    VERIFY (failed);
+
+    // A codec that shares the masks decodes the same image
+    unsigned long g = codec2.GetGeneration ();
+    codec2.ShareResmap (codec1);
+    VERIFY (codec2.GetGeneration () > g);
+    unsigned w1, h1, w2, h2;
+    vector<unsigned char> m1, m2;
+    codec1.GetMask (0, w1, h1, m1);
+    codec2.GetMask (0, w2, h2, m2);
+    VERIFY (w1 == w2 && h1 == h2 && m1 == m2);
+    codec1.Reduce ();
+    codec2.Reduce ();
+    codec1.Encode (W / 3, H / 3);
+    codec2.Encode (W / 3, H / 3);
+    codec1.Decode ();
+    codec2.Decode ();
+    VERIFY (dest1 == dest2);
+
+    // Setting the resmap again does not change the shared masks
+    vector<unsigned char> pixels2;
+    CreateResmap (W * 2, H * 2, pixels2, 1.1, 45.0);
+    codec1.SetResmap (W * 2, H * 2, pixels2);
+    codec2.GetMask (0, w2, h2, m2);
+    VERIFY (m1 == m2);
+}
+
+// Transpose a row major W x H buffer
+vector<unsigned char> Transpose (const unsigned char *p, int W, int H)
+{
+    vector<unsigned char> t (W * H);
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+            t[x * H + y] = p[y * W + x];
+    return t;
+}
+
+void test10 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    const int X = W / 3;
+    const int Y = H / 4;
+
+    // Encode the row major image
+    PNM::Image dest (W, H, 1);
+    CODEC codec1 (W, H, src.GetPixelsAddress (), dest.GetPixelsAddress ());
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    codec1.SetResmap (W * 2, H * 2, pixels);
+    codec1.Encode (X, Y);
+    codec1.Decode ();
+
+    // Encode the same image in column major order
+    vector<unsigned char> csrc = Transpose (src.GetPixelsAddress (), W, H);
+    vector<unsigned char> cdest (W * H);
+    CODEC codec2 (W, H, &csrc[0], &cdest[0], 5, COLUMN_MAJOR);
+    VERIFY (codec2.GetMemoryOrder () == COLUMN_MAJOR);
+    VERIFY (codec2.GetWidth () == static_cast<unsigned> (W));
+    VERIFY (codec2.GetHeight () == static_cast<unsigned> (H));
+    codec2.SetResmap (W * 2, H * 2, Transpose (&pixels[0], W * 2, H * 2));
+    codec2.Encode (X, Y);
+    VERIFY (!codec2.IsDecoded (X, Y));
+    codec2.Decode ();
+    VERIFY (codec2.IsDecoded (X, Y));
+    VERIFY (!codec2.IsDecoded (Y, X));
+
+    // The results are the same
+    VERIFY (cdest == Transpose (dest.GetPixelsAddress (), W, H));
+    unsigned w1, h1, w2, h2;
+    vector<unsigned char> m1, m2;
+    codec1.GetMask (1, w1, h1, m1);
+    codec2.GetMask (1, w2, h2, m2);
+    VERIFY (w1 == w2 && h1 == h2);
+    VERIFY (m2 == Transpose (&m1[0], w1, h1));
+    vector<unsigned> x1, y1, bw1, bh1, x2, y2, bw2, bh2;
+    vector<vector<unsigned char> > p1, p2;
+    codec1.GetEncodedImageBlocks (2, x1, y1, bw1, bh1, p1);
+    codec2.GetEncodedImageBlocks (2, x2, y2, bw2, bh2, p2);
+    // The regions may be split differently, but they cover the same
+    // area
+    unsigned area1 = 0;
+    unsigned area2 = 0;
+    for (unsigned i = 0; i < x1.size (); ++i)
+        area1 += bw1[i] * bh1[i];
+    for (unsigned i = 0; i < x2.size (); ++i)
+        area2 += bw2[i] * bh2[i];
+    VERIFY (area1 > 0);
+    VERIFY (area1 == area2);
+
+    // Row and column major codecs may not share masks
+    bool failed = false;
+    try { codec2.ShareResmap (codec1); }
+    catch (...) { failed = true; }
+    VERIFY (failed);
+}
+
+void test11 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    const unsigned char *p = src.GetPixelsAddress ();
+
+    // Encode a packed window of the image
+    const int X0 = 17;
+    const int Y0 = 9;
+    const int WW = W / 2 + 3;
+    const int WH = H / 2 + 5;
+    vector<unsigned char> window (WW * WH);
+    for (int y = 0; y < WH; ++y)
+        for (int x = 0; x < WW; ++x)
+            window[y * WW + x] = p[(y + Y0) * W + x + X0];
+    vector<unsigned char> dest1 (WW * WH);
+    CODEC codec1 (WW, WH, &window[0], &dest1[0]);
+    vector<unsigned char> pixels;
+    CreateResmap (WW * 2, WH * 2, pixels, 2.3, 45.0);
+    codec1.SetResmap (WW * 2, WH * 2, pixels);
+    codec1.Reduce ();
+    codec1.Encode (WW / 3, WH / 2);
+    codec1.Decode ();
+
+    // Encode the same window in place, into a padded surface
+    const unsigned PITCH = WW + 24;
+    vector<unsigned char> surface (PITCH * WH, 7);
+    CODEC codec2 (WW, WH, &window[0], &surface[0]);
+    codec2.SetResmap (WW * 2, WH * 2, pixels);
+    bool failed = false;
+    try { codec2.SetSrcImage (src.GetPixelsAddress (), WW - 1); }
+    catch (...) { failed = true; }
+    VERIFY (failed);
+    codec2.SetSrcImage (src.GetPixelsAddress () + Y0 * W + X0, W);
+    codec2.SetDestImage (&surface[0], PITCH);
+    codec2.Reduce ();
+    codec2.Encode (WW / 3, WH / 2);
+    codec2.Decode ();
+    for (int y = 0; y < WH; ++y)
+    {
+        VERIFY (equal (&dest1[y * WW], &dest1[y * WW] + WW, &surface[y * PITCH]));
+        for (unsigned x = WW; x < PITCH; ++x)
+            VERIFY (surface[y * PITCH + x] == 7);
+    }
+
+    // The getters return packed images
+    unsigned w, h;
+    vector<unsigned char> d;
+    codec2.GetDecodedImage (0, w, h, d);
+    VERIFY (d == dest1);
+    codec2.GetReducedImage (0, w, h, d);
+    VERIFY (d == window);
+
+    // Changing the pitch means decoding again
+    VERIFY (codec2.IsDecoded (WW / 3, WH / 2));
+    codec2.SetDestImage (&surface[0]);
+    VERIFY (!codec2.IsDecoded (WW / 3, WH / 2));
+    codec2.Decode ();
+    VERIFY (equal (dest1.begin (), dest1.end (), surface.begin ()));
+}
+
+void test12 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> dest (W * H);
+
+    for (int order = ROW_MAJOR; order <= COLUMN_MAJOR; ++order)
+    {
+        // A column major codec sees the transposed buffer
+        vector<unsigned char> s (src.GetPixelsAddress (), src.GetPixelsAddress () + W * H);
+        vector<unsigned char> r (pixels);
+        if (order == COLUMN_MAJOR)
+        {
+            s = Transpose (&s[0], W, H);
+            r = Transpose (&r[0], W * 2, H * 2);
+        }
+        CODEC codec (W, H, &s[0], &dest[0], 5, MemoryOrder (order));
+        codec.SetResmap (W * 2, H * 2, r);
+        codec.Reduce ();
+        codec.Encode (W / 3, H / 2);
+        codec.Decode ();
+
+        // The views hold the same pixels as the copies
+        for (unsigned l = 0; l < codec.PyramidLevels (); ++l)
+        {
+            unsigned w, h;
+            vector<unsigned char> p;
+            // There is one less mask than there are levels
+            bool has_mask = l + 1 < codec.PyramidLevels ();
+            ImageView v[3] = {
+                has_mask ? codec.GetMaskView (l) : ImageView (),
+                codec.GetReducedView (l),
+                codec.GetDecodedView (l) };
+            for (unsigned k = has_mask ? 0 : 1; k < 3; ++k)
+            {
+                switch (k)
+                {
+                    case 0: codec.GetMask (l, w, h, p); break;
+                    case 1: codec.GetReducedImage (l, w, h, p); break;
+                    case 2: codec.GetDecodedImage (l, w, h, p); break;
+                }
+                VERIFY (v[k].width == w);
+                VERIFY (v[k].height == h);
+                // Rows of the buffer
+                unsigned bw = order == COLUMN_MAJOR ? h : w;
+                unsigned bh = order == COLUMN_MAJOR ? w : h;
+                VERIFY (v[k].pitch >= bw);
+                for (unsigned j = 0; j < bh; ++j)
+                    VERIFY (equal (&p[j * bw], &p[j * bw] + bw, v[k].pixels + j * v[k].pitch));
+            }
+        }
+        VERIFY (codec.GetReducedView (0).pixels == &s[0]);
+        VERIFY (codec.GetDecodedView (0).pixels == &dest[0]);
+        bool failed = false;
+        try { codec.GetReducedView (codec.PyramidLevels ()); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+
+        // The blocks match the copied blocks
+        for (unsigned l = 0; l < codec.PyramidLevels (); ++l)
+        {
+            vector<unsigned> x, y, w, h;
+            vector<vector<unsigned char> > p;
+            codec.GetEncodedImageBlocks (l, x, y, w, h, p);
+            CODEC::BlockIterator i = codec.GetEncodedBlocks (l);
+            ImageBlock b;
+            unsigned n = 0;
+            while (i.Next (b))
+            {
+                VERIFY (n < x.size ());
+                VERIFY (b.x == x[n] && b.y == y[n]);
+                VERIFY (b.view.width == w[n] && b.view.height == h[n]);
+                // The block points into the reduced image
+                ImageView r = codec.GetReducedView (l);
+                unsigned bx = b.x;
+                unsigned by = b.y;
+                if (order == COLUMN_MAJOR)
+                    swap (bx, by);
+                VERIFY (b.view.pixels == r.pixels + by * r.pitch + bx);
+                VERIFY (b.view.pitch == r.pitch);
+                VERIFY (p[n][0] == b.view.pixels[0]);
+                ++n;
+            }
+            VERIFY (n == x.size ());
+            VERIFY (!i.Next (b));
+        }
+    }
+}
+
+void test13 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+
+    for (int order = ROW_MAJOR; order <= COLUMN_MAJOR; ++order)
+    {
+        vector<unsigned char> s (src.GetPixelsAddress (), src.GetPixelsAddress () + W * H);
+        vector<unsigned char> r (pixels);
+        if (order == COLUMN_MAJOR)
+        {
+            s = Transpose (&s[0], W, H);
+            r = Transpose (&r[0], W * 2, H * 2);
+        }
+
+        // The sender encodes and decodes as usual
+        vector<unsigned char> dest1 (W * H);
+        CODEC sender (W, H, &s[0], &dest1[0], 5, MemoryOrder (order));
+        sender.SetResmap (W * 2, H * 2, r);
+        sender.Reduce ();
+
+        // The receiver has no source image
+        vector<unsigned char> dest2 (W * H);
+        CODEC receiver (W, H, 0, &dest2[0], 5, MemoryOrder (order));
+        bool failed = false;
+        vector<unsigned char> stream;
+        sender.Encode (W / 3, H / 2);
+        sender.GetBitstream (stream);
+        try { receiver.DecodeBitstream (&stream[0], stream.size ()); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+        receiver.SetResmap (W * 2, H * 2, r);
+
+        // So it can only decode bitstreams
+        failed = false;
+        try { receiver.Reduce (); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+        failed = false;
+        try { receiver.Encode (W / 3, H / 2); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+        failed = false;
+        try { receiver.GetBitstream (stream); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+
+        const int x[] = { W / 3, 0, W - 1, W / 2 };
+        const int y[] = { H / 2, 0, H - 1, H / 4 };
+        for (unsigned f = 0; f < sizeof (x) / sizeof (x[0]); ++f)
+        {
+            sender.Encode (x[f], y[f]);
+            sender.Decode ();
+            sender.GetBitstream (stream);
+            VERIFY (stream.size () < unsigned (W * H));
+            receiver.DecodeBitstream (&stream[0], stream.size ());
+            VERIFY (dest1 == dest2);
+
+            // Compressed streams decode to the same image
+            vector<unsigned char> compressed;
+            sender.GetBitstream (compressed, true);
+            VERIFY (compressed.size () < stream.size ());
+            fill (dest2.begin (), dest2.end (), 0);
+            receiver.DecodeBitstream (&compressed[0], compressed.size ());
+            VERIFY (dest1 == dest2);
+        }
+
+        // The memory order must match
+        CODEC other (W, H, 0, &dest2[0], 5,
+            order == ROW_MAJOR ? COLUMN_MAJOR : ROW_MAJOR);
+        other.SetResmap (W * 2, H * 2, r);
+        failed = false;
+        try { other.DecodeBitstream (&stream[0], stream.size ()); }
+        catch (...) { failed = true; }
+        VERIFY (failed);
+    }
+}
+
+void test14 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> frame (src.GetPixelsAddress (), src.GetPixelsAddress () + W * H);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    CODEC sender (W, H, &frame[0], &dest1[0]);
+    sender.SetResmap (W * 2, H * 2, pixels);
+    sender.SetInterFrame (true);
+    vector<unsigned char> unused (W * H);
+    CODEC receiver (W, H, &unused[0], &dest2[0]);
+    receiver.SetResmap (W * 2, H * 2, pixels);
+
+    // A still scene with a moving patch
+    vector<unsigned char> stream;
+    vector<size_t> sizes;
+    for (int f = 0; f < 6; ++f)
+    {
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                frame[(H / 2 + y) * W + f * 16 + x] = 255;
+        sender.Reduce ();
+        sender.Encode (W / 3, H / 2);
+        sender.Decode ();
+        sender.GetBitstream (stream, f % 2 == 1);
+        sizes.push_back (stream.size ());
+        // An inter frame cannot be decoded on its own
+        if (f == 1)
+        {
+            vector<unsigned char> d (W * H);
+            CODEC other (W, H, &unused[0], &d[0]);
+            other.SetResmap (W * 2, H * 2, pixels);
+            bool failed = false;
+            try { other.DecodeBitstream (&stream[0], stream.size ()); }
+            catch (...) { failed = true; }
+            VERIFY (failed);
+        }
+        receiver.DecodeBitstream (&stream[0], stream.size ());
+        VERIFY (dest1 == dest2);
+    }
+    for (int f = 1; f < 6; ++f)
+        VERIFY (sizes[f] < sizes[0] / 4);
+
+    // Start over with a keyframe
+    sender.SetInterFrame (true);
+    sender.GetBitstream (stream);
+    VERIFY (stream.size () == sizes[0]);
+    receiver.DecodeBitstream (&stream[0], stream.size ());
+    VERIFY (dest1 == dest2);
+}
+
+void test15 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> frame (src.GetPixelsAddress (), src.GetPixelsAddress () + W * H);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    vector<unsigned char> expected (W * H);
+    CODEC sender (W, H, &frame[0], &dest1[0]);
+    sender.SetResmap (W * 2, H * 2, pixels);
+    vector<unsigned char> unused (W * H);
+    CODEC receiver (W, H, &unused[0], &dest2[0]);
+    receiver.SetResmap (W * 2, H * 2, pixels);
+
+    // Residual streams are smaller and decode to the same image
+    sender.Reduce ();
+    sender.Encode (W / 3, H / 2);
+    sender.Decode ();
+    expected = dest1;
+    vector<unsigned char> stream;
+    sender.GetBitstream (stream, true);
+    size_t size = stream.size ();
+    sender.SetResidualCoding (true);
+    fill (dest1.begin (), dest1.end (), 0);
+    sender.GetBitstream (stream, true);
+    VERIFY (stream.size () < size);
+    // Writing the stream decoded the image
+    VERIFY (dest1 == expected);
+    receiver.DecodeBitstream (&stream[0], stream.size ());
+    VERIFY (dest2 == expected);
+
+    // With inter frames
+    sender.SetInterFrame (true);
+    for (int f = 0; f < 4; ++f)
+    {
+        for (int y = 0; y < 16; ++y)
+            for (int x = 0; x < 16; ++x)
+                frame[(H / 2 + y) * W + f * 16 + x] = 255;
+        sender.Reduce ();
+        sender.Encode (W / 3, H / 2);
+        sender.GetBitstream (stream, f % 2 == 1);
+        receiver.DecodeBitstream (&stream[0], stream.size ());
+        VERIFY (dest1 == dest2);
+        sender.Decode ();
+        VERIFY (dest1 == dest2);
+    }
+
+    // Switching back to pixels sends a keyframe
+    sender.SetResidualCoding (false);
+    sender.GetBitstream (stream);
+    receiver.DecodeBitstream (&stream[0], stream.size ());
+    VERIFY (dest1 == dest2);
+}
+
+void test16 ()
+{
+    // Read an image
+    PNM::Image src;
+    Load (src, "src.pgm");
+    VERIFY (src.GetPixelDepth () == 1);
+
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> dest1 (W * H);
+    vector<unsigned char> dest2 (W * H);
+    CODEC sender (W, H, src.GetPixelsAddress (), &dest1[0]);
+    sender.SetResmap (W * 2, H * 2, pixels);
+    sender.SetProgressiveCoding (true);
+    vector<unsigned char> unused (W * H);
+    CODEC receiver (W, H, &unused[0], &dest2[0]);
+    receiver.SetResmap (W * 2, H * 2, pixels);
+
+    sender.Reduce ();
+    sender.Encode (W / 2, H / 3);
+    sender.Decode ();
+    vector<unsigned char> stream;
+    sender.GetBitstream (stream, true);
+    BitstreamHeader h;
+    ReadBitstreamHeader (&stream[0], stream.size (), h);
+    VERIFY (h.progressive);
+
+    // Any prefix of the stream decodes, and the whole stream decodes
+    // to the same image
+    for (size_t size = BITSTREAM_HEADER_SIZE; size < stream.size (); size += stream.size () / 5)
+        receiver.DecodeBitstream (&stream[0], size);
+    VERIFY (dest1 != dest2);
+    receiver.DecodeBitstream (&stream[0], stream.size ());
+    VERIFY (dest1 == dest2);
+
+    // Inter frames cannot follow a progressive stream
+    sender.SetInterFrame (true);
+    bool failed = false;
+    try { sender.GetBitstream (stream); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    sender.SetProgressiveCoding (false);
+    sender.GetBitstream (stream);
+    sender.GetBitstream (stream);
+    ReadBitstreamHeader (&stream[0], stream.size (), h);
+    VERIFY (h.inter);
+    failed = false;
+    try { receiver.DecodeBitstream (&stream[0], stream.size ()); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test17 ()
+{
+    // A 16 bit image, written and read back as a 16 bit PGM
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const unsigned W = src.GetWidth ();
+    const unsigned H = src.GetHeight ();
+    PNM::Image16 wide (W, H, 1);
+    for (unsigned i = 0; i < W * H; ++i)
+        wide.GetPixelsAddress ()[i] = src.GetPixelsAddress ()[i] * 257;
+    {
+        ofstream s ("tmp_svis_16.pgm", ios::binary);
+        s << wide;
+    }
+    PNM::Image16 loaded;
+    {
+        ifstream s ("tmp_svis_16.pgm", ios::binary);
+        s >> loaded;
+    }
+    VERIFY (loaded.GetMaxval () == 65535);
+    VERIFY (loaded == wide);
+    // ... but not as an 8 bit one
+    bool failed = false;
+    try { Load (src, "tmp_svis_16.pgm"); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    Load (src, "src.pgm");
+
+    // Foveate it with a 16 bit codec that shares the masks of an 8 bit
+    // one
+    vector<unsigned char> pixels;
+    CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+    vector<unsigned char> dest8 (W * H);
+    CODEC codec8 (W, H, src.GetPixelsAddress (), &dest8[0]);
+    codec8.SetResmap (W * 2, H * 2, pixels);
+    vector<unsigned short> dest16 (W * H);
+    CODEC16 codec16 (W, H, loaded.GetPixelsAddress (), &dest16[0]);
+    codec16.ShareResmap (codec8);
+    VERIFY (codec16.GetImageSize () == W * H);
+    codec8.Reduce ();
+    codec8.Encode (W / 3, H / 2);
+    codec8.Decode ();
+    codec16.Reduce ();
+    codec16.Encode (W / 3, H / 2);
+    codec16.Decode ();
+
+    // It foveates like the 8 bit codec, less the rounding of each 8
+    // bit level, and keeps the values in between those of 8 bit pixels
+    unsigned between = 0;
+    for (unsigned i = 0; i < W * H; ++i)
+    {
+        VERIFY (abs ((dest16[i] + 128) / 257 - dest8[i]) <= 2);
+        if (dest16[i] % 257)
+            ++between;
+    }
+    VERIFY (between > W * H / 4);
+    unsigned w;
+    unsigned h;
+    vector<unsigned short> level;
+    codec16.GetDecodedImage (0, w, h, level);
+    VERIFY (level == dest16);
+    codec16.GetReducedImage (codec16.PyramidLevels () - 1, w, h, level);
+    VERIFY (w == W >> (codec16.PyramidLevels () - 1));
+
+    // 16 bit pixels that fit in 8 bits decode exactly as 8 bit pixels
+    // do, in either memory order
+    for (unsigned order = 0; order < 2; ++order)
+    {
+        MemoryOrder o = order ? COLUMN_MAJOR : ROW_MAJOR;
+        vector<unsigned char> s8 (src.GetPixels ());
+        vector<unsigned short> s16 (s8.begin (), s8.end ());
+        CODEC c8 (W, H, &s8[0], &dest8[0], 5, o);
+        CODEC16 c16 (W, H, &s16[0], &dest16[0], 5, o);
+        CODEC16 c16b (W, H, &s16[0], &dest16[0], 5, o);
+        vector<unsigned char> resmap (pixels);
+        if (o == COLUMN_MAJOR)
+            for (unsigned y = 0; y < H * 2; ++y)
+                for (unsigned x = 0; x < W * 2; ++x)
+                    resmap[x * H * 2 + y] = pixels[y * W * 2 + x];
+        c16.SetResmap (W * 2, H * 2, resmap);
+        c8.SetResmap (W * 2, H * 2, resmap);
+        c16b.ShareResmap (c16);
+        c8.Reduce ();
+        c8.Encode (W / 4, H / 4);
+        c8.Decode ();
+        c16b.Reduce ();
+        c16b.Encode (W / 4, H / 4);
+        c16b.Decode ();
+        VERIFY (vector<unsigned short> (dest8.begin (), dest8.end ()) == dest16);
+    }
+
+    // Masks are only shared between codecs with the same levels
+    CODEC16 c3 (W, H, loaded.GetPixelsAddress (), &dest16[0], 3);
+    failed = false;
+    try { c3.ShareResmap (codec8); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
+void test18 ()
+{
+    // YUV 4:2:0 images, of even and odd sizes
+    PNM::Image src;
+    Load (src, "src.pgm");
+    for (unsigned odd = 0; odd < 2; ++odd)
+    {
+        const unsigned W = src.GetWidth () - odd;
+        const unsigned H = src.GetHeight () - odd;
+        const unsigned CW = (W + 1) / 2;
+        const unsigned CH = (H + 1) / 2;
+        const unsigned Y = W * H;
+        const unsigned C = CW * CH;
+        // Y is the image, U is the image at half resolution, and V is
+        // flat
+        vector<unsigned char> i420 (Y + C * 2, 128);
+        vector<unsigned char> luma (Y);
+        for (unsigned y = 0; y < H; ++y)
+            for (unsigned x = 0; x < W; ++x)
+                luma[y * W + x] = i420[y * W + x] = src.GetPixelsAddress ()[y * src.GetWidth () + x];
+        for (unsigned y = 0; y < CH; ++y)
+            for (unsigned x = 0; x < CW; ++x)
+                i420[Y + y * CW + x] = luma[y * 2 * W + x * 2];
+        vector<unsigned char> nv12 (i420);
+        for (unsigned i = 0; i < C; ++i)
+        {
+            nv12[Y + i * 2] = i420[Y + i];
+            nv12[Y + i * 2 + 1] = i420[Y + C + i];
+        }
+
+        vector<unsigned char> pixels;
+        CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+        vector<unsigned char> dest (Y);
+        CODEC c (W, H, &luma[0], &dest[0]);
+        c.SetResmap (W * 2, H * 2, pixels);
+        c.Reduce ();
+        c.Encode (W / 3, H / 2);
+        c.Decode ();
+
+        vector<unsigned char> d420 (i420.size ());
+        YUVCODEC y420 (W, H, I420, &i420[0], &d420[0]);
+        VERIFY (y420.GetImageSize () == i420.size ());
+        VERIFY (y420.GetFormat () == I420);
+        y420.SetResmap (W * 2, H * 2, pixels);
+        y420.Reduce ();
+        y420.Encode (W / 3, H / 2);
+        y420.Decode ();
+
+        // The Y plane is foveated as a CODEC foveates it
+        VERIFY (equal (dest.begin (), dest.end (), d420.begin ()));
+
+        // The U plane keeps its resolution around the fixation point,
+        // and loses it in the periphery
+        const unsigned fx = W / 6;
+        const unsigned fy = H / 4;
+        unsigned changed = 0;
+        for (unsigned y = 0; y < CH; ++y)
+            for (unsigned x = 0; x < CW; ++x)
+            {
+                unsigned i = Y + y * CW + x;
+                if (abs (static_cast<int> (x) - static_cast<int> (fx)) < 4 &&
+                    abs (static_cast<int> (y) - static_cast<int> (fy)) < 4)
+                    VERIFY (d420[i] == i420[i]);
+                if (d420[i] != i420[i])
+                    ++changed;
+            }
+        VERIFY (changed > C / 4);
+        // The flat V plane stays flat
+        for (unsigned i = Y + C; i < Y + C * 2; ++i)
+            VERIFY (d420[i] == 128);
+
+        // NV12 decodes to the same samples, interleaved, and may share
+        // the masks of a CODEC
+        vector<unsigned char> d12 (nv12.size ());
+        YUVCODEC y12 (W, H, NV12, &nv12[0], &d12[0]);
+        y12.ShareResmap (c);
+        y12.Reduce ();
+        y12.Encode (W / 3, H / 2);
+        y12.Decode ();
+        VERIFY (equal (d12.begin (), d12.begin () + Y, d420.begin ()));
+        for (unsigned i = 0; i < C; ++i)
+        {
+            VERIFY (d12[Y + i * 2] == d420[Y + i]);
+            VERIFY (d12[Y + i * 2 + 1] == d420[Y + C + i]);
+        }
+        // ... and may be given other frames
+        vector<unsigned char> s2 (nv12);
+        vector<unsigned char> d2 (nv12.size ());
+        y12.SetSrcImage (&s2[0]);
+        y12.SetDestImage (&d2[0]);
+        y12.Reduce ();
+        y12.Encode (W / 3, H / 2);
+        y12.Decode ();
+        VERIFY (d2 == d12);
+    }
+
+    // Bad parameters
+    const unsigned W = 64;
+    const unsigned H = 48;
+    vector<unsigned char> frame (W * H * 3 / 2);
+    bool failed = false;
+    try { YUVCODEC y (W, H, I420, &frame[0], &frame[0], 1); }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try
+    {
+        YUVCODEC y (W, H, I420, &frame[0], &frame[0]);
+        y.Reduce ();
+        y.Encode (W / 2, H / 2);
+    }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try
+    {
+        vector<unsigned char> pixels;
+        CreateResmap (W * 2, H * 2, pixels, 2.3, 45.0);
+        CODEC c (W, H, &frame[0], &frame[0], 4);
+        c.SetResmap (W * 2, H * 2, pixels);
+        YUVCODEC y (W, H, NV12, &frame[0], &frame[0]);
+        y.ShareResmap (c);
+    }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+    failed = false;
+    try
+    {
+        vector<unsigned char> pixels;
+        CreateResmap (H * 2, W * 2, pixels, 2.3, 45.0);
+        CODEC c (W, H, &frame[0], &frame[0], 5, COLUMN_MAJOR);
+        c.SetResmap (W * 2, H * 2, pixels);
+        YUVCODEC y (W, H, NV12, &frame[0], &frame[0]);
+        y.ShareResmap (c);
+    }
+    catch (const runtime_error &) { failed = true; }
+    VERIFY (failed);
+}
+
 int main ()
 {
     try
@@ -324,6 +1361,20 @@ int main ()
         test2 ();
         test3 ();
         test4 ();
+        test5 ();
+        test6 ();
+        test7 ();
+        test8 ();
+        test9 ();
+        test10 ();
+        test11 ();
+        test12 ();
+        test13 ();
+        test14 ();
+        test15 ();
+        test16 ();
+        test17 ();
+        test18 ();
 
         return 0;
     }
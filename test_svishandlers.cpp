@@ -0,0 +1,314 @@
+// Space Variant Imaging System MEX handler tests
+//
+// Copyright (C) 2006
+// Center for Perceptual Systems
+// University of Texas at Austin
+//
+// These drive the MEX gateway through the stub in mexstub/, the way
+// the toolbox .m files do.
+
+#include "verify.h"
+#include "mex.h"
+#include "pnm_util.h"
+#include "svis.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace SVIS;
+
+// Call svismex with function index 'f', like the .m files, and return
+// the result, if any
+mxArray *svismex (int f,
+    const mxArray *a1 = 0,
+    const mxArray *a2 = 0,
+    const mxArray *a3 = 0,
+    const mxArray *a4 = 0)
+{
+    mxArray *findex = mxCreateDoubleScalar (f);
+    const mxArray *prhs[] = { findex, a1, a2, a3, a4 };
+    int nrhs = 1;
+    while (nrhs < 5 && prhs[nrhs])
+        ++nrhs;
+    mxArray *plhs[1] = { 0 };
+    try
+    {
+        mexFunction (1, plhs, nrhs, prhs);
+    }
+    catch (...)
+    {
+        mxDestroyArray (findex);
+        mxDestroyArray (plhs[0]);
+        throw;
+    }
+    mxDestroyArray (findex);
+    return plhs[0];
+}
+
+// Return true if a call raises a MATLAB error
+bool Fails (int f,
+    const mxArray *a1 = 0,
+    const mxArray *a2 = 0,
+    const mxArray *a3 = 0,
+    const mxArray *a4 = 0)
+{
+    try
+    {
+        mxDestroyArray (svismex (f, a1, a2, a3, a4));
+    }
+    catch (const mexError &)
+    {
+        return true;
+    }
+    return false;
+}
+
+// Function indices in svismex.cpp
+enum { INIT, RELEASE, CODEC_, SETRESMAP, SETSRC, ENCODE, CODECRGB, SETSRCRGB, ENCODERGB };
+
+// Create a MATLAB array from 'planes' row major W x H images
+mxArray *ToMatlab (const unsigned char *p, int W, int H, int planes = 1)
+{
+    const int dims[3] = { H, W, planes };
+    mxArray *a = mxCreateNumericArray (planes == 1 ? 2 : 3, dims, mxUINT8_CLASS, mxREAL);
+    unsigned char *d = static_cast<unsigned char *> (mxGetData (a));
+    for (int k = 0; k < planes; ++k)
+        for (int y = 0; y < H; ++y)
+            for (int x = 0; x < W; ++x)
+                d[k * W * H + x * H + y] = p[k * W * H + y * W + x];
+    return a;
+}
+
+// Return plane 'k' of a MATLAB array as a row major image
+vector<unsigned char> FromMatlab (const mxArray *a, int k = 0)
+{
+    const int H = mxGetDimensions (a)[0];
+    const int W = mxGetDimensions (a)[1];
+    const unsigned char *d = static_cast<const unsigned char *> (mxGetData (a));
+    vector<unsigned char> p (W * H);
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x)
+            p[y * W + x] = d[k * W * H + x * H + y];
+    return p;
+}
+
+// Encode a row major image with the library
+vector<unsigned char> Encode (const unsigned char *p,
+    int W, int H,
+    const vector<unsigned char> &resmap,
+    int x, int y)
+{
+    vector<unsigned char> src (p, p + W * H);
+    vector<unsigned char> dest (W * H);
+    CODEC codec (W, H, &src[0], &dest[0], 8);
+    codec.SetResmap (W * 2, H * 2, resmap);
+    codec.Reduce ();
+    codec.Encode (x, y);
+    codec.Decode ();
+    return dest;
+}
+
+void test1 ()
+{
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, H * 2, resmap, 2.3, 45.0);
+
+    mxArray *img = ToMatlab (src.GetPixelsAddress (), W, H);
+    mxArray *r = ToMatlab (&resmap[0], W * 2, H * 2);
+    mxArray *row = mxCreateDoubleScalar (H / 4);
+    mxArray *col = mxCreateDoubleScalar (W / 3);
+
+    // svisinit must come first
+    svismex (RELEASE);
+    VERIFY (Fails (CODEC_, img));
+    svismex (INIT);
+
+    mxArray *c = svismex (CODEC_, img);
+    VERIFY (*mxGetPr (c) == 1.0);
+    svismex (SETRESMAP, c, r);
+
+    // The MEX output is the library output in column major order
+    const vector<unsigned char> expected = Encode (src.GetPixelsAddress (), W, H, resmap, W / 3, H / 4);
+    mxArray *d = svismex (ENCODE, c, row, col);
+    VERIFY (mxGetDimensions (d)[0] == H);
+    VERIFY (mxGetDimensions (d)[1] == W);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+
+    // Polling the same frame gives the same result
+    d = svismex (ENCODE, c, row, col);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+
+    // ... and so does passing the source in the same call
+    d = svismex (ENCODE, c, row, col, img);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+
+    // The source was not retained
+    VERIFY (Fails (ENCODE, c, row, col));
+    svismex (SETSRC, c, img);
+    d = svismex (ENCODE, c, row, col);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+
+    // Bad arguments
+    mxArray *bad = mxCreateDoubleScalar (2);
+    VERIFY (Fails (ENCODE, bad, row, col));
+    VERIFY (Fails (SETSRC, c, r));
+    VERIFY (Fails (ENCODE, c, row));
+    VERIFY (Fails (ENCODERGB, c, row, col));
+    mxDestroyArray (bad);
+
+    svismex (RELEASE);
+    mxDestroyArray (c);
+    mxDestroyArray (col);
+    mxDestroyArray (row);
+    mxDestroyArray (r);
+    mxDestroyArray (img);
+}
+
+void test2 ()
+{
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, H * 2, resmap, 2.3, 45.0);
+
+    // Three different planes
+    vector<unsigned char> rgb (W * H * 3);
+    for (int i = 0; i < W * H; ++i)
+    {
+        rgb[i] = src.GetPixelsAddress ()[i];
+        rgb[W * H + i] = 255 - src.GetPixelsAddress ()[i];
+        rgb[2 * W * H + i] = src.GetPixelsAddress ()[W * H - 1 - i];
+    }
+
+    mxArray *img = ToMatlab (&rgb[0], W, H, 3);
+    mxArray *r = ToMatlab (&resmap[0], W * 2, H * 2);
+    mxArray *row = mxCreateDoubleScalar (H / 2);
+    mxArray *col = mxCreateDoubleScalar (W / 5);
+
+    svismex (INIT);
+    mxArray *c = svismex (CODECRGB, img);
+    svismex (SETRESMAP, c, r);
+
+    // Each plane is encoded like a grayscale image
+    mxArray *d = svismex (ENCODERGB, c, row, col);
+    VERIFY (mxGetNumberOfDimensions (d) == 3);
+    VERIFY (mxGetDimensions (d)[2] == 3);
+    for (int k = 0; k < 3; ++k)
+        VERIFY (FromMatlab (d, k) == Encode (&rgb[k * W * H], W, H, resmap, W / 5, H / 2));
+    mxDestroyArray (d);
+
+    // Grayscale calls do not take color handles
+    VERIFY (Fails (ENCODE, c, row, col));
+    VERIFY (Fails (SETSRC, c, img));
+    svismex (SETSRCRGB, c, img);
+
+    svismex (RELEASE);
+    mxDestroyArray (c);
+    mxDestroyArray (col);
+    mxDestroyArray (row);
+    mxDestroyArray (r);
+    mxDestroyArray (img);
+}
+
+void test3 ()
+{
+    PNM::Image src;
+    Load (src, "src.pgm");
+    const int W = src.GetWidth ();
+    const int H = src.GetHeight ();
+    vector<unsigned char> resmap;
+    CreateResmap (W * 2, H * 2, resmap, 2.3, 45.0);
+
+    mxArray *img = ToMatlab (src.GetPixelsAddress (), W, H);
+    mxArray *r = ToMatlab (&resmap[0], W * 2, H * 2);
+    mxArray *row = mxCreateDoubleScalar (H / 2);
+    mxArray *col = mxCreateDoubleScalar (W / 2);
+    const vector<unsigned char> expected = Encode (src.GetPixelsAddress (), W, H, resmap, W / 2, H / 2);
+
+    svismex (INIT);
+    mxArray *c1 = svismex (CODEC_, img);
+    mxArray *c2 = svismex (CODEC_, img);
+    VERIFY (*mxGetPr (c2) == 2.0);
+
+    // Release one handle
+    svismex (RELEASE, c1);
+    VERIFY (Fails (ENCODE, c1, row, col));
+    VERIFY (Fails (RELEASE, c1));
+
+    // ... and it is reused, with the pooled buffers
+    mxArray *c3 = svismex (CODEC_, img);
+    VERIFY (*mxGetPr (c3) == 1.0);
+    svismex (SETRESMAP, c3, r);
+    svismex (SETRESMAP, c2, r);
+    mxArray *d = svismex (ENCODE, c3, row, col);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+    d = svismex (ENCODE, c2, row, col);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+
+    // Trials that create and release a codec
+    for (int i = 0; i < 3; ++i)
+    {
+        mxArray *c = svismex (CODEC_, img);
+        svismex (SETRESMAP, c, r);
+        d = svismex (ENCODE, c, row, col);
+        VERIFY (FromMatlab (d) == expected);
+        mxDestroyArray (d);
+        svismex (RELEASE, c);
+        mxDestroyArray (c);
+    }
+
+    // A pooled codec does not keep the resolution map of the last
+    // trial
+    mxArray *c4 = svismex (CODEC_, img);
+    VERIFY (Fails (ENCODE, c4, row, col));
+    svismex (SETRESMAP, c4, r);
+    d = svismex (ENCODE, c4, row, col);
+    VERIFY (FromMatlab (d) == expected);
+    mxDestroyArray (d);
+    mxDestroyArray (c4);
+
+    svismex (RELEASE);
+    VERIFY (Fails (ENCODE, c2, row, col));
+    mxDestroyArray (c1);
+    mxDestroyArray (c2);
+    mxDestroyArray (c3);
+    mxDestroyArray (col);
+    mxDestroyArray (row);
+    mxDestroyArray (r);
+    mxDestroyArray (img);
+}
+
+int main ()
+{
+    try
+    {
+        test1 ();
+        test2 ();
+        test3 ();
+
+        return 0;
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+    catch (const mexError &e)
+    {
+        cerr << e.what () << endl;
+        return -1;
+    }
+}